@@ -0,0 +1,397 @@
+#include "util.h"
+
+#include "vm.h"
+#include "compiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/**
+ * @brief A script run by the VM, with the check telling whether the run computed what it should have.
+ */
+struct vm_benchmark
+{
+    std::string name;
+    std::string source;
+    std::function<bool(primal::vm&)> check;
+};
+
+/**
+ * @brief A generated script fed to the compiler, made of the given number of functions and blocks.
+ */
+struct compiler_benchmark
+{
+    std::string name;
+    int units;
+};
+
+struct result
+{
+    std::string name;
+    std::string kind;
+    bool ok = true;
+    uint64_t instructions = 0;      // per run, for the VM benchmarks
+    uint64_t source_bytes = 0;      // for the compiler benchmarks
+    std::vector<uint64_t> times;    // of the timed iterations, in nanoseconds
+};
+
+// both the VM and the compiler are chatty on the standard output, which is not what is measured
+class quiet final
+{
+public:
+    quiet() : m_saved(std::cout.rdbuf(m_null.rdbuf())) {}
+    ~quiet() { std::cout.rdbuf(m_saved); }
+
+private:
+    std::ostringstream m_null;
+    std::streambuf* m_saved;
+};
+
+uint64_t g_ffi_sum = 0;
+
+std::vector<vm_benchmark> vm_benchmarks()
+{
+    return {
+        {"vm_arithmetic_loop", R"code(
+            var i, s
+            let i = 0
+            let s = 0
+            while i < 100000
+               let s = s + i * 3 - 1
+               let i = i + 1
+            end
+        )code", [](primal::vm& v) { return v.get_mem(word_size) == 14999750000; }},
+
+        // the iterative one of the compiler tests, the functions of the scripts do not return values yet
+        {"vm_fibonacci", R"code(
+            var t1, t2, nextTerm, n, k
+            let k = 0
+            :outer
+            let n = 1000000
+            let t1 = 0
+            let t2 = 1
+            :again
+            let nextTerm = t1 + t2
+            let t1 = t2
+            let t2 = nextTerm
+            if nextTerm < n then
+                goto again
+            end
+            let k = k + 1
+            if k < 1000 then
+                goto outer
+            end
+        )code", [](primal::vm& v) { return v.get_mem(0) == 1000 && v.get_mem(3 * word_size) == 1346269; }},
+
+        // the script compiler cannot index with a variable yet, the indexing is done by hand
+        {"vm_array_indexing", R"code(
+            var number data[64]
+            asm MOV $r5 0
+            asm MOV $r8 0
+            :outer
+            asm MOV $r6 0
+            :inner
+            asm MOV $r7 $r6
+            asm MUL $r7 8
+            asm ADD [$r7] $r6
+            asm ADD $r8 [$r7]
+            asm ADD $r6 1
+            asm LT $r6 64
+            asm JT inner
+            asm ADD $r5 1
+            asm LT $r5 1000
+            asm JT outer
+        )code", [](primal::vm& v) { return v.r(8).value() == 1009008000 && v.get_mem(63 * word_size) == 63000; }},
+
+        // every assignment of the literal copies it into the memory of the variable
+        {"vm_string_copy", R"code(
+            var string a
+            var k
+            let k = 0
+            while k < 100000
+               let a = "The quick brown fox jumps over the lazy dog, again and again and again"
+               let k = k + 1
+            end
+        )code", [](primal::vm& v) { return v.get_mem(0) == 100000; }},
+
+        {"vm_call_ret", R"code(
+            var a, k
+            fun f(integer x)
+               let a = a + x
+            end
+            let k = 0
+            while k < 100000
+               f(1)
+               let k = k + 1
+            end
+        )code", [](primal::vm& v) { return v.get_mem(0) == 100000; }},
+
+        // the host function is called directly with CALLN
+        {"vm_ffi_call", R"code(
+            fun bench_add(integer x) int extern
+            end
+            var k
+            let k = 0
+            while k < 10000
+               bench_add(k)
+               let k = k + 1
+            end
+        )code", [](primal::vm& v) { return g_ffi_sum == 49995000; }},
+    };
+}
+
+std::vector<compiler_benchmark> compiler_benchmarks()
+{
+    return {
+        {"compiler_generated_100", 100},
+        {"compiler_generated_1000", 1000},
+    };
+}
+
+std::string generate_source(int units)
+{
+    std::ostringstream s;
+    s << "var a, b, c, k\n";
+    for(int i = 0; i < units; i++)
+    {
+        s << "fun f" << i << "(integer x)\n"
+          << "   let a = a + x * " << i << "\n"
+          << "   if a > 1000 then\n"
+          << "      let a = a - 1000\n"
+          << "   end\n"
+          << "end\n";
+    }
+    s << "let a = 0\nlet b = 0\nlet c = 0\n";
+    for(int i = 0; i < units; i++)
+    {
+        s << "let c = (a + " << i << ") * 2 - b / 3\n"
+          << "let k = 0\n"
+          << "while k < 10\n"
+          << "   let b = b + k\n"
+          << "   let k = k + 1\n"
+          << "end\n"
+          << "if c > " << i << " then\n"
+          << "   let b = b - 1\n"
+          << "end\n"
+          << "f" << i << "(c)\n";
+    }
+    return s.str();
+}
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point started)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+}
+
+result run_vm_benchmark(const vm_benchmark& b, int iterations, bool jit)
+{
+    result r;
+    r.name = b.name;
+    r.kind = "vm";
+
+    std::vector<uint8_t> app;
+    {
+        quiet q;
+        auto c = primal::compiler::create();
+        c->compile(b.source);
+        app = c->bytecode();
+    }
+
+    // the same machine runs all the iterations, like the workers of a vm_pool do
+    auto v = primal::vm::create();
+#ifdef TICKS
+    v->set_speed(0);
+#endif
+
+    // a run with an unreachable budget counts the instructions, the timed runs go without the meter
+    {
+        quiet q;
+        g_ffi_sum = 0;
+        v->set_instruction_budget(std::numeric_limits<uint64_t>::max());
+        r.ok = v->run(app) && b.check(*v);
+        r.instructions = v->executed_instructions();
+        v->set_instruction_budget(0);
+    }
+    v->set_jit(jit);
+
+    for(int i = 0; i < iterations && r.ok; i++)
+    {
+        quiet q;
+        g_ffi_sum = 0;
+        auto started = std::chrono::steady_clock::now();
+        bool finished = v->run(app);
+        r.times.push_back(elapsed_ns(started));
+        r.ok = finished && b.check(*v);
+    }
+
+    return r;
+}
+
+result run_compiler_benchmark(const compiler_benchmark& b, int iterations)
+{
+    result r;
+    r.name = b.name;
+    r.kind = "compiler";
+
+    std::string source = generate_source(b.units);
+    r.source_bytes = source.size();
+
+    for(int i = 0; i < iterations && r.ok; i++)
+    {
+        quiet q;
+        auto c = primal::compiler::create();
+        auto started = std::chrono::steady_clock::now();
+        c->compile(source);
+        std::vector<uint8_t> app = c->bytecode();
+        r.times.push_back(elapsed_ns(started));
+        r.ok = !app.empty();
+    }
+
+    return r;
+}
+
+void write_json(std::ostream& out, const std::vector<result>& results, int iterations, bool jit)
+{
+    out << "{\n"
+        << "  \"suite\": \"primal_bench\",\n"
+        << "  \"word_size\": " << word_size << ",\n"
+#ifdef TICKS
+        << "  \"ticks\": true,\n"
+#else
+        << "  \"ticks\": false,\n"
+#endif
+        << "  \"jit\": " << (jit ? "true" : "false") << ",\n"
+        << "  \"iterations\": " << iterations << ",\n"
+        << "  \"benchmarks\": [";
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const result& r = results[i];
+        std::vector<uint64_t> sorted = r.times;
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t min = sorted.empty() ? 0 : sorted.front();
+        uint64_t median = sorted.empty() ? 0 : sorted[sorted.size() / 2];
+        uint64_t total = 0;
+        for(uint64_t t : sorted)
+        {
+            total += t;
+        }
+        uint64_t mean = sorted.empty() ? 0 : total / sorted.size();
+
+        out << (i ? "," : "") << "\n    {\n"
+            << "      \"name\": \"" << r.name << "\",\n"
+            << "      \"kind\": \"" << r.kind << "\",\n"
+            << "      \"ok\": " << (r.ok ? "true" : "false") << ",\n";
+        if(r.kind == "vm")
+        {
+            double per_second = median ? static_cast<double>(r.instructions) * 1e9 / static_cast<double>(median) : 0.0;
+            out << "      \"instructions\": " << r.instructions << ",\n"
+                << "      \"instructions_per_second\": " << static_cast<uint64_t>(per_second) << ",\n";
+        }
+        else
+        {
+            double per_second = median ? static_cast<double>(r.source_bytes) * 1e9 / static_cast<double>(median) : 0.0;
+            out << "      \"source_bytes\": " << r.source_bytes << ",\n"
+                << "      \"bytes_per_second\": " << static_cast<uint64_t>(per_second) << ",\n";
+        }
+        out << "      \"min_ns\": " << min << ",\n"
+            << "      \"median_ns\": " << median << ",\n"
+            << "      \"mean_ns\": " << mean << "\n"
+            << "    }";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+[[noreturn]] void usage()
+{
+    std::cout << "Primal benchmarks" << std::endl;
+    std::cout << "Usage: primal_bench [--iterations <n>] [--filter <name part>] [--output <results.json>] [--jit]" << std::endl;
+    exit(1);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    util::InputParser input(argc, argv);
+    if(input.cmdOptionExists("-h") || input.cmdOptionExists("--help"))
+    {
+        usage();
+    }
+
+    int iterations = 5;
+    if(!input.getCmdOption("--iterations").empty())
+    {
+        try
+        {
+            iterations = std::max(std::stoi(input.getCmdOption("--iterations")), 1);
+        }
+        catch(const std::exception&)
+        {
+            std::cerr << "Error: Invalid value for --iterations argument." << std::endl;
+            usage();
+        }
+    }
+    const std::string& filter = input.getCmdOption("--filter");
+    bool jit = input.cmdOptionExists("--jit");
+
+    primal::vm::create()->register_function("bench_add", [](word_t x) -> word_t
+                                            {
+                                                g_ffi_sum += static_cast<uint64_t>(x);
+                                                return g_ffi_sum;
+                                            });
+
+    // the progress goes to stderr, so the results can be redirected
+    std::vector<result> results;
+    for(const auto& b : vm_benchmarks())
+    {
+        if(b.name.find(filter) != std::string::npos)
+        {
+            std::cerr << b.name << std::endl;
+            results.push_back(run_vm_benchmark(b, iterations, jit));
+        }
+    }
+    for(const auto& b : compiler_benchmarks())
+    {
+        if(b.name.find(filter) != std::string::npos)
+        {
+            std::cerr << b.name << std::endl;
+            results.push_back(run_compiler_benchmark(b, iterations));
+        }
+    }
+
+    const std::string& output = input.getCmdOption("--output");
+    if(output.empty())
+    {
+        write_json(std::cout, results, iterations, jit);
+    }
+    else
+    {
+        std::ofstream file(output);
+        if(!file)
+        {
+            std::cerr << "Error: Cannot open output file '" << output << "'" << std::endl;
+            return 1;
+        }
+        write_json(file, results, iterations, jit);
+    }
+
+    bool ok = std::all_of(results.begin(), results.end(), [](const result& r) { return r.ok; });
+    if(!ok)
+    {
+        std::cerr << "Error: A benchmark did not compute what it should have." << std::endl;
+    }
+    return ok ? 0 : 2;
+}
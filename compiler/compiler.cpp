@@ -9,6 +9,7 @@
 #include "variable.h"
 #include "hal.h"
 #include "function.h"
+#include "cpp_translator.h"
 
 #include <opcodes.h>
 
@@ -101,7 +102,7 @@ int compiler::next_varcount(fun* holder, const std::string& name)
             int idx = holder->get_parameter_index(p);
             if(idx > 0)
             {
-                return - (idx + 2 );   // if it is a parameter substract: BP - 2 * num-t_size - parcount * num-t_size
+                return - (idx + 3 );   // if it is a parameter substract: BP - 3 * num-t_size - parcount * num-t_size
             }
         }
     }
@@ -380,6 +381,15 @@ compiler::~compiler()
         }
     }
 
+    if (!m_native_source_path.empty()) {
+        try {
+            generate_native_source();
+            std::cout << "Successfully generated C++ translation: " << m_native_source_path << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error generating C++ translation: " << e.what() << std::endl;
+        }
+    }
+
     compiled_code::instance(this).destroy();
     variable::reset();
     fun::reset();
@@ -390,6 +400,11 @@ void compiler::set_interface_header_path(const std::string& path, const std::str
     m_script_name = script_name;
 }
 
+void compiler::set_native_source_path(const std::string& path, const std::string& script_name) {
+    m_native_source_path = path;
+    m_script_name = script_name;
+}
+
 // Generates a C++-safe class name from a filename.
 std::string script_name_to_class_name(const std::string& script_name) {
     std::string base_name = script_name;
@@ -461,7 +476,16 @@ void compiler::generate_variable_interface() const {
     header_file << "    }\n\n";
 
     header_file << "    // --- Generated Accessors ---\n\n";
+    generate_variable_accessors(header_file, "m_vm->");
 
+    header_file << "}; // class " << class_name << "\n\n";
+
+    // Write bytecode definition
+    generate_bytecode_definition(header_file, class_name);
+    header_file << "#endif\n";
+}
+
+void compiler::generate_variable_accessors(std::ostream& out, const std::string& memory) const {
     word_t current_location = 0;
     for (const auto& var_info : variable::get_declarations()) {
         const auto& name = std::get<0>(var_info);
@@ -474,57 +498,114 @@ void compiler::generate_variable_interface() const {
             word_t base_address = current_location * word_size;
 
             if (size > 1) { // It's an array
-                header_file << "    // Array: var " << to_string(type) << " " << name << "[" << size << "]\n";
+                out << "    // Array: var " << to_string(type) << " " << name << "[" << size << "]\n";
                 if (type == entity_type::ET_NUMERIC) {
-                    header_file << "    word_t get_" << name << "(size_t index) {\n";
-                    header_file << "        if (index >= " << size << ") { throw std::out_of_range(\"Index out of bounds for array '" << name << "'.\"); }\n";
-                    header_file << "        return m_vm->get_mem(" << base_address << " + index * word_size);\n";
-                    header_file << "    }\n\n";
-                    header_file << "    void set_" << name << "(size_t index, word_t value) {\n";
-                    header_file << "        if (index >= " << size << ") { throw std::out_of_range(\"Index out of bounds for array '" << name << "'.\"); }\n";
-                    header_file << "        m_vm->set_mem(" << base_address << " + index * word_size, value);\n";
-                    header_file << "    }\n\n";
+                    out << "    word_t get_" << name << "(size_t index) {\n";
+                    out << "        if (index >= " << size << ") { throw std::out_of_range(\"Index out of bounds for array '" << name << "'.\"); }\n";
+                    out << "        return " << memory << "get_mem(" << base_address << " + index * word_size);\n";
+                    out << "    }\n\n";
+                    out << "    void set_" << name << "(size_t index, word_t value) {\n";
+                    out << "        if (index >= " << size << ") { throw std::out_of_range(\"Index out of bounds for array '" << name << "'.\"); }\n";
+                    out << "        " << memory << "set_mem(" << base_address << " + index * word_size, value);\n";
+                    out << "    }\n\n";
                 }
                 // Note: Setters for string arrays are complex and omitted for now.
             } else { // It's a scalar variable
-                header_file << "    // Scalar: var " << to_string(type) << " " << name << "\n";
+                out << "    // Scalar: var " << to_string(type) << " " << name << "\n";
                 if (type == entity_type::ET_NUMERIC) {
-                    header_file << "    word_t get_" << name << "() {\n";
-                    header_file << "        return m_vm->get_mem(" << base_address << ");\n";
-                    header_file << "    }\n\n";
-                    header_file << "    void set_" << name << "(word_t value) {\n";
-                    header_file << "        m_vm->set_mem(" << base_address << ", value);\n";
-                    header_file << "    }\n\n";
+                    out << "    word_t get_" << name << "() {\n";
+                    out << "        return " << memory << "get_mem(" << base_address << ");\n";
+                    out << "    }\n\n";
+                    out << "    void set_" << name << "(word_t value) {\n";
+                    out << "        " << memory << "set_mem(" << base_address << ", value);\n";
+                    out << "    }\n\n";
                 } else if (type == entity_type::ET_STRING) {
-                    header_file << "    std::string get_" << name << "() {\n";
-                    header_file << "        word_t string_addr = m_vm->get_mem(" << base_address << ");\n";
-                    header_file << "        if (string_addr == 0) return \"\"; // Uninitialized string\n";
-                    header_file << "        uint8_t len = m_vm->get_mem_byte(string_addr);\n";
-                    header_file << "        std::string result;\n";
-                    header_file << "        result.reserve(len);\n";
-                    header_file << "        for (uint8_t i = 0; i < len; ++i) {\n";
-                    header_file << "            result += static_cast<char>(m_vm->get_mem_byte(string_addr + 1 + i));\n";
-                    header_file << "        }\n";
-                    header_file << "        return result;\n";
-                    header_file << "    }\n\n";
+                    out << "    std::string get_" << name << "() {\n";
+                    out << "        word_t string_addr = " << memory << "get_mem(" << base_address << ");\n";
+                    out << "        if (string_addr == 0) return \"\"; // Uninitialized string\n";
+                    out << "        uint8_t len = " << memory << "get_mem_byte(string_addr);\n";
+                    out << "        std::string result;\n";
+                    out << "        result.reserve(len);\n";
+                    out << "        for (uint8_t i = 0; i < len; ++i) {\n";
+                    out << "            result += static_cast<char>(" << memory << "get_mem_byte(string_addr + 1 + i));\n";
+                    out << "        }\n";
+                    out << "        return result;\n";
+                    out << "    }\n\n";
                     // Note: A setter for strings would require memory allocation inside the VM, which is complex.
                 }
             }
             current_location += size;
         }
     }
+}
 
-    header_file << "}; // class " << class_name << "\n\n";
-
-    // Write bytecode definition
-    header_file << "const unsigned char " << class_name << "::s_bytecode[] = {\n    ";
+void compiler::generate_bytecode_definition(std::ostream& out, const std::string& class_name) const {
+    const auto bc = compiled_code::instance(const_cast<compiler*>(this)).bytecode();
+    out << "const unsigned char " << class_name << "::s_bytecode[] = {\n    ";
     for (size_t i = 0; i < bc.size(); ++i) {
-        header_file << "0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bc[i]);
+        out << "0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bc[i]);
         if (i != bc.size() - 1) {
-            header_file << ", ";
+            out << ", ";
         }
         if ((i + 1) % 16 == 0) {
-            header_file << "\n    ";
+            out << "\n    ";
         }
     }
-    header_file << "\n};\n#endif\n";}
+    out << std::dec << "\n};\n";
+}
+
+void compiler::generate_native_source() const {
+    std::ofstream source_file(m_native_source_path);
+    if (!source_file.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + m_native_source_path);
+    }
+
+    std::string class_name = script_name_to_class_name(m_script_name);
+    const auto bc = compiled_code::instance(const_cast<compiler*>(this)).bytecode();
+
+    // The same class as the one in the interface header, but running the script natively instead of in a VM
+    source_file << "// Generated by the Primal Compiler for script '" << m_script_name << "' - Do not edit!\n";
+    source_file << "// Native translation of the bytecode, a drop-in replacement for the class of the interface header.\n";
+    source_file << "#ifndef " << util::to_upper(class_name) << "_PRIM_NATIVE_H\n";
+    source_file << "#define " << util::to_upper(class_name) << "_PRIM_NATIVE_H\n";
+
+    source_file << "#define TARGET_ARCH " << TARGET_ARCH<< "\n";
+
+    source_file << "#include <numeric_decl.h>\n";
+    source_file << "#include <vm.h>\n";
+    source_file << "#include <interface.h>\n";
+    source_file << "#include <algorithm>\n";
+    source_file << "#include <cstring>\n";
+    source_file << "#include <iostream>\n";
+    source_file << "#include <string>\n";
+    source_file << "#include <stdexcept>\n";
+    source_file << "#include <type_traits>\n";
+    source_file << "#include <vector>\n";
+    source_file << "#include <cstdint>\n\n";
+
+    source_file << "class " << class_name << " {\n";
+    source_file << "    static const unsigned char s_bytecode[];\n";
+    source_file << "    static const size_t s_bytecode_len = " << bc.size() << ";\n\n";
+
+    source_file << "public:\n";
+    source_file << "    " << class_name << "() {\n";
+    source_file << "        load_image();\n";
+    source_file << "    }\n\n";
+
+    // FFI Registration
+    source_file << "    template<typename Callable>\n";
+    source_file << "    void register_function(const std::string& name, Callable func) {\n";
+    source_file << "        primal::function_registry::instance().add(name, func);\n";
+    source_file << "    }\n\n";
+
+    translate_to_cpp(bc, source_file);
+
+    source_file << "\npublic:\n\n";
+    source_file << "    // --- Generated Accessors ---\n\n";
+    generate_variable_accessors(source_file, "");
+
+    source_file << "}; // class " << class_name << "\n\n";
+
+    generate_bytecode_definition(source_file, class_name);
+    source_file << "#endif\n";
+}
@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <ostream>
 
 #include "source.h"
 #include "numeric_decl.h"
@@ -182,6 +183,17 @@ public:
      */
     void set_interface_header_path(const std::string& path, const std::string& script_name);
 
+    /**
+     * @brief Set the path of the C++ translation of the compiled script.
+     *
+     * The translation is a class with the same interface as the one in the interface
+     * header, which runs the script natively instead of in a VM.
+     *
+     * @param path Path to the C++ source file.
+     * @param script_name Name of the script being compiled.
+     */
+    void set_native_source_path(const std::string& path, const std::string& script_name);
+
 private:
     /**
      * @brief Generate the interface for variables.
@@ -191,6 +203,29 @@ private:
      */
     void generate_variable_interface() const;
 
+    /**
+     * @brief Generate the C++ translation of the compiled script.
+     *
+     * Used internally after compilation, the bytecode is translated by @ref translate_to_cpp.
+     */
+    void generate_native_source() const;
+
+    /**
+     * @brief Write the accessors of the global variables.
+     *
+     * @param out The stream receiving the accessors.
+     * @param memory The prefix of the get_mem/set_mem calls reaching the memory of the script.
+     */
+    void generate_variable_accessors(std::ostream& out, const std::string& memory) const;
+
+    /**
+     * @brief Write the definition of the embedded bytecode array of the given class.
+     *
+     * @param out The stream receiving the definition.
+     * @param class_name The class having the s_bytecode static member.
+     */
+    void generate_bytecode_definition(std::ostream& out, const std::string& class_name) const;
+
     /// @brief Source object containing the script.
     source m_src;
 
@@ -206,6 +241,9 @@ private:
     /// @brief Path to the generated interface header.
     std::string m_interface_header_path;
 
+    /// @brief Path to the generated C++ translation.
+    std::string m_native_source_path;
+
     /// @brief Name of the script currently being compiled.
     std::string m_script_name;
 };
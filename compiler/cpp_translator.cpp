@@ -0,0 +1,876 @@
+#include "cpp_translator.h"
+#include "types.h"
+
+#include <hal.h>
+#include <decoded_operand.h>
+#include <opcodes.h>
+
+#include <array>
+#include <cstring>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace primal;
+
+namespace
+{
+
+// what the translator needs to know about an opcode
+struct opcode_info
+{
+    std::string name;
+    word_t paramcount = -1;
+};
+
+const std::array<opcode_info, 256> opcode_infos = []() -> std::array<opcode_info, 256> {
+    std::array<opcode_info, 256> arr;
+#define PRIMAL_TRANSLATOR_ENTRY(name, code) arr[code] = { #name, opcodes::name().paramcount() };
+    PRIMAL_OPCODE_LIST(PRIMAL_TRANSLATOR_ENTRY)
+#undef PRIMAL_TRANSLATOR_ENTRY
+    return arr;
+}();
+
+// the exit marker closing the code of the application
+constexpr uint8_t EXIT = 0xFF;
+
+// the instruction pointer of the VM, only updated by the translated code when an instruction refers to it
+constexpr uint8_t IP = 250;
+
+// the flag register of the VM
+constexpr uint8_t FLAG = 253;
+
+// the frame pointer and the stack pointer of the VM
+constexpr uint8_t FP = 254;
+constexpr uint8_t SP = 255;
+
+struct instruction
+{
+    uint8_t opcode = 0;
+    uint8_t operand_count = 0;
+    decoded_operand operands[3];
+    word_t address = 0;
+    word_t next = 0;
+    word_t target = -1;     // the address a jump with an immediate target lands on, -1 if not known
+};
+
+bool is_opcode(uint8_t opc, const opcodes::opcode& o)
+{
+    return opc == o.bin();
+}
+
+bool is_absolute_jump(uint8_t opc)
+{
+    return is_opcode(opc, opcodes::JMP()) || is_opcode(opc, opcodes::JT()) || is_opcode(opc, opcodes::JNT()) || is_opcode(opc, opcodes::CALL())
+        || is_opcode(opc, opcodes::CALLA());
+}
+
+// the delta of the relative jumps is always their last operand
+bool is_relative_jump(uint8_t opc)
+{
+    return is_opcode(opc, opcodes::DJMP()) || is_opcode(opc, opcodes::DJT()) || is_opcode(opc, opcodes::DJNT())
+        || is_opcode(opc, opcodes::DJEQ()) || is_opcode(opc, opcodes::DJNEQ()) || is_opcode(opc, opcodes::DJLT())
+        || is_opcode(opc, opcodes::DJGT()) || is_opcode(opc, opcodes::DJLTE()) || is_opcode(opc, opcodes::DJGTE())
+        || is_opcode(opc, opcodes::IDJLTE());
+}
+
+// the instructions after which the execution does not simply continue with the next one
+bool ends_block(uint8_t opc)
+{
+    return opc == EXIT || is_absolute_jump(opc) || is_relative_jump(opc) || is_opcode(opc, opcodes::RET()) || is_opcode(opc, opcodes::LEAVE());
+}
+
+// false for the instructions which never continue with the next one
+bool falls_through(uint8_t opc)
+{
+    return opc != EXIT && !is_opcode(opc, opcodes::JMP()) && !is_opcode(opc, opcodes::DJMP())
+        && !is_opcode(opc, opcodes::CALL()) && !is_opcode(opc, opcodes::RET())
+        && !is_opcode(opc, opcodes::CALLA()) && !is_opcode(opc, opcodes::LEAVE());
+}
+
+bool is_byte_of_register(type_destination t)
+{
+    switch(t)
+    {
+    case type_destination::TYPE_MOD_REG_BYTE:   // [[fallthrough]]
+    case type_destination::TYPE_MOD_REG_BYTE0:
+    case type_destination::TYPE_MOD_REG_BYTE1:
+    case type_destination::TYPE_MOD_REG_BYTE2:
+    case type_destination::TYPE_MOD_REG_BYTE3:
+#if TARGET_ARCH == 64
+    case type_destination::TYPE_MOD_REG_BYTE4:
+    case type_destination::TYPE_MOD_REG_BYTE5:
+    case type_destination::TYPE_MOD_REG_BYTE6:
+    case type_destination::TYPE_MOD_REG_BYTE7:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_memory(type_destination t)
+{
+    switch(t)
+    {
+    case type_destination::TYPE_MOD_MEM_IMM:    // [[fallthrough]]
+    case type_destination::TYPE_MOD_MEM_IMM_BYTE:
+    case type_destination::TYPE_MOD_MEM_REG_IDX:
+    case type_destination::TYPE_MOD_MEM_REG_BYTE:
+    case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
+    case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_immediate(type_destination t)
+{
+    return t == type_destination::TYPE_MOD_IMM || t == type_destination::TYPE_MOD_IMM_BYTE;
+}
+
+// true if the operand reads or writes the given register
+bool uses_register(const decoded_operand& o, uint8_t r)
+{
+    if(is_immediate(o.type) || o.type == type_destination::TYPE_MOD_MEM_IMM || o.type == type_destination::TYPE_MOD_MEM_IMM_BYTE)
+    {
+        return false;
+    }
+    return o.ridx == r || (o.type == type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS && o.ridx2 == r);
+}
+
+std::string literal(word_t v)
+{
+    if(v == std::numeric_limits<word_t>::min())
+    {
+        return "(-" + std::to_string(std::numeric_limits<word_t>::max()) + " - 1)";
+    }
+    return v < 0 ? "(" + std::to_string(v) + ")" : std::to_string(v);
+}
+
+std::string register_expr(uint8_t r)
+{
+    return "m_r[" + std::to_string(r) + "]";
+}
+
+std::string label(word_t address)
+{
+    return "L_" + std::to_string(address);
+}
+
+/*
+ * Writes the statements of the instructions, one braced block each, so the gotos never skip an initialization.
+ */
+class block_writer
+{
+public:
+
+    block_writer(std::ostream& out, const std::set<word_t>& labels) : m_out(out), m_labels(labels) {}
+
+    void write(const instruction& ins)
+    {
+        m_ins = &ins;
+        line("// " + std::to_string(ins.address) + ": " + (ins.opcode == EXIT ? std::string("EXIT") : opcode_infos[ins.opcode].name));
+        line("{");
+
+        bool uses_ip = false;
+        for(uint8_t i = 0; i < ins.operand_count; i++)
+        {
+            uses_ip = uses_ip || uses_register(ins.operands[i], IP);
+        }
+        if(uses_ip)
+        {
+            statement(register_expr(IP) + " = " + literal(ins.next) + ";");
+        }
+
+        // the memory operands are resolved (and checked) before anything is executed, just like the VM does
+        for(uint8_t i = 0; i < ins.operand_count; i++)
+        {
+            const auto& o = ins.operands[i];
+            if(is_memory(o.type))
+            {
+                statement("uint8_t* const p" + std::to_string(i) + " = at(" + address_of(o) + ", " + std::to_string(width_of(o)) + ");");
+            }
+        }
+
+        body(ins.opcode);
+
+        // an instruction might have changed the instruction pointer itself
+        if(uses_ip && !ends_block(ins.opcode))
+        {
+            statement("if(" + register_expr(IP) + " != " + literal(ins.next) + ") { ip = " + register_expr(IP) + "; continue; }");
+        }
+
+        line("}");
+    }
+
+private:
+
+    void body(uint8_t opc)
+    {
+        if(opc == EXIT)
+        {
+            statement(register_expr(IP) + " = " + literal(m_ins->next) + ";");
+            statement("return true;");
+        }
+        else if(is_opcode(opc, opcodes::MOV()))
+        {
+            statement(assign(0, value(1)));
+            set_flag_from_destination();
+        }
+        else if(is_opcode(opc, opcodes::ADD())) arithmetic("+");
+        else if(is_opcode(opc, opcodes::SUB())) arithmetic("-");
+        else if(is_opcode(opc, opcodes::MUL())) arithmetic("*");
+        else if(is_opcode(opc, opcodes::AND())) arithmetic("&");
+        else if(is_opcode(opc, opcodes::OR()))  arithmetic("|");
+        else if(is_opcode(opc, opcodes::XOR())) arithmetic("^");
+        else if(is_opcode(opc, opcodes::DIV()) || is_opcode(opc, opcodes::MOD()))
+        {
+            statement("if(" + value(1) + " == 0) panic(\"Division by 0\");");
+            arithmetic(is_opcode(opc, opcodes::DIV()) ? "/" : "%");
+        }
+        else if(is_opcode(opc, opcodes::EQ()))  compare("==");
+        else if(is_opcode(opc, opcodes::NEQ())) compare("!=");
+        else if(is_opcode(opc, opcodes::LT()))  compare("<");
+        else if(is_opcode(opc, opcodes::GT()))  compare(">");
+        else if(is_opcode(opc, opcodes::LTE())) compare("<=");
+        else if(is_opcode(opc, opcodes::GTE())) compare(">=");
+        else if(is_opcode(opc, opcodes::NOT()))
+        {
+            statement(assign(0, "!" + value(0)));
+            set_flag_from_destination();
+        }
+        else if(is_opcode(opc, opcodes::INC()))
+        {
+            statement(assign(0, value(0) + " + 1"));
+        }
+        else if(is_opcode(opc, opcodes::JMP()) || is_opcode(opc, opcodes::DJMP()))
+        {
+            jump("");
+        }
+        else if(is_opcode(opc, opcodes::JT()) || is_opcode(opc, opcodes::JNT()))
+        {
+            // the flag is cleared only when not jumping
+            jump(std::string(is_opcode(opc, opcodes::JT()) ? "" : "!") + register_expr(FLAG));
+            statement(register_expr(FLAG) + " = 0;");
+        }
+        else if(is_opcode(opc, opcodes::DJT()) || is_opcode(opc, opcodes::DJNT()))
+        {
+            statement(std::string("const bool taken = ") + (is_opcode(opc, opcodes::DJT()) ? "" : "!") + register_expr(FLAG) + ";");
+            statement(register_expr(FLAG) + " = 0;");
+            jump("taken");
+        }
+        else if(is_opcode(opc, opcodes::DJEQ()))  compare_and_branch("==");
+        else if(is_opcode(opc, opcodes::DJNEQ())) compare_and_branch("!=");
+        else if(is_opcode(opc, opcodes::DJLT()))  compare_and_branch("<");
+        else if(is_opcode(opc, opcodes::DJGT()))  compare_and_branch(">");
+        else if(is_opcode(opc, opcodes::DJLTE())) compare_and_branch("<=");
+        else if(is_opcode(opc, opcodes::DJGTE())) compare_and_branch(">=");
+        else if(is_opcode(opc, opcodes::IDJLTE()))
+        {
+            statement(assign(0, value(0) + " + 1"));
+            compare_and_branch("<=");
+        }
+        else if(is_opcode(opc, opcodes::PUSH()))
+        {
+            statement("push(" + value(0) + ");");
+        }
+        else if(is_opcode(opc, opcodes::POP()))
+        {
+            statement("const word_t v = pop();");
+            statement(assign(0, "v"));
+        }
+        else if(is_opcode(opc, opcodes::CALL()))
+        {
+            // the destination is fetched before the return address is pushed
+            if(m_ins->target == -1 || !m_labels.count(m_ins->target))
+            {
+                statement("const word_t destination = " + value(0) + ";");
+                statement("push(" + literal(m_ins->next) + ");");
+                jump("", "destination");
+            }
+            else
+            {
+                statement("push(" + literal(m_ins->next) + ");");
+                jump("");
+            }
+        }
+        else if(is_opcode(opc, opcodes::RET()))
+        {
+            statement("ip = pop();");
+            statement("continue;");
+        }
+        else if(is_opcode(opc, opcodes::CALLA()))
+        {
+            // the argument count goes below the return address, for the LEAVE of the function
+            if(m_ins->target == -1 || !m_labels.count(m_ins->target))
+            {
+                statement("const word_t destination = " + value(0) + ";");
+                statement("push(" + value(1) + ");");
+                statement("push(" + literal(m_ins->next) + ");");
+                jump("", "destination");
+            }
+            else
+            {
+                statement("push(" + value(1) + ");");
+                statement("push(" + literal(m_ins->next) + ");");
+                jump("");
+            }
+        }
+        else if(is_opcode(opc, opcodes::ENTER()))
+        {
+            statement("push(" + register_expr(FP) + ");");
+            statement(register_expr(FP) + " = " + register_expr(SP) + ";");
+            statement(register_expr(SP) + " -= " + value(0) + ";");
+        }
+        else if(is_opcode(opc, opcodes::LEAVE()))
+        {
+            statement(register_expr(SP) + " = " + register_expr(FP) + ";");
+            statement(register_expr(FP) + " = pop();");
+            statement("ip = pop();");
+            statement("const word_t argc = pop();");
+            statement(register_expr(SP) + " -= argc * word_size;");
+            statement("continue;");
+        }
+        else if(is_opcode(opc, opcodes::COPY()))
+        {
+            statement("copy(" + value(0) + ", " + value(1) + ", " + value(2) + ");");
+        }
+        else if(is_opcode(opc, opcodes::INTR()))
+        {
+            statement("interrupt(" + value(0) + ");");
+        }
+        else if(is_opcode(opc, opcodes::CALLN()))
+        {
+            statement("call_native(" + value(0) + ");");
+        }
+        else if(is_opcode(opc, opcodes::YIELD()))
+        {
+            // the translated application owns its thread, there is no host to give it back to
+        }
+        else
+        {
+            throw std::runtime_error("The opcode " + opcode_infos[opc].name + " has no C++ translation");
+        }
+    }
+
+    void arithmetic(const std::string& op)
+    {
+        statement(assign(0, value(0) + " " + op + " " + value(1)));
+        set_flag_from_destination();
+    }
+
+    void compare(const std::string& op)
+    {
+        statement(register_expr(FLAG) + " = " + value(0) + " " + op + " " + value(1) + ";");
+    }
+
+    void compare_and_branch(const std::string& op)
+    {
+        statement("const bool taken = " + value(0) + " " + op + " " + value(1) + ";");
+        statement(register_expr(FLAG) + " = 0;");
+        jump("taken");
+    }
+
+    // the flag reflects the destination as it is after the write, a byte operand is already truncated
+    void set_flag_from_destination()
+    {
+        statement(register_expr(FLAG) + " = " + value(0) + " != 0;");
+    }
+
+    // jumps to the target of the instruction if the condition holds (always, if it is empty)
+    void jump(const std::string& condition, const std::string& computed = "")
+    {
+        std::string prefix = condition.empty() ? "" : "if(" + condition + ") ";
+        if(m_ins->target != -1 && m_labels.count(m_ins->target))
+        {
+            statement(prefix + "goto " + label(m_ins->target) + ";");
+            return;
+        }
+
+        std::string destination = computed;
+        if(destination.empty())
+        {
+            destination = is_relative_jump(m_ins->opcode) ? literal(m_ins->next) + " + " + value(m_ins->operand_count - 1u) : value(0);
+        }
+        statement(prefix + "{ ip = " + destination + "; continue; }");
+    }
+
+    std::string value(size_t i) const
+    {
+        const auto& o = m_ins->operands[i];
+        const std::string p = "p" + std::to_string(i);
+        if(is_immediate(o.type))
+        {
+            return literal(o.imm);
+        }
+        if(o.type == type_destination::TYPE_MOD_REG)
+        {
+            return register_expr(o.ridx);
+        }
+        if(is_byte_of_register(o.type))
+        {
+            return "get_byte(" + register_expr(o.ridx) + ", " + std::to_string(byte_index(o.type)) + ")";
+        }
+        return width_of(o) == 1 ? "word_t(*" + p + ")" : "load(" + p + ")";
+    }
+
+    std::string assign(size_t i, const std::string& v) const
+    {
+        const auto& o = m_ins->operands[i];
+        const std::string p = "p" + std::to_string(i);
+        if(is_immediate(o.type))
+        {
+            return "panic(\"invalid binary: cannot assign to a numeric value\");";
+        }
+        if(o.type == type_destination::TYPE_MOD_REG)
+        {
+            return register_expr(o.ridx) + " = " + v + ";";
+        }
+        if(is_byte_of_register(o.type))
+        {
+            return "put_byte(" + register_expr(o.ridx) + ", " + std::to_string(byte_index(o.type)) + ", " + v + ");";
+        }
+        return width_of(o) == 1 ? "*" + p + " = static_cast<uint8_t>(" + v + ");" : "store(" + p + ", " + v + ");";
+    }
+
+    static uint8_t byte_index(type_destination t)
+    {
+        if(t == type_destination::TYPE_MOD_REG_BYTE)
+        {
+            return 0;
+        }
+        return static_cast<uint8_t>(static_cast<uint8_t>(t) - static_cast<uint8_t>(type_destination::TYPE_MOD_REG_BYTE0));
+    }
+
+    static word_t width_of(const decoded_operand& o)
+    {
+        return o.type == type_destination::TYPE_MOD_MEM_IMM || o.type == type_destination::TYPE_MOD_MEM_REG_IDX ? word_size : 1;
+    }
+
+    static std::string address_of(const decoded_operand& o)
+    {
+        switch(o.type)
+        {
+        case type_destination::TYPE_MOD_MEM_IMM:        // [[fallthrough]]
+        case type_destination::TYPE_MOD_MEM_IMM_BYTE:
+            return literal(o.imm);
+        case type_destination::TYPE_MOD_MEM_REG_IDX:    // [[fallthrough]]
+        case type_destination::TYPE_MOD_MEM_REG_BYTE:
+            return register_expr(o.ridx);
+        case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
+            return register_expr(o.ridx) + " " + static_cast<char>(o.op) + " " + literal(o.imm);
+        case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+            return register_expr(o.ridx) + " " + static_cast<char>(o.op) + " " + register_expr(o.ridx2);
+        default:
+            throw std::runtime_error("Not a memory operand: " + to_string(o.type));
+        }
+    }
+
+    void line(const std::string& s) { m_out << "                " << s << "\n"; }
+    void statement(const std::string& s) { m_out << "                    " << s << "\n"; }
+
+    std::ostream& m_out;
+    const std::set<word_t>& m_labels;
+    const instruction* m_ins = nullptr;
+};
+
+// decodes the code section of the application, the addresses are the ones it has in the memory of the VM
+std::vector<instruction> decode(const std::vector<uint8_t>& mem, word_t code_start, word_t code_end)
+{
+    std::vector<instruction> result;
+    word_t at = code_start;
+    while(at < code_end)
+    {
+        instruction ins;
+        ins.address = at;
+        ins.opcode = mem[static_cast<size_t>(at++)];
+
+        if(ins.opcode != EXIT)
+        {
+            const auto& info = opcode_infos[ins.opcode];
+            if(info.paramcount < 0 || info.paramcount > 3)
+            {
+                throw std::runtime_error("Invalid opcode at " + std::to_string(ins.address));
+            }
+
+            ins.operand_count = static_cast<uint8_t>(info.paramcount);
+            for(uint8_t i = 0; i < ins.operand_count; i++)
+            {
+                if(!decode_operand(mem.data(), code_end, at, ins.operands[i]))
+                {
+                    throw std::runtime_error("Invalid operand of the instruction at " + std::to_string(ins.address));
+                }
+            }
+
+            const auto& first = ins.operands[0];
+            const auto& last = ins.operands[ins.operand_count > 0 ? ins.operand_count - 1 : 0];
+            if(is_absolute_jump(ins.opcode) && first.type == type_destination::TYPE_MOD_IMM)
+            {
+                ins.target = first.imm;
+            }
+            else if(is_relative_jump(ins.opcode) && last.type == type_destination::TYPE_MOD_IMM)
+            {
+                ins.target = at + last.imm;
+            }
+        }
+
+        ins.next = at;
+        result.push_back(ins);
+    }
+
+    return result;
+}
+
+// a function of the function table of the bytecode, the address is the one in the memory of the VM
+struct table_function
+{
+    std::string name;
+    word_t address = 0;
+    bool is_extern = false;
+};
+
+// the functions of the application from the function table of the bytecode, in the order of the table
+std::vector<table_function> function_table(const std::vector<uint8_t>& bytecode)
+{
+    std::vector<table_function> result;
+    auto read = [&bytecode](size_t& at, size_t n) {
+        if(at + n > bytecode.size())
+        {
+            throw std::runtime_error("Unexpected end of the function table");
+        }
+        size_t from = at;
+        at += n;
+        return &bytecode[from];
+    };
+    auto read_word = [&read](size_t& at) {
+        word_t v = 0;
+        std::memcpy(&v, read(at, sizeof(v)), sizeof(v));
+        return htovm(v);
+    };
+
+    size_t at = 4;
+    size_t table = static_cast<size_t>(read_word(at)) + 4;
+    word_t count = read_word(table);
+    for(word_t i = 0; i < count; i++)
+    {
+        uint8_t len = *read(table, 1);
+        std::string name(reinterpret_cast<const char*>(read(table, len)), len);
+        word_t address = read_word(table);
+        bool is_extern = *read(table, 1) != 0;
+        read(table, 1);     // the return type
+        read(table, *read(table, 1));
+        result.push_back({name, address + VM_MEM_SEGMENT_SIZE, is_extern});
+    }
+    return result;
+}
+
+}
+
+void primal::translate_to_cpp(const std::vector<uint8_t>& bytecode, std::ostream& out)
+{
+    if(bytecode.size() < static_cast<size_t>(PRIMAL_HEADER_SIZE))
+    {
+        throw std::runtime_error("The bytecode is too small to contain a valid header");
+    }
+
+    // the memory image, exactly as the VM sets it up
+    const word_t memory_size = VM_MEM_SEGMENT_SIZE + static_cast<word_t>(bytecode.size());
+    std::vector<uint8_t> mem(static_cast<size_t>(memory_size), 0);
+    std::copy(bytecode.begin(), bytecode.end(), mem.begin() + VM_MEM_SEGMENT_SIZE);
+
+    word_t stack_offset = 0;
+    word_t string_table = 0;
+    std::memcpy(&stack_offset, &bytecode[4 + sizeof(word_t)], sizeof(word_t));
+    std::memcpy(&string_table, &bytecode[4 + 2 * sizeof(word_t)], sizeof(word_t));
+
+    const word_t code_start = VM_MEM_SEGMENT_SIZE + PRIMAL_HEADER_SIZE;
+    const word_t code_end = VM_MEM_SEGMENT_SIZE + htovm(string_table);
+    if(code_end < code_start || code_end > memory_size)
+    {
+        throw std::runtime_error("Invalid code section in the bytecode");
+    }
+
+    const auto instructions = decode(mem, code_start, code_end);
+
+    std::set<word_t> boundaries;
+    for(const auto& ins : instructions)
+    {
+        boundaries.insert(ins.address);
+    }
+
+    // the targets of the gotos, and the addresses the dynamic jumps can land on
+    std::set<word_t> labels;
+    std::set<word_t> entries { code_start };
+    for(const auto& ins : instructions)
+    {
+        if(ins.target != -1 && boundaries.count(ins.target))
+        {
+            labels.insert(ins.target);
+            entries.insert(ins.target);
+        }
+        if(ends_block(ins.opcode) || is_opcode(ins.opcode, opcodes::CALL()) || is_opcode(ins.opcode, opcodes::CALLA()))
+        {
+            entries.insert(ins.next);
+        }
+    }
+    const auto functions = function_table(bytecode);
+    for(const auto& f : functions)
+    {
+        if(!f.is_extern && boundaries.count(f.address))
+        {
+            entries.insert(f.address);
+        }
+    }
+
+    out << "public:\n\n";
+    out << "    // Runs the translated application from the beginning, gives back true when it reaches its end\n";
+    out << "    bool run()\n";
+    out << "    {\n";
+    out << "        load_image();\n";
+    out << "        word_t ip = " << literal(code_start) << ";\n";
+    out << "        for(;;)\n";
+    out << "        {\n";
+    out << "            switch(ip)\n";
+    out << "            {\n";
+    out << "            default:\n";
+    out << "                panic(\"No translated code at address \" + std::to_string(ip));\n";
+
+    block_writer writer(out, labels);
+    const instruction* previous = nullptr;
+    for(const auto& ins : instructions)
+    {
+        if(entries.count(ins.address))
+        {
+            if(previous && falls_through(previous->opcode))
+            {
+                out << "                [[fallthrough]];\n";
+            }
+            out << "            case " << literal(ins.address) << ":\n";
+        }
+        if(labels.count(ins.address))
+        {
+            out << "            " << label(ins.address) << ":\n";
+        }
+        writer.write(ins);
+        previous = &ins;
+    }
+    if(entries.count(code_end))
+    {
+        if(previous && falls_through(previous->opcode))
+        {
+            out << "                [[fallthrough]];\n";
+        }
+        out << "            case " << literal(code_end) << ":\n";
+    }
+    out << "                panic(\"Ran past the end of the code\");\n";
+    out << "            }\n";
+    out << "        }\n";
+    out << "    }\n\n";
+
+    out << R"(    word_t get_mem(word_t address) { return load(at(address, word_size)); }
+    void set_mem(word_t address, word_t new_value) { store(at(address, word_size), new_value); }
+    uint8_t get_mem_byte(word_t address) { return *at(address, 1); }
+    void set_mem_byte(word_t address, uint8_t b) { *at(address, 1) = b; }
+    word_t r(uint8_t i) const { return m_r[i]; }
+
+private:
+
+    [[noreturn]] static void panic(const std::string& s)
+    {
+        throw std::runtime_error("[VM panic] " + s);
+    }
+
+    uint8_t* at(word_t address, word_t width)
+    {
+        if(address < 0 || address + width > static_cast<word_t>(m_mem.size()))
+        {
+            panic("Memory overflow/underflow error. Invalid access at:" + std::to_string(address));
+        }
+        return &m_mem[static_cast<size_t>(address)];
+    }
+
+    static word_t load(const uint8_t* p)
+    {
+        word_t v = 0;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static void store(uint8_t* p, word_t v)
+    {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    using uword_t = std::make_unsigned_t<word_t>;
+
+    static word_t get_byte(word_t r, int b)
+    {
+        return static_cast<word_t>((static_cast<uword_t>(r) >> (8 * b)) & 0xFF);
+    }
+
+    static void put_byte(word_t& r, int b, word_t v)
+    {
+        const uword_t mask = static_cast<uword_t>(0xFF) << (8 * b);
+        r = static_cast<word_t>((static_cast<uword_t>(r) & ~mask) | ((static_cast<uword_t>(v) << (8 * b)) & mask));
+    }
+
+    void push(word_t v)
+    {
+        store(at()" << register_expr(255) << R"(, word_size), v);
+        )" << register_expr(255) << R"( += word_size;
+        if()" << register_expr(255) << " > " << VM_MEM_SEGMENT_SIZE << R"()
+        {
+            panic("Stack Overflow Error");
+        }
+    }
+
+    word_t pop()
+    {
+        if()" << register_expr(255) << R"( - word_size < 0)
+        {
+            panic("Stack Underflow Error");
+        }
+        word_t v = load(at()" << register_expr(255) << R"( - word_size, word_size));
+        )" << register_expr(255) << R"( -= word_size;
+        return v;
+    }
+
+    void copy(word_t dest, word_t src, word_t cnt)
+    {
+        if(dest + cnt > )" << VM_MEM_SEGMENT_SIZE << R"( || src < 0 || dest < 0)
+        {
+            panic("Invalid memory copy");
+        }
+        std::memmove(at(dest, cnt), at(src, cnt), static_cast<size_t>(cnt));
+    }
+
+    void interrupt(word_t i)
+    {
+        switch(i)
+        {
+        case 1: print(); break;
+        case 2: call_foreign(); break;
+        default: panic("Unimplemented interrupt called: " + std::to_string(i));
+        }
+    }
+
+    // interrupt 1: prints the number in r2 if r1 is 0, otherwise r1 characters of the string at r2
+    void print()
+    {
+        if(m_r[1] == 0)
+        {
+            std::cout << m_r[2];
+            return;
+        }
+        word_t addr = m_r[2];
+        word_t len = m_r[1];
+        while(len)
+        {
+            char c = static_cast<char>(get_mem_byte(addr++));
+            len --;
+            if(c != '\\')
+            {
+                std::cout << c;
+            }
+            else if(len)
+            {
+                c = static_cast<char>(get_mem_byte(addr++));
+                len --;
+                if(c == 'n')
+                {
+                    std::cout << std::endl;
+                }
+            }
+        }
+    }
+
+    // interrupt 2: calls the extern function with the index in r249, the way CALLN does
+    void call_foreign()
+    {
+        call_native()" << register_expr(249) << R"();
+    }
+
+    // calls the extern function with the given index through the function registry, with the arguments on the stack
+    void call_native(word_t index)
+    {
+        std::string name;
+        switch(index)
+        {
+)";
+    word_t native = 0;
+    for(const auto& f : functions)
+    {
+        if(f.is_extern)
+        {
+            out << "        case " << native++ << ": name = \"" << f.name << "\"; break;\n";
+        }
+    }
+    out << R"(        default: panic("Unknown extern function called: " + std::to_string(index));
+        }
+
+        word_t arg_count = pop();
+        primal::script_args args;
+        for(word_t i = 0; i < arg_count; i++)
+        {
+            word_t value = pop();
+            if(pop() == )" << static_cast<word_t>(entity_type::ET_STRING) << R"()
+            {
+                std::string s;
+                uint8_t len = get_mem_byte(value);
+                for(uint8_t j = 0; j < len; j++)
+                {
+                    s += static_cast<char>(get_mem_byte(value + 1 + j));
+                }
+                args.push_back(s);
+            }
+            else
+            {
+                args.push_back(value);
+            }
+        }
+        std::reverse(args.begin(), args.end());
+
+        primal::script_value result = primal::function_registry::instance().call(name, args);
+        if(std::holds_alternative<word_t>(result))
+        {
+            m_r[0] = std::get<word_t>(result);
+        }
+        else if(std::holds_alternative<std::string>(result))
+        {
+            const auto& s = std::get<std::string>(result);
+            if(s.length() > 255)
+            {
+                panic("FFI string return value is too long (max 255 characters).");
+            }
+            set_mem_byte()" << STRING_RESULT_INDEX_IN_MEM << R"(, static_cast<uint8_t>(s.length()));
+            for(size_t i = 0; i < s.length(); i++)
+            {
+                set_mem_byte()" << STRING_RESULT_INDEX_IN_MEM << R"( + 1 + static_cast<word_t>(i), static_cast<uint8_t>(s[i]));
+            }
+            m_r[0] = )" << STRING_RESULT_INDEX_IN_MEM << R"(;
+        }
+        else
+        {
+            m_r[0] = 0;
+        }
+    }
+
+    // sets up the memory and the registers the way the VM does before running the application
+    void load_image()
+    {
+        m_mem.assign()" << memory_size << R"(, 0);
+        std::copy(s_bytecode, s_bytecode + s_bytecode_len, m_mem.begin() + )" << VM_MEM_SEGMENT_SIZE << R"();
+        std::fill(std::begin(m_r), std::end(m_r), 0);
+        )" << register_expr(250) << " = " << literal(code_start) << R"(;
+        )" << register_expr(251) << " = " << VM_MEM_SEGMENT_SIZE << R"(;
+        )" << register_expr(252) << " = " << register_expr(255) << " = " << literal(stack_offset * word_size) << R"(;
+    }
+
+    word_t m_r[256] = {};
+    std::vector<uint8_t> m_mem;
+)";
+}
@@ -0,0 +1,32 @@
+#ifndef PRIMAL_CPP_TRANSLATOR_H
+#define PRIMAL_CPP_TRANSLATOR_H
+
+#include <ostream>
+#include <vector>
+#include <cstdint>
+
+namespace primal
+{
+
+/**
+ * @brief Translates the code section of a compiled application into C++ source.
+ *
+ * The members of a class are written, which run the application natively: the registers are an array,
+ * the memory is a buffer initialized from the bytecode just like the VM does it, and every basic block of
+ * the code section becomes a straight-line sequence of C++ statements. The jumps with an immediate target
+ * are translated to gotos, all the other ones (returns, computed jumps) go through a switch over the
+ * addresses starting a basic block. The print interrupt is translated, the foreign functions are called
+ * through the @ref function_registry of the interface, everything else fails the run.
+ *
+ * The written members expect the class to have a static `s_bytecode` array of `s_bytecode_len` bytes.
+ *
+ * @param bytecode The compiled application, the foreign functions are looked up in its function table.
+ * @param out Receives the members of the class.
+ *
+ * @throws std::runtime_error If the code section cannot be decoded.
+ */
+void translate_to_cpp(const std::vector<uint8_t>& bytecode, std::ostream& out);
+
+}
+
+#endif // PRIMAL_CPP_TRANSLATOR_H
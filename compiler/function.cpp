@@ -140,43 +140,29 @@ void fun::parse()
 
 bool fun::compile(compiler* c)
 {
+    // the extern functions have no code, their callers call them directly with CALLN
+    if(is_extern())
+    {
+        return true;
+    }
+
     label fun_label = label::create(c->get_source());
     fun_label.set_name(m_name);
     (*c->generator()) << declare_label(fun_label);
 
     set_address(compiled_code::instance(c).location());
 
-    // now the header for the function
-    (*c->generator()) << PUSH() << reg(254);                 // save R254 somewhere
-    (*c->generator()) << MOV()  << reg(254) << reg(255);     // save the SP into R254
-    (*c->generator()) << SUB()  << reg(255) <<  type_destination::TYPE_MOD_IMM <<             // Decrease the stack pointer to skip the pushed r254 and return address
-#if TARGET_ARCH == 32
-        (8);                                        // For 32 bit builds we decrease with 8
-#else
-        (16);                                       // For 64 bit builds decrease with 16
-#endif
+    // now the header for the function: save R254, point it to the top of the stack, and decrease the stack
+    // pointer to skip the pushed r254, the return address and the argument count pushed by CALLA
+    (*c->generator()) << ENTER() << type_destination::TYPE_MOD_IMM << (3 * word_size);
 
-    if(!is_extern())
-    {
-        for(const auto& seq : m_body)
-        {
-            seq->compile(c);
-        }
-    }
-    else
+    for(const auto& seq : m_body)
     {
-        //compiled_code::instance(c).string_encountered(m_name);
-
-        (*c->generator()) << MOV() << reg(249) << reg(250);
-        (*c->generator()) << SUB() << reg(249) << type_destination::TYPE_MOD_IMM  << (25);
-        (*c->generator()) << INTR() << type_destination::TYPE_MOD_IMM << (2);
+        seq->compile(c);
     }
 
-    (*c->generator()) << MOV() << reg(255) << reg(254);     // Restore the stack pointer
-    (*c->generator()) << POP() << reg(254);                 // restore R254 to what it was before
-
-    // and then return to the caller
-    (*c->generator()) << RET();
+    // restore the stack pointer and R254, return to the caller and drop the arguments
+    (*c->generator()) << LEAVE();
     return true;
 }
 
@@ -212,6 +198,24 @@ bool fun::is_extern() const
     return m_extern;
 }
 
+word_t fun::native_index() const
+{
+    // the extern functions are numbered in the order of the function table, the VM links them the same way
+    word_t index = 0;
+    for(const auto& f : m_functions)
+    {
+        if(f.second.get() == this)
+        {
+            return index;
+        }
+        if(f.second->is_extern())
+        {
+            index++;
+        }
+    }
+    throw syntax_error("Internal compiler error. Lost the extern function:" + m_name);
+}
+
 void fun::set_extern(bool newExtern)
 {
     m_extern = newExtern;
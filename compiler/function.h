@@ -81,6 +81,9 @@ namespace primal {
         bool is_extern() const;
         void set_extern(bool newExtern);
 
+        // the index CALLN calls the extern function with, valid once all the functions were registered
+        word_t native_index() const;
+
     private:
 
         static std::map<std::string, std::shared_ptr<fun>> m_functions;
@@ -171,14 +171,16 @@ bool primal::function_call::compile(primal::compiler *c)
         pushed_params++;
     }
 
-    // perform the actual call
-    (*c->generator()) << opcodes::CALL() << label(c->get_source(), f->name());
-
-    // clean up stack
-    (*c->generator()) << opcodes::SUB()
-                      << reg(255)
-                      << type_destination::TYPE_MOD_IMM
-                      << (pushed_params * word_size);
+    // the extern functions are called directly, they pop their arguments
+    if(f->is_extern())
+    {
+        (*c->generator()) << opcodes::CALLN() << type_destination::TYPE_MOD_IMM << f->native_index();
+        return true;
+    }
+
+    // perform the actual call, the LEAVE of the function cleans up the stack
+    (*c->generator()) << opcodes::CALLA() << label(c->get_source(), f->name())
+                      << type_destination::TYPE_MOD_IMM << pushed_params;
 
     return true;
 }
@@ -8,6 +8,7 @@
 #include "util.h"
 #include "exceptions.h"
 #include "variable.h"
+#include "ast.h"
 
 #include <options.h>
 
@@ -85,6 +86,29 @@ sequence::prepared_type kw_for::prepare(std::vector<token>& tokens) {
     return sequence::prepared_type::PT_CONSUMED;
 }
 
+bool kw_for::depends_on_iterator(const std::shared_ptr<ast>& node) const
+{
+    if (!node) {
+        return false;
+    }
+
+    // function calls might read the iterator too, so they are treated as if they did
+    token::type tt = node->data.get_type();
+    if (tt == token::type::TT_FUNCTION_CALL || (tt == token::type::TT_VARIABLE && node->data.data() == m_iterator_name)) {
+        return true;
+    }
+
+    if (depends_on_iterator(node->left) || depends_on_iterator(node->right)) {
+        return true;
+    }
+    for (const auto& child : node->children) {
+        if (depends_on_iterator(child)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool kw_for::compile(compiler* c)
 {
 
@@ -110,18 +134,11 @@ bool kw_for::compile(compiler* c)
     label lbl_loop_body = label::create(c->get_source());
     label lbl_loop_end = label::create(c->get_source());
 
-    // Condition Check
+    // Condition Check, only once before entering the loop: skip it if i > end
     (*c->generator()) << declare_label(lbl_loop_start);
     // Evaluate end value and store it (e.g., in r128)
     traverse_ast(128, m_end_seq->root(), c);
-
-    (*c->generator()) << MOV() << reg(0) << m_iterator;
-    // Compare: i <= end
-    (*c->generator()) << LTE() << reg(0) << reg(128);
-    // Jump to body if true
-    (*c->generator()) << DJT() << lbl_loop_body;
-    // Jump to end if false
-    (*c->generator()) << DJMP() << lbl_loop_end;
+    (*c->generator()) << DJGT() << m_iterator << reg(128) << lbl_loop_end;
 
     // Loop Body
     (*c->generator()) << declare_label(lbl_loop_body);
@@ -131,12 +148,19 @@ bool kw_for::compile(compiler* c)
 
     // Increment Step
     // i = i + step_value
+    if (m_step_seq->root()->data.get_type() == token::type::TT_NUMBER && m_step_seq->root()->data.data() == "1"
+            && !depends_on_iterator(m_end_seq->root())) {
+        // the end value is evaluated before incrementing, then i++ and jump back to body if i <= end
+        traverse_ast(128, m_end_seq->root(), c);
+        (*c->generator()) << IDJLTE() << m_iterator << reg(128) << lbl_loop_body;
+    }
+    else {
+        traverse_ast(128, m_step_seq->root(), c);
+        (*c->generator()) << ADD() << m_iterator << reg(128);
 
-    traverse_ast(128, m_step_seq->root(), c);
-    (*c->generator()) << ADD() << m_iterator << reg(128);
-
-    // Jump back to start
-    (*c->generator()) << DJMP() << lbl_loop_start;
+        // Jump back to start
+        (*c->generator()) << DJMP() << lbl_loop_start;
+    }
 
     // End of Loop
     (*c->generator()) << declare_label(lbl_loop_end);
@@ -22,6 +22,9 @@ public:
     std::string name() override { return N; }
 
 private:
+    // whether the value of the expression might change when only the iterator is incremented
+    bool depends_on_iterator(const std::shared_ptr<ast>& node) const;
+
     std::shared_ptr<variable> m_iterator;
     std::string m_iterator_name;
 
@@ -62,31 +62,35 @@ bool kw_if::compile(compiler* c)
         options::instance().asm_stream() << "===" << m_string_seq << "===" << std::endl;
     }
 
-    // to compile the expression on which the IF takes its decision
-    sequence::compile(c);
-
-    // and set up the jumps depending on the trueness of the expression
+    // the labels for the jumps depending on the trueness of the expression
     label lbl_after_if = label::create(c->get_source());
     label lbl_if_body = label::create(c->get_source());
     label lbl_else = label::create(c->get_source());
 
-    // let's get the comparator for this IF
-    comp* comparator = dynamic_cast<comp*>(operators[m_root->data.data()].get());
-    if(!comparator)
-    {
-        throw syntax_error("Invalid IF statement condition. Nothing to compare");
-    }
-    // jump to IF body if condition is ok
-    (*c->generator()) << comparator->jump << lbl_if_body;
-
-    // otherwise jump to else if any
-    if(!m_else_body.empty())
-    {
-        (*c->generator()) << DJMP() << lbl_else;
-    }
-    else
+    // a plain comparison jumps over the IF body in one instruction if it does not hold
+    if(!compile_compare_and_branch(c, m_else_body.empty() ? lbl_after_if : lbl_else, false))
     {
-        (*c->generator()) << DJMP() << lbl_after_if;
+        // to compile the expression on which the IF takes its decision
+        sequence::compile(c);
+
+        // let's get the comparator for this IF
+        comp* comparator = dynamic_cast<comp*>(operators[m_root->data.data()].get());
+        if(!comparator)
+        {
+            throw syntax_error("Invalid IF statement condition. Nothing to compare");
+        }
+        // jump to IF body if condition is ok
+        (*c->generator()) << comparator->jump << lbl_if_body;
+
+        // otherwise jump to else if any
+        if(!m_else_body.empty())
+        {
+            (*c->generator()) << DJMP() << lbl_else;
+        }
+        else
+        {
+            (*c->generator()) << DJMP() << lbl_after_if;
+        }
     }
 
     (*c->generator()) << declare_label(lbl_if_body);
@@ -5,6 +5,8 @@
 #include "registers.h"
 #include "compiler.h"
 #include "exceptions.h"
+#include "operators.h"
+#include "ast.h"
 
 #include <options.h>
 #include <parser.h>
@@ -176,6 +178,13 @@ bool kw_let::compile(compiler* c)
         }
     }
 
+    else if(var_type == entity_type::ET_NUMERIC && !m_variable->is_array() && is_update_of_variable(c))
+    {
+        // let a = a + x with a number or a variable as x is done in place in the memory of the variable
+        auto g = c->generator();
+        (*g) << operators.at(m_root->data.data())->opcode << m_variable;
+        generate_operand(*g, m_root->right, c);
+    }
     else
     {
         // Original logic for non-indexed assignment.
@@ -185,4 +194,15 @@ bool kw_let::compile(compiler* c)
     return false;
 }
 
+bool kw_let::is_update_of_variable(compiler* c) const
+{
+    if(!m_root || m_root->data.get_type() != token::type::TT_OPERATOR || !operators.count(m_root->data.data()))
+    {
+        return false;
+    }
+
+    return m_root->left && m_root->left->data.get_type() == token::type::TT_VARIABLE
+        && m_root->left->data.data() == m_name && is_simple_operand(m_root->right, c);
+}
+
 
@@ -26,6 +26,9 @@ namespace primal
         std::string name() override { return N; }
 
     private:
+        // whether the assignment is a = a <op> x with a number or a variable as x
+        bool is_update_of_variable(compiler* c) const;
+
         std::shared_ptr<variable> m_variable;
         std::string m_name;
         bool m_indexed = false;
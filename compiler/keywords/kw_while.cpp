@@ -43,15 +43,28 @@ bool kw_while::compile(compiler* c)
     }
 
     label lbl_while = label::create(c->get_source());
+    label lbl_after_while = label::create(c->get_source());
+    label lbl_while_body = label::create(c->get_source());
+
+    // a plain comparison is checked once before entering the loop and then at the end of the body,
+    // so every iteration ends in a single compare-and-branch instead of a jump back to the condition
+    if(compile_compare_and_branch(c, lbl_after_while, false))
+    {
+        (*c->generator()) << declare_label(lbl_while_body);
+        for(const auto& seq : m_while_body)
+        {
+            seq->compile(c);
+        }
+        compile_compare_and_branch(c, lbl_while_body, true);
+        (*c->generator()) << declare_label(lbl_after_while);
+        return false;
+    }
+
     (*c->generator()) << declare_label(lbl_while);
 
     // to compile the expression on which the WHILE takes its decision
     sequence::compile(c);
 
-    // and set up the jumps depending on the trueness of the expression
-    label lbl_after_while = label::create(c->get_source());
-    label lbl_while_body = label::create(c->get_source());
-
     // let's get the comparator for this WHILE
     comp* comparator = dynamic_cast<comp*>(operators[m_root->data.data()].get());
     if(!comparator)
@@ -0,0 +1,32 @@
+#include "kw_yield.h"
+#include "opcodes.h"
+#include "generate.h"
+
+#include <compiler.h>
+#include <options.h>
+
+using namespace primal;
+using namespace primal::opcodes;
+
+sequence::prepared_type kw_yield::prepare(std::vector<token>& tokens)
+{
+    if(!tokens.empty())
+    {
+        return sequence::prepared_type::PT_INVALID;
+    }
+
+    return sequence::prepared_type::PT_CONSUMED;
+}
+
+bool kw_yield::compile(compiler* c)
+{
+
+    if(options::instance().generate_assembly())
+    {
+        options::instance().asm_stream() << "===" << m_string_seq << "===" << std::endl;
+    }
+
+    (*c->generator()) << YIELD();
+
+    return true;
+}
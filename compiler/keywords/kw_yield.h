@@ -0,0 +1,23 @@
+#ifndef KW_YIELD_H
+#define KW_YIELD_H
+
+#include "sequence.h"
+#include "keywords.h"
+
+namespace primal
+{
+    class kw_yield : public sequence, public keyword
+    {
+    public:
+        static constexpr const char* N= "YIELD";
+
+        explicit kw_yield(source& src) : sequence(src) {}
+
+        sequence::prepared_type prepare(std::vector<token>& tokens) override;
+        bool compile(compiler* c) override;
+
+        std::string name() override { return N; }
+    };
+}
+
+#endif
@@ -9,7 +9,7 @@
 static void usage()
 {
     std::cout << "Primal compiler" << std::endl;
-    std::cout << "Usage: primc -i <input.prim> -o <output.pric> [--header-out <interface.h>]" << std::endl;
+    std::cout << "Usage: primc -i <input.prim> -o <output.pric> [--header-out <interface.h>] [--emit-cpp <native.h>]" << std::endl;
     exit(1);
 }
 
@@ -24,6 +24,7 @@ int main(int argc, char **argv)
     std::string infile = input.getCmdOption("-i");
     std::string outfile = input.getCmdOption("-o");
     std::string headerfile = input.getCmdOption("--header-out");
+    std::string nativefile = input.getCmdOption("--emit-cpp");
 
     if(infile.empty() || outfile.empty())
     {
@@ -40,6 +41,9 @@ int main(int argc, char **argv)
         if (!headerfile.empty()) {
             c->set_interface_header_path(headerfile, infile); // Pass both paths
         }
+        if (!nativefile.empty()) {
+            c->set_native_source_path(nativefile, infile);
+        }
 
         c->compile(app);
         std::vector<uint8_t> compiled_app = c->bytecode();
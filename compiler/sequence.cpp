@@ -99,17 +99,23 @@ void sequence::traverse_ast(uint8_t level, const std::shared_ptr<ast>& croot, co
         if (croot->children.size() > 0) {
             for (auto it = croot->children.rbegin(); it != croot->children.rend(); ++it) {
                 traverse_ast(0, *it, c);
+                if (f->is_extern()) {
+                    // the extern functions take the type of every argument and the number of them
+                    (*c->generator()) << PUSH() << type_destination::TYPE_MOD_IMM
+                                      << static_cast<word_t>(util::to_integral(entity_type::ET_NUMERIC));
+                }
                 (*c->generator()) << PUSH() << reg(0);
                 pushed_params++;
             }
         }
-        (*c->generator()) << CALL() << label(c->get_source(), f->name());
-        (*c->generator()) << MOV() << reg(level) << reg(0);
-        if (pushed_params > 0) {
-            word_t stack_cleanup_size = pushed_params * word_size;
-            (*c->generator()) << SUB() << reg(255)
-                              << type_destination::TYPE_MOD_IMM << stack_cleanup_size;
+        if (f->is_extern()) {
+            (*c->generator()) << PUSH() << type_destination::TYPE_MOD_IMM << pushed_params;
+            (*c->generator()) << CALLN() << type_destination::TYPE_MOD_IMM << f->native_index();
+        } else {
+            (*c->generator()) << CALLA() << label(c->get_source(), f->name())
+                              << type_destination::TYPE_MOD_IMM << pushed_params;
         }
+        (*c->generator()) << MOV() << reg(level) << reg(0);
         return;
     }
 
@@ -161,13 +167,21 @@ void sequence::traverse_ast(uint8_t level, const std::shared_ptr<ast>& croot, co
             return; // We are done for this branch
         }
 
-        // Existing operator logic
-        traverse_ast(level + 1, croot->left, c);
-        (*c->generator()) << MOV() << reg(level) << reg(level + 1);
-        traverse_ast(level + 1, croot->right, c);
-        (*c->generator()) << operators.at(croot->data.data())->opcode << reg(level) << reg(level + 1) ;
+        // Existing operator logic. The left side goes straight into the target register and a number or
+        // a variable on the right side is used as the operand of the operation without loading it first
+        traverse_ast(level, croot->left, c);
+        if(is_simple_operand(croot->right, c))
+        {
+            auto g = c->generator();
+            (*g) << operators.at(croot->data.data())->opcode << reg(level);
+            generate_operand(*g, croot->right, c);
+        }
+        else
+        {
+            traverse_ast(level + 1, croot->right, c);
+            (*c->generator()) << operators.at(croot->data.data())->opcode << reg(level) << reg(level + 1) ;
+        }
     }
-    // ... (rest of the function is unchanged) ...
     if(tt == token::type::TT_COMPARISON || tt == token::type::TT_LOGICAL)
     {
         traverse_ast(level + 2, croot->left, c);
@@ -234,6 +248,76 @@ void sequence::traverse_ast(uint8_t level, const std::shared_ptr<ast>& croot, co
     }
 }
 
+namespace
+{
+
+// the compare-and-branch superinstruction jumping when the comparison is (or is not, if jump_if is false) true
+std::shared_ptr<opcodes::opcode> compare_and_branch_opcode(const std::string& comparison, bool jump_if)
+{
+    if(comparison == "==") return jump_if ? std::shared_ptr<opcodes::opcode>(new DJEQ)  : std::shared_ptr<opcodes::opcode>(new DJNEQ);
+    if(comparison == "!=") return jump_if ? std::shared_ptr<opcodes::opcode>(new DJNEQ) : std::shared_ptr<opcodes::opcode>(new DJEQ);
+    if(comparison == "<")  return jump_if ? std::shared_ptr<opcodes::opcode>(new DJLT)  : std::shared_ptr<opcodes::opcode>(new DJGTE);
+    if(comparison == ">")  return jump_if ? std::shared_ptr<opcodes::opcode>(new DJGT)  : std::shared_ptr<opcodes::opcode>(new DJLTE);
+    if(comparison == "<=") return jump_if ? std::shared_ptr<opcodes::opcode>(new DJLTE) : std::shared_ptr<opcodes::opcode>(new DJGT);
+    if(comparison == ">=") return jump_if ? std::shared_ptr<opcodes::opcode>(new DJGTE) : std::shared_ptr<opcodes::opcode>(new DJLT);
+    return nullptr;
+}
+
+}
+
+bool sequence::compile_compare_and_branch(compiler *c, const label &target, bool jump_if)
+{
+    if(!m_root || m_root->data.get_type() != token::type::TT_COMPARISON)
+    {
+        return false;
+    }
+
+    auto branch = compare_and_branch_opcode(m_root->data.data(), jump_if);
+    if(!branch)
+    {
+        return false;
+    }
+
+    traverse_ast(1, m_root->left, c);
+    if(is_simple_operand(m_root->right, c))
+    {
+        auto g = c->generator();
+        (*g) << branch << reg(1);
+        generate_operand(*g, m_root->right, c);
+        (*g) << target;
+    }
+    else
+    {
+        traverse_ast(2, m_root->right, c);
+        (*c->generator()) << branch << reg(1) << reg(2) << target;
+    }
+
+    return true;
+}
+
+bool sequence::is_simple_operand(const std::shared_ptr<ast> &node, compiler *c)
+{
+    if(!node)
+    {
+        return false;
+    }
+
+    token::type tt = node->data.get_type();
+    return tt == token::type::TT_NUMBER || (tt == token::type::TT_VARIABLE && c->get_variable(node->data.data()));
+}
+
+void sequence::generate_operand(generate &g, const std::shared_ptr<ast> &node, compiler *c)
+{
+    if(node->data.get_type() == token::type::TT_NUMBER)
+    {
+        g << node->data;
+    }
+    else
+    {
+        g << c->get_variable(node->data.data());
+    }
+}
+
 void sequence::set_string_seq(const std::string &newString_seq)
 {
     m_string_seq = newString_seq;
@@ -13,6 +13,8 @@ namespace primal
     class ast;
     class compiler;
     class function;
+    class label;
+    class generate;
 
     /* A sequence represents a keyword and its attached expression */
     class sequence
@@ -58,6 +60,16 @@ namespace primal
         /* Compiles the simples of the expressions */
         virtual void traverse_ast(uint8_t level, const std::shared_ptr<ast>& croot, compiler* c);
 
+        /* Compiles a plain comparison into a single compare-and-branch instruction jumping to target if the
+        comparison evaluates to jump_if. Returns false, without generating anything, for any other expression */
+        bool compile_compare_and_branch(compiler* c, const label& target, bool jump_if);
+
+        /* Tells whether the node can go straight into an instruction as an operand: a number or a variable */
+        static bool is_simple_operand(const std::shared_ptr<ast>& node, compiler* c);
+
+        /* Generates a node for which is_simple_operand holds as the operand of an instruction */
+        static void generate_operand(generate& g, const std::shared_ptr<ast>& node, compiler* c);
+
     protected:
 
         source& m_src;
@@ -94,6 +94,21 @@ int g_cursor_y = 0;
 int g_regs_scroll_y = 0;
 int g_mem_scroll_y = 0;
 
+// --- Execution: F7 runs the application on a tracing VM ---
+class trace_recorder final : public primal::vm_observer {
+public:
+    void before(primal::vm&, word_t address, uint8_t) override {
+        executed[address - VM_MEM_SEGMENT_SIZE - PRIMAL_HEADER_SIZE]++;
+    }
+    void after(primal::vm&, word_t, uint8_t) override { instructions++; }
+
+    std::map<word_t, uint64_t> executed; // by the address of the disassembly
+    uint64_t instructions = 0;
+};
+std::shared_ptr<primal::vm> g_vm;
+std::shared_ptr<trace_recorder> g_trace;
+std::string g_run_status = "F7 runs the application";
+
 // --- Helper Functions from primdis ---
 template<typename T>
 T read_value(const std::vector<uint8_t>& bytecode, word_t& offset) {
@@ -120,35 +135,9 @@ using OpcodeMap = std::map<uint8_t, std::shared_ptr<primal::opcodes::opcode>>;
 
 OpcodeMap create_opcode_map() {
     OpcodeMap opcodes;
-    opcodes[primal::opcodes::MOV().bin()] = std::make_shared<primal::opcodes::MOV>();
-    opcodes[primal::opcodes::ADD().bin()] = std::make_shared<primal::opcodes::ADD>();
-    opcodes[primal::opcodes::SUB().bin()] = std::make_shared<primal::opcodes::SUB>();
-    opcodes[primal::opcodes::MUL().bin()] = std::make_shared<primal::opcodes::MUL>();
-    opcodes[primal::opcodes::DIV().bin()] = std::make_shared<primal::opcodes::DIV>();
-    opcodes[primal::opcodes::MOD().bin()] = std::make_shared<primal::opcodes::MOD>();
-    opcodes[primal::opcodes::OR().bin()] = std::make_shared<primal::opcodes::OR>();
-    opcodes[primal::opcodes::AND().bin()] = std::make_shared<primal::opcodes::AND>();
-    opcodes[primal::opcodes::EQ().bin()] = std::make_shared<primal::opcodes::EQ>();
-    opcodes[primal::opcodes::NEQ().bin()] = std::make_shared<primal::opcodes::NEQ>();
-    opcodes[primal::opcodes::JT().bin()] = std::make_shared<primal::opcodes::JT>();
-    opcodes[primal::opcodes::JNT().bin()] = std::make_shared<primal::opcodes::JNT>();
-    opcodes[primal::opcodes::JMP().bin()] = std::make_shared<primal::opcodes::JMP>();
-    opcodes[primal::opcodes::LT().bin()] = std::make_shared<primal::opcodes::LT>();
-    opcodes[primal::opcodes::GT().bin()] = std::make_shared<primal::opcodes::GT>();
-    opcodes[primal::opcodes::LTE().bin()] = std::make_shared<primal::opcodes::LTE>();
-    opcodes[primal::opcodes::GTE().bin()] = std::make_shared<primal::opcodes::GTE>();
-    opcodes[primal::opcodes::PUSH().bin()] = std::make_shared<primal::opcodes::PUSH>();
-    opcodes[primal::opcodes::POP().bin()] = std::make_shared<primal::opcodes::POP>();
-    opcodes[primal::opcodes::COPY().bin()] = std::make_shared<primal::opcodes::COPY>();
-    opcodes[primal::opcodes::DJT().bin()] = std::make_shared<primal::opcodes::DJT>();
-    opcodes[primal::opcodes::DJNT().bin()] = std::make_shared<primal::opcodes::DJNT>();
-    opcodes[primal::opcodes::DJMP().bin()] = std::make_shared<primal::opcodes::DJMP>();
-    opcodes[primal::opcodes::XOR().bin()] = std::make_shared<primal::opcodes::XOR>();
-    opcodes[primal::opcodes::NOT().bin()] = std::make_shared<primal::opcodes::NOT>();
-    opcodes[primal::opcodes::CALL().bin()] = std::make_shared<primal::opcodes::CALL>();
-    opcodes[primal::opcodes::RET().bin()] = std::make_shared<primal::opcodes::RET>();
-    opcodes[primal::opcodes::INTR().bin()] = std::make_shared<primal::opcodes::INTR>();
-    opcodes[primal::opcodes::INC().bin()] = std::make_shared<primal::opcodes::INC>();
+#define PRIMAL_OPCODE_MAP_ENTRY(name, code) opcodes[primal::opcodes::name().bin()] = std::make_shared<primal::opcodes::name>();
+    PRIMAL_OPCODE_LIST(PRIMAL_OPCODE_MAP_ENTRY)
+#undef PRIMAL_OPCODE_MAP_ENTRY
     return opcodes;
 }
 
@@ -443,7 +432,7 @@ void draw_status_bar(TextScreen* screen) {
         screen_put_char(screen, x, screen->rows - 1, ' ', TD_BLACK, TD_CYAN);
     }
 
-    const char* bar_text[] = { "F1-Help", "F2-Main", "F3-Funcs", "F4-Strs", "F5-Info", "F6-Set", "F7-Step", "F8-Regs", "F9-Mem", "F10-Exit" };
+    const char* bar_text[] = { "F1-Help", "F2-Main", "F3-Funcs", "F4-Strs", "F5-Info", "F6-Set", "F7-Run", "F8-Regs", "F9-Mem", "F10-Exit" };
     int x = 1;
     for (int i = 0; i < 10; ++i) {
         std::string part = bar_text[i];
@@ -484,7 +473,8 @@ void draw_disassembly_window(TextScreen* screen, int scroll_y, int cursor_y) {
         if (instr_idx >= (int)g_disassembly.size()) break;
 
         const auto& instr = g_disassembly[instr_idx];
-        SDL_Color bg_color = (instr_idx == cursor_y) ? TD_CYAN : TD_BLUE;
+        bool executed = g_trace && g_trace->executed.count(instr.address);
+        SDL_Color bg_color = (instr_idx == cursor_y) ? TD_CYAN : (executed ? TD_LIGHT_BLUE : TD_BLUE);
         SDL_Color default_fg = (instr_idx == cursor_y) ? TD_BLACK : TD_WHITE;
         SDL_Color mnemonic_fg = (instr_idx == cursor_y) ? TD_BLACK : TD_YELLOW;
         SDL_Color reg_fg = (instr_idx == cursor_y) ? TD_BLACK : TD_BRIGHT_WHITE;
@@ -533,6 +523,10 @@ void draw_current_instruction_status(TextScreen* screen, const DisassembledInstr
     // 1. Address
     std::stringstream ss;
     ss << "Address: 0x" << std::hex << std::setw(8) << std::setfill('0') << instr.address;
+    if (g_trace) {
+        auto count = g_trace->executed.find(instr.address);
+        ss << std::dec << "  Executed: " << (count == g_trace->executed.end() ? 0 : count->second) << " times";
+    }
     screen_print(screen, 2, y++, ss.str(), fg, bg);
 
     // 2. Disassembly
@@ -561,12 +555,15 @@ void draw_register_window(TextScreen* screen, int scroll_y) {
     }
     screen_put_char(screen, screen->cols - 2, 8, 185, TD_BRIGHT_WHITE, TD_CYAN);
 
-    screen_print(screen, 2, 1, "$r250 (IP): 0x00000000", TD_WHITE, TD_BLUE);
-    screen_print(screen, 2, 2, "$r251 (MEMSIZE): 1000", TD_WHITE, TD_BLUE);
-    screen_print(screen, 2, 3, "$r252 (STACK_START): 0x0", TD_WHITE, TD_BLUE);
-    screen_print(screen, 2, 4, "$r253 (LOF): 0", TD_WHITE, TD_BLUE);
-    screen_print(screen, 2, 5, "$r254 (FP): 0x0", TD_WHITE, TD_BLUE);
-    screen_print(screen, 2, 6, "$r255 (SP): 0x0", TD_WHITE, TD_BLUE);
+    // the registers of the last run, zero until F7 ran the application
+    auto reg_value = [](int i) -> word_t { return g_vm ? g_vm->r(static_cast<uint8_t>(i)).value() : 0; };
+    const char* special[] = { "IP", "MEMSIZE", "STACK_START", "LOF", "FP", "SP" };
+    for (int i = 0; i < 6; ++i) {
+        std::stringstream ss;
+        ss << "$r" << 250 + i << " (" << special[i] << "): 0x" << std::hex << reg_value(250 + i);
+        screen_print(screen, 2, 1 + i, ss.str(), TD_WHITE, TD_BLUE);
+    }
+    screen_print(screen, 2, 7, g_run_status.substr(0, screen->cols - 4), TD_YELLOW, TD_BLUE);
 
     int y = 9;
     int regs_per_row = 2;
@@ -579,7 +576,7 @@ void draw_register_window(TextScreen* screen, int scroll_y) {
         int col = 2 + (i % regs_per_row) * (screen->cols / regs_per_row);
 
         std::stringstream ss;
-        ss << "$r" << std::left << std::setw(3) << reg_idx << ": " << std::right << std::setw(8) << 0;
+        ss << "$r" << std::left << std::setw(3) << reg_idx << ": " << std::right << std::setw(8) << reg_value(reg_idx);
         screen_print(screen, col, row, ss.str(), TD_WHITE, TD_BLUE);
     }
 }
@@ -665,6 +662,25 @@ void draw_memory_window(TextScreen* screen, const std::vector<uint8_t>& mem_data
     }
 }
 
+void run_application() {
+    // the trace policy calls the recorder around every instruction, a release VM would not
+    g_vm = primal::vm::create(primal::memory_config(), primal::execution_policy::trace);
+#ifdef TICKS
+    g_vm->set_speed(0);
+#endif
+    g_trace = std::make_shared<trace_recorder>();
+    g_vm->set_observer(g_trace);
+
+    try {
+        g_vm->run(g_bytecode);
+        std::stringstream ss;
+        ss << "Finished, " << g_trace->instructions << " instructions";
+        g_run_status = ss.str();
+    } catch (const std::exception& e) {
+        g_run_status = std::string("Stopped: ") + e.what();
+    }
+}
+
 int main(int argc, char** argv) {
     if (argc != 2) {
         std::cerr << "Usage: " << argv[0] << " <input.pric>" << std::endl;
@@ -780,6 +796,7 @@ int main(int argc, char** argv) {
                 case SDLK_F4: g_current_view = WindowState::STRING_TABLE; g_scroll_y = 0; g_cursor_y = 0; break;
                 case SDLK_F5: g_current_view = WindowState::FILE_INFO; g_scroll_y = 0; g_cursor_y = 0; break;
                 case SDLK_F6: g_current_view = WindowState::SETTINGS; g_scroll_y = 0; g_cursor_y = 0; break;
+                case SDLK_F7: run_application(); break;
                 case SDLK_F8:
                     regs_window.is_visible = !regs_window.is_visible;
                     if (regs_window.is_visible) SDL_ShowWindow(regs_window.sdl_window);
@@ -860,7 +877,7 @@ int main(int argc, char** argv) {
                 screen_print(&main_window.screen, 2, 2, "This is the Primal Debugger.", TD_BRIGHT_WHITE, TD_BLUE);
                 screen_print(&main_window.screen, 2, 4, "Use F-keys to navigate between windows.", TD_WHITE, TD_BLUE);
                 screen_print(&main_window.screen, 2, 5, "Use UP/DOWN arrows/mouse to scroll.", TD_WHITE, TD_BLUE);
-                screen_print(&main_window.screen, 2, 7, "F7 and F10 will be used for execution control.", TD_GRAY, TD_BLUE);
+                screen_print(&main_window.screen, 2, 7, "F7 runs the application, the executed instructions are highlighted.", TD_GRAY, TD_BLUE);
             }
         }
         render_text_screen(&main_window);
@@ -0,0 +1,78 @@
+#include "decoded_operand.h"
+
+#include <cstring>
+
+using namespace primal;
+
+bool primal::decode_operand(const uint8_t* mem, word_t mem_size, word_t& at, decoded_operand& o)
+{
+    auto available = [&](word_t n) { return at >= 0 && at + n <= mem_size; };
+
+    if(!available(1))
+    {
+        return false;
+    }
+
+    o.type = static_cast<type_destination>(mem[at++]);
+    switch(o.type)
+    {
+    case type_destination::TYPE_MOD_IMM_BYTE:
+        if(!available(1)) return false;
+        o.imm = mem[at++];
+        return true;
+
+    case type_destination::TYPE_MOD_IMM:        // [[fallthrough]]
+    case type_destination::TYPE_MOD_MEM_IMM:
+    case type_destination::TYPE_MOD_MEM_IMM_BYTE:
+    {
+        if(!available(word_size)) return false;
+        word_t v = 0;
+        std::memcpy(&v, mem + at, sizeof(v));
+        o.imm = htovm(v);
+        at += word_size;
+        return true;
+    }
+
+    case type_destination::TYPE_MOD_REG:        // [[fallthrough]]
+    case type_destination::TYPE_MOD_REG_BYTE:
+    case type_destination::TYPE_MOD_REG_BYTE0:
+    case type_destination::TYPE_MOD_REG_BYTE1:
+    case type_destination::TYPE_MOD_REG_BYTE2:
+    case type_destination::TYPE_MOD_REG_BYTE3:
+#if TARGET_ARCH == 64
+    case type_destination::TYPE_MOD_REG_BYTE4:
+    case type_destination::TYPE_MOD_REG_BYTE5:
+    case type_destination::TYPE_MOD_REG_BYTE6:
+    case type_destination::TYPE_MOD_REG_BYTE7:
+#endif
+    case type_destination::TYPE_MOD_MEM_REG_IDX:
+    case type_destination::TYPE_MOD_MEM_REG_BYTE:
+        if(!available(1)) return false;
+        o.ridx = mem[at++];
+        return true;
+
+    case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
+    {
+        if(!available(2 + word_size)) return false;
+        o.ridx = mem[at++];
+        o.op = mem[at++];
+        word_t v = 0;
+        std::memcpy(&v, mem + at, sizeof(v));
+        o.imm = htovm(v);
+        at += word_size;
+        return true;
+    }
+
+    case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+        if(!available(3)) return false;
+        o.ridx = mem[at++];
+        o.op = mem[at++];
+        o.ridx2 = mem[at++];
+        return true;
+
+    case type_destination::TYPE_MOD_UNKNOWN:
+        return false;
+    }
+
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef PRIMAL_DECODED_OPERAND_H
+#define PRIMAL_DECODED_OPERAND_H
+
+#include <numeric_decl.h>
+#include <type_destination_decl.h>
+
+#include <cstdint>
+
+namespace primal
+{
+
+/**
+ * @brief One operand of an instruction, decoded from its bytecode representation.
+ *
+ * Immediates, addresses and offsets are already converted to host byte order, so
+ * resolving the operand at runtime only needs the current register values.
+ */
+struct decoded_operand
+{
+    /** The addressing mode of the operand, as found in the bytecode. */
+    type_destination type = type_destination::TYPE_MOD_UNKNOWN;
+
+    /** The register index for the register based addressing modes. */
+    uint8_t ridx = 0;
+
+    /** The second register of the [$rX op $rY] addressing mode. */
+    uint8_t ridx2 = 0;
+
+    /** The operation ('+', '-', '*', '/') of the offseted addressing modes. */
+    uint8_t op = 0;
+
+    /** The immediate value, the memory address or the offset, depending on @ref type. */
+    word_t imm = 0;
+
+    /** Set by the verifier when the memory access of the operand is proven to stay within the memory. */
+    bool unchecked = false;
+};
+
+/**
+ * @brief Decodes one operand from the bytecode.
+ *
+ * @param mem The memory holding the bytecode.
+ * @param mem_size The size of the memory.
+ * @param at The address of the operand, advanced past the operand on success.
+ * @param o Receives the decoded operand.
+ * @return False if the operand is malformed or does not fit in the memory.
+ */
+bool decode_operand(const uint8_t* mem, word_t mem_size, word_t& at, decoded_operand& o);
+
+}
+
+#endif // PRIMAL_DECODED_OPERAND_H
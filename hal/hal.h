@@ -6,6 +6,13 @@
 // Holds the number of registers in the virtual machine
 static const int VM_REG_COUNT = 256;
 
+// The special registers: the instruction pointer, the flag of the last operation, the frame pointer of the
+// script functions and the stack pointer
+static const int VM_REG_IP = 250;
+static const int VM_REG_FLAG = 253;
+static const int VM_REG_FP = 254;
+static const int VM_REG_SP = 255;
+
 // The size of the free memory region, 2000 bytes initially can be increased if you feel like
 static const word_t VM_MEM_SEGMENT_SIZE = 2000 /** 1024*/;
 
@@ -0,0 +1,124 @@
+#ifndef OPERAND_H
+#define OPERAND_H
+
+#include "numeric_decl.h"
+#include "registers.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace primal
+{
+
+/**
+ * @brief An operand of an instruction, resolved against the registers and the memory of the VM.
+ *
+ * This is a small value type: it points straight into the storage of the register or into the
+ * memory of the VM (or holds the immediate value itself), so reading and writing it needs no
+ * allocation and no virtual call. It is valid only until the VM changes its memory, so it is
+ * not meant to be kept around between instructions.
+ */
+struct operand
+{
+    // the byte masks of the registers are unsigned
+    using uword_t = std::make_unsigned_t<word_t>;
+
+    /** The kind of storage the operand refers to. */
+    enum class kind : uint8_t
+    {
+        immediate,  // a literal value, cannot be assigned to
+        reg,        // a full register
+        reg_byte,   // one byte of a register
+        mem,        // a word in the memory
+        mem_byte    // a byte in the memory
+    };
+
+    operand() = default;
+
+    /** @brief Creates an immediate operand. */
+    static operand of_immediate(word_t v) { operand o; o.m_kind = kind::immediate; o.m_value = v; return o; }
+
+    /** @brief Creates an operand referring to the given register, in the register file of the VM. */
+    static operand of_reg(word_t& r) { operand o; o.m_kind = kind::reg; o.m_reg = &r; return o; }
+
+    /** @brief Creates an operand referring to the @p bidx th byte of the given register. */
+    static operand of_reg_byte(word_t& r, uint8_t bidx) { operand o; o.m_kind = kind::reg_byte; o.m_reg = &r; o.m_bidx = bidx; return o; }
+
+    /** @brief Creates an operand referring to the word at the given location in the memory. */
+    static operand of_mem(uint8_t* p) { operand o; o.m_kind = kind::mem; o.m_mem = p; return o; }
+
+    /** @brief Creates an operand referring to the byte at the given location in the memory. */
+    static operand of_mem_byte(uint8_t* p) { operand o; o.m_kind = kind::mem_byte; o.m_mem = p; return o; }
+
+    /** @return The current value of the operand. */
+    word_t value() const
+    {
+        switch(m_kind)
+        {
+        case kind::immediate:
+            return m_value;
+        case kind::reg:
+            return *m_reg;
+        case kind::reg_byte:
+            return static_cast<word_t>((static_cast<uword_t>(*m_reg) & masks[m_bidx].first) >> masks[m_bidx].second);
+        case kind::mem:
+        {
+            word_t v = 0;
+            std::memcpy(&v, m_mem, sizeof(v));
+            return v;
+        }
+        case kind::mem_byte:
+            return *m_mem;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Updates the storage the operand refers to. Immediates cannot be assigned to.
+     *
+     * @return The value stored, as value() would read it back: the byte operands keep only the lowest byte.
+     */
+    word_t set_value(word_t v)
+    {
+        switch(m_kind)
+        {
+        case kind::immediate:
+            throw std::runtime_error("invalid binary: cannot assign to a numeric value");
+        case kind::reg:
+            *m_reg = v;
+            return v;
+        case kind::reg_byte:
+        {
+            uword_t bits = (static_cast<uword_t>(v) << masks[m_bidx].second) & masks[m_bidx].first;
+            *m_reg = static_cast<word_t>((static_cast<uword_t>(*m_reg) & ~masks[m_bidx].first) | bits);
+            return static_cast<word_t>(bits >> masks[m_bidx].second);
+        }
+        case kind::mem:
+            std::memcpy(m_mem, &v, sizeof(v));
+            return v;
+        case kind::mem_byte:
+            *m_mem = static_cast<uint8_t>(v);
+            return static_cast<uint8_t>(v);
+        }
+        return 0;
+    }
+
+    /** @return The kind of the operand. */
+    kind get_kind() const { return m_kind; }
+
+    /** @return A debug string representation of this operand. */
+    std::string debug() const;
+
+    kind m_kind = kind::immediate;
+    uint8_t m_bidx = 0;
+    word_t m_value = 0;         // the value of an immediate
+    word_t* m_reg = nullptr;    // the storage of the register for reg and reg_byte
+    uint8_t* m_mem = nullptr;   // the location in the memory for mem and mem_byte
+};
+
+} // namespace primal
+
+#endif // OPERAND_H
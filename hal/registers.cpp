@@ -1,4 +1,5 @@
 #include "registers.h"
+#include "operand.h"
 #include "util.h"
 namespace primal {
 
@@ -7,16 +8,21 @@ std::string reg::debug() const {
     return res;
 }
 
-std::string memaddress::debug() const {
-    return std::string("[") + util::to_string(m_address) + "]";
-}
-
-std::string memaddress_byte_ref::debug() const {
-    return std::string("[@") + util::to_string(m_address) + "]";
-}
-
-std::string reg_subbyte::debug() const  {
-    return  std::string("@") + util::to_string((int)m_bidx) + "/" + m_r->debug();
+std::string operand::debug() const {
+    switch(m_kind)
+    {
+    case kind::immediate:
+        return util::to_string(m_value);
+    case kind::reg:
+        return "reg=(" + util::to_string(*m_reg) + ")";
+    case kind::reg_byte:
+        return std::string("@") + util::to_string((int)m_bidx) + "/reg=(" + util::to_string(*m_reg) + ")";
+    case kind::mem:
+        return std::string("[") + util::to_string(value()) + "]";
+    case kind::mem_byte:
+        return std::string("[@") + util::to_string(value()) + "]";
+    }
+    return "";
 }
 
 std::string immediate::debug() const {
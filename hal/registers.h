@@ -7,7 +7,6 @@
 #include <stdint.h>
 
 #include <map>
-#include <functional>
 #include <array>
 #include <stdexcept>
 
@@ -151,74 +150,58 @@ struct reg final : public valued
 };
 
 /**
- * @brief Represents a memory address reference in the VM.
+ * @brief Refers to a register of a running VM, which keeps its registers as plain words.
  *
- * The memory address is accessed using provided getter and setter functions.
+ * This is what vm::r() gives back: the reads and the writes go straight to the register file of the VM,
+ * while @ref reg stays the register as the compiler and the debugger see it.
  */
-struct memaddress final : public valued
+class register_ref final
 {
-    memaddress() = default;
-    explicit memaddress(word_t address,
-                        std::function<void(word_t, word_t)> setter,
-                        std::function<word_t(word_t)> getter)
-        : m_address(address), m_getter(std::move(getter)), m_setter(std::move(setter)) {}
+public:
+    register_ref(word_t& value, uint8_t index) : m_value(&value), m_reg_idx(index) {}
+    register_ref(const register_ref&) = default;
 
-    void set_value(word_t v) override { m_setter(m_address, v); }
-    word_t value() const override { return m_getter(m_address); }
+    /** @brief Assigns the value of the other register, it does not refer to the other register. */
+    register_ref& operator=(const register_ref& o) { *m_value = *o.m_value; return *this; }
+    register_ref& operator=(word_t v) { *m_value = v; return *this; }
 
-    type_destination get_type() const override { return type_destination::TYPE_MOD_MEM_REG_IDX; }
-    std::string debug() const override;
+    /** Conversion to word_t. */
+    operator word_t() const { return *m_value; }
 
-    word_t m_address = -1;
-    std::function<word_t(word_t)> m_getter;
-    std::function<void(word_t, word_t)> m_setter;
-};
+    /** @return The current value of the register. */
+    word_t value() const { return *m_value; }
 
-/**
- * @brief Represents a byte reference at a memory address.
- *
- * Provides access to individual bytes using byte-level getter and setter functions.
- */
-struct memaddress_byte_ref final : public valued
-{
-    memaddress_byte_ref() = default;
-    explicit memaddress_byte_ref(word_t address,
-                                 std::function<void(word_t, uint8_t)> setter,
-                                 std::function<uint8_t(word_t)> getter)
-        : m_address(address), m_getter(std::move(getter)), m_setter(std::move(setter)) {}
-
-    void set_value(word_t v) override { m_setter(m_address, static_cast<uint8_t>(v)); }
-    word_t value() const override { return m_getter(m_address); }
+    /** @brief Updates the value of the register. */
+    void set_value(word_t v) { *m_value = v; }
 
-    type_destination get_type() const override { return type_destination::TYPE_MOD_MEM_REG_BYTE; }
-    std::string debug() const override;
+    /** @return The register index. */
+    uint8_t idx() const { return m_reg_idx; }
 
-    word_t m_address = -1;
-    std::function<uint8_t(word_t)> m_getter;
-    std::function<void(word_t, uint8_t)> m_setter;
+private:
+    word_t* m_value;
+    uint8_t m_reg_idx;
 };
 
 /**
- * @brief Represents a sub-byte reference of a register.
- *
- * Allows addressing specific bytes within a register using masks and shifts.
+ * @brief Refers to a register of a VM for reading only, what vm::r() gives back for a const VM.
  */
-struct reg_subbyte : public valued
+class const_register_ref final
 {
-    reg_subbyte(reg* r, uint8_t bidx) : m_r(r), m_bidx(bidx) {}
+public:
+    const_register_ref(const word_t& value, uint8_t index) : m_value(&value), m_reg_idx(index) {}
 
-    void set_value(word_t v) override
-    {
-        m_r->set_value(((m_r->value()) |
-                        (((v << masks[m_bidx].second) & masks[m_bidx].first) |
-                         !(masks[m_bidx].first))));
-    }
+    /** Conversion to word_t. */
+    operator word_t() const { return *m_value; }
 
-    type_destination get_type() const override { return type_destination::TYPE_MOD_REG_BYTE; }
-    std::string debug() const override;
+    /** @return The current value of the register. */
+    word_t value() const { return *m_value; }
 
-    reg* m_r;
-    uint8_t m_bidx;
+    /** @return The register index. */
+    uint8_t idx() const { return m_reg_idx; }
+
+private:
+    const word_t* m_value;
+    uint8_t m_reg_idx;
 };
 
 /**
@@ -5,8 +5,17 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <functional>
 #include <variant>
+#include <future>
+#include <chrono>
+#include <string_view>
+#if __has_include(<span>)
+#include <span>
+#endif
 #include <stdexcept>
 #include <tuple>
 #include <utility>
@@ -32,6 +41,82 @@ using script_value = std::variant<std::monostate, word_t, std::string>;
  */
 using script_args = std::vector<script_value>;
 
+/**
+ * @brief An argument of a linked call, as the VM passes it to the function: a number, or a string
+ * viewed in the memory of the VM.
+ */
+struct ffi_arg {
+    word_t value = 0;           ///< The number, or the address of the string.
+    bool is_string = false;     ///< Whether the argument is a string.
+    std::string_view text;      ///< The characters of the string, valid during the call.
+};
+
+/**
+ * @brief The result of an asynchronous function, one which returned a `std::future` or a `std::shared_future`.
+ *
+ * The VM suspends at the call and continues once the result is ready (see vm::resume()).
+ */
+class pending_call {
+public:
+    virtual ~pending_call() = default;
+
+    /** @return Whether get() can return without waiting. */
+    virtual bool ready() const = 0;
+
+    /** @brief Waits for the result. */
+    virtual void wait() const = 0;
+
+    /**
+     * @return The result of the function, waiting for it if needed.
+     * @throws What the function threw.
+     */
+    virtual script_value get() = 0;
+};
+
+/**
+ * @brief A @ref pending_call waiting for a future.
+ *
+ * @tparam Future `std::future<T>` or `std::shared_future<T>`, T being void, `word_t` or `std::string`.
+ */
+template <typename Future>
+class pending_future final : public pending_call {
+public:
+    explicit pending_future(Future f) : future(std::move(f)) {}
+
+    bool ready() const override {
+        // a deferred function runs when asked for its result, it is not waited for
+        return future.wait_for(std::chrono::seconds(0)) != std::future_status::timeout;
+    }
+
+    void wait() const override {
+        future.wait();
+    }
+
+    script_value get() override {
+        if constexpr (std::is_void_v<decltype(future.get())>) {
+            future.get();
+            return std::monostate{};
+        } else {
+            return future.get();
+        }
+    }
+
+private:
+    Future future;
+};
+
+/**
+ * @brief Whether a function returning the given type is asynchronous.
+ */
+template <typename T>
+struct is_future : std::false_type {};
+
+template <typename T>
+struct is_future<std::future<T>> : std::true_type {};
+
+template <typename T>
+struct is_future<std::shared_future<T>> : std::true_type {};
+
 /**
  * @brief Stream output operator for @ref script_value.
  *
@@ -81,6 +166,14 @@ inline std::string get_value_type_name(const script_value& v) {
  * Functions can be lambdas, free functions, or any callable that
  * has a well-defined signature. Arguments are automatically unpacked
  * from `script_args` and converted to the expected C++ types.
+ *
+ * The registry can be used from several threads: functions are called
+ * concurrently, and a function replaced while it is running stays alive
+ * until the calls already running it return.
+ *
+ * A function returning a `std::future` or a `std::shared_future` is
+ * asynchronous: the VM calling it suspends until the result is ready, the
+ * other callers wait for it.
  */
 class function_registry {
 public:
@@ -91,6 +184,18 @@ public:
      */
     using generic_func = std::function<script_value(const script_args&)>;
 
+    /**
+     * @brief Type alias for the wrapper called by the VM through a slot returned by link().
+     *
+     * The arguments are converted straight to the expected C++ types, without building a script_args.
+     */
+    using linked_func = std::function<script_value(const ffi_arg*, std::size_t)>;
+
+    /**
+     * @brief Type alias for the wrapper of an asynchronous function called through a slot.
+     */
+    using linked_async_func = std::function<std::shared_ptr<pending_call>(const ffi_arg*, std::size_t)>;
+
 private:
     /**
      * @brief Metaprogramming helper to deduce function signatures.
@@ -128,6 +233,32 @@ private:
     template <typename C, typename Ret, typename... Args>
     struct function_traits<Ret(C::*)(Args...) const> : function_traits<Ret(Args...)> {};
 
+    /**
+     * @brief Whether a parameter type views the characters of a string argument instead of copying them.
+     *
+     * `std::string_view` parameters (and with C++20 `std::span<const char>` and `std::span<const uint8_t>`)
+     * point straight into the memory of the VM, they are only valid until the function returns.
+     */
+    template <typename T>
+    static constexpr bool is_view_v = std::is_same_v<T, std::string_view>
+#ifdef __cpp_lib_span
+                                      || std::is_same_v<T, std::span<const char>>
+                                      || std::is_same_v<T, std::span<const uint8_t>>
+#endif
+        ;
+
+    /**
+     * @brief Helper to make a view parameter of the given characters.
+     */
+    template <typename T>
+    static T view_of(std::string_view text) {
+        if constexpr (std::is_same_v<T, std::string_view>) {
+            return text;
+        } else {
+            return T(reinterpret_cast<typename T::pointer>(text.data()), text.size());
+        }
+    }
+
     /**
      * @brief Helper to get a typed argument from a @ref script_args vector.
      *
@@ -145,7 +276,11 @@ private:
             throw std::runtime_error("Argument index out of bounds for function '" + func_name + "'.");
         }
         try {
-            return std::get<T>(args[index]);
+            if constexpr (is_view_v<T>) {
+                return view_of<T>(std::get<std::string>(args[index]));
+            } else {
+                return std::get<T>(args[index]);
+            }
         } catch (const std::bad_variant_access&) {
             throw std::runtime_error(
                 "Type mismatch for argument " + std::to_string(index + 1) + " in function '" + func_name +
@@ -168,6 +303,100 @@ private:
         return std::make_tuple(get_arg<std::tuple_element_t<Is, Tuple>>(args, Is, func_name)...);
     }
 
+    /**
+     * @brief Helper to convert an argument of a linked call to the expected C++ type.
+     *
+     * @tparam T Expected argument type.
+     * @param arg The argument.
+     * @param index Argument index, for error reporting.
+     * @param func_name Name of the function being called (for error reporting).
+     * @return The argument as a `T`.
+     *
+     * @throws std::runtime_error If the type is mismatched.
+     */
+    template <typename T>
+    static T get_linked_arg(const ffi_arg& arg, std::size_t index, const std::string& func_name) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            if (arg.is_string) {
+                return std::string(arg.text);
+            }
+        } else if constexpr (is_view_v<T>) {
+            if (arg.is_string) {
+                return view_of<T>(arg.text);
+            }
+        } else {
+            if (!arg.is_string) {
+                return arg.value;
+            }
+        }
+        throw std::runtime_error(
+            "Type mismatch for argument " + std::to_string(index + 1) + " in function '" + func_name +
+            "'. Got " + (arg.is_string ? "string" : "number") + "."
+            );
+    }
+
+    /**
+     * @brief Helper to convert the arguments of a linked call into a C++ tuple.
+     */
+    template <typename Tuple, std::size_t... Is>
+    static Tuple unpack_linked_args_helper(const ffi_arg* args, const std::string& func_name, std::index_sequence<Is...>) {
+        return Tuple(get_linked_arg<std::tuple_element_t<Is, Tuple>>(args[Is], Is, func_name)...);
+    }
+
+    /**
+     * @brief Helper to turn what a function returned into a script value, waiting for the asynchronous ones.
+     *
+     * @tparam Ret The return type of the function.
+     * @param call Calls the function.
+     */
+    template <typename Ret, typename Call>
+    static script_value result_of(Call&& call) {
+        if constexpr (std::is_void_v<Ret>) {
+            call();
+            return std::monostate{};
+        } else if constexpr (is_future<Ret>::value) {
+            return pending_future<Ret>(call()).get();
+        } else {
+            return call();
+        }
+    }
+
+    /**
+     * @brief Helper to check the number of arguments a function was called with.
+     */
+    static void check_arity(std::size_t arity, std::size_t count, const std::string& func_name) {
+        if (arity != count) {
+            throw std::runtime_error(
+                "Error calling '" + func_name + "': Expected " +
+                std::to_string(arity) + " arguments, but got " +
+                std::to_string(count) + "."
+                );
+        }
+    }
+
+    /**
+     * @brief The wrappers of a registered function, linked_async is only set for the asynchronous ones.
+     */
+    struct registered {
+        generic_func generic;
+        linked_func linked;
+        linked_async_func linked_async;
+    };
+
+    /**
+     * @brief The slot of the given name, created empty if the name was not seen yet. Called with the lock held.
+     */
+    std::size_t slot_of(const std::string& name) {
+        auto it = slot_names.find(name);
+        if (it != slot_names.end()) {
+            return it->second;
+        }
+        slots.emplace_back();
+        names.push_back(name);
+        slot_names[name] = slots.size() - 1;
+        return slots.size() - 1;
+    }
+
 public:
     /**
      * @brief Register a function, lambda, or callable under a given name.
@@ -184,25 +413,74 @@ public:
         using ArgsTuple = typename traits::args_tuple;
         using Ret = typename traits::return_type;
 
-        functions[name] = [func = std::move(func), name](const script_args& args) -> script_value {
-            if (traits::arity != args.size()) {
-                throw std::runtime_error(
-                    "Error calling '" + name + "': Expected " +
-                    std::to_string(traits::arity) + " arguments, but got " +
-                    std::to_string(args.size()) + "."
-                    );
-            }
+        auto wrapper = std::make_shared<registered>();
+        wrapper->generic = [func, name](const script_args& args) -> script_value {
+            check_arity(traits::arity, args.size(), name);
 
             // Convert arguments into a tuple
             auto cpp_args_tuple = unpack_args_helper<ArgsTuple>(args, name, std::make_index_sequence<traits::arity>{});
+            return result_of<Ret>([&]() { return std::apply(func, cpp_args_tuple); });
+        };
+        wrapper->linked = [func, name](const ffi_arg* args, std::size_t count) -> script_value {
+            check_arity(traits::arity, count, name);
 
-            if constexpr (std::is_void_v<Ret>) {
-                std::apply(func, cpp_args_tuple);
-                return std::monostate{};
-            } else {
-                return std::apply(func, cpp_args_tuple);
-            }
+            auto cpp_args_tuple = unpack_linked_args_helper<ArgsTuple>(args, name, std::make_index_sequence<traits::arity>{});
+            return result_of<Ret>([&]() { return std::apply(func, cpp_args_tuple); });
         };
+        if constexpr (is_future<Ret>::value) {
+            wrapper->linked_async = [func = std::move(func), name](const ffi_arg* args, std::size_t count) -> std::shared_ptr<pending_call> {
+                check_arity(traits::arity, count, name);
+
+                auto cpp_args_tuple = unpack_linked_args_helper<ArgsTuple>(args, name, std::make_index_sequence<traits::arity>{});
+                return std::make_shared<pending_future<Ret>>(std::apply(func, cpp_args_tuple));
+            };
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        slots[slot_of(name)] = std::move(wrapper);
+    }
+
+    /**
+     * @brief Resolve a name to the slot its function is called through.
+     *
+     * The slot stays the same for the lifetime of the registry, a function registered later under the
+     * name (or replacing the one registered) is found through the same slot.
+     *
+     * @param name The function name.
+     * @return The slot, to be given to call_linked().
+     */
+    std::size_t link(const std::string& name) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return slot_of(name);
+    }
+
+    /**
+     * @brief Call the function of a slot, without looking up its name.
+     *
+     * @param slot The slot returned by link().
+     * @param args The arguments, in the order the function takes them.
+     * @param count The number of arguments.
+     * @param pending If given, an asynchronous function is not waited for: its result is left here and
+     * an empty value is returned.
+     * @return The script value returned by the function.
+     *
+     * @throws std::runtime_error If no function was registered under the name of the slot.
+     */
+    script_value call_linked(std::size_t slot, const ffi_arg* args, std::size_t count,
+                             std::shared_ptr<pending_call>* pending = nullptr) {
+        std::shared_ptr<const registered> func;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            func = slots[slot];
+            if (!func) {
+                throw std::runtime_error("Function not found: " + names[slot]);
+            }
+        }
+        if (pending && func->linked_async) {
+            *pending = func->linked_async(args, count);
+            return std::monostate{};
+        }
+        return func->linked(args, count);
     }
 
     /**
@@ -215,11 +493,18 @@ public:
      * @throws std::runtime_error If the function is not found.
      */
     script_value call(const std::string& name, const script_args& args) {
-        auto it = functions.find(name);
-        if (it == functions.end()) {
-            throw std::runtime_error("Function not found: " + name);
+        std::shared_ptr<const registered> func;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = slot_names.find(name);
+            if (it != slot_names.end()) {
+                func = slots[it->second];
+            }
+            if (!func) {
+                throw std::runtime_error("Function not found: " + name);
+            }
         }
-        return it->second(args);
+        return func->generic(args);
     }
 
     /**
@@ -236,8 +521,17 @@ private:
     /// @brief Private constructor for singleton usage.
     function_registry() = default;
 
-    /// @brief Map of function names to their generic wrappers.
-    std::map<std::string, generic_func> functions;
+    /// @brief The functions, indexed by slot. A slot linked before its function was registered is empty.
+    std::vector<std::shared_ptr<const registered>> slots;
+
+    /// @brief The names of the slots.
+    std::vector<std::string> names;
+
+    /// @brief Map of function names to their slots.
+    std::map<std::string, std::size_t> slot_names;
+
+    /// @brief Guards the slots, the calls only lock it while fetching the function.
+    mutable std::shared_mutex mutex;
 };
 
 } // namespace primal
@@ -5,15 +5,11 @@
 
 bool primal::impl_ADD(primal::vm* v)
 {
-    v->debug(opcodes::ADD(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* dest = v->fetch();
-    primal::valued* src  = v->fetch();
+    primal::operand dest = v->fetch();
+    primal::operand src  = v->fetch();
 
-    *dest += *src;
+    v->set_flag(dest.set_value(dest.value() + src.value()) != 0);
 
-    v->set_flag(dest->value() != 0);
-
-    v->debug(opcodes::ADD(), OpcodeDebugState::VM_DEBUG_AFTER);
     return true;
 }
 
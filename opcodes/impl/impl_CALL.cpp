@@ -6,12 +6,10 @@
 
 bool primal::impl_CALL(primal::vm* v)
 {
-    v->debug(opcodes::CALL(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* dest = v->fetch();
+    primal::operand dest = v->fetch();
     // now push the current IP
     v->push( v->ip() );
     // and now just go to the address where the dest points
-    bool result = v->jump(dest->value());
-    v->debug(opcodes::CALL(), OpcodeDebugState::VM_DEBUG_AFTER);
+    bool result = v->jump(dest.value());
     return result;
 }
@@ -0,0 +1,15 @@
+#include <CALLA.h>
+#include <vm.h>
+
+// CALLA target, argc: calls a script function after the caller pushed its argc arguments. The number of the
+// arguments goes on the stack below the return address, for the LEAVE of the function called to drop them.
+bool primal::impl_CALLA(primal::vm* v)
+{
+    primal::operand dest = v->fetch();
+    primal::operand argc = v->fetch();
+    if(!v->push(argc.value()) || !v->push(v->ip()))
+    {
+        return false;
+    }
+    return v->jump(dest.value());
+}
@@ -0,0 +1,12 @@
+#include <CALLN.h>
+#include <vm.h>
+
+// CALLN index: calls the extern function with the given index in the function table of the application, after
+// the caller pushed its arguments the way interrupt 2 takes them. The arguments are popped by the call, the
+// result goes into r0, and a call waiting for its result suspends the machine after this instruction.
+bool primal::impl_CALLN(primal::vm* v)
+{
+    primal::operand index = v->fetch();
+    v->call_native(index.value());
+    return !v->stop_requested();
+}
@@ -5,18 +5,15 @@
 
 bool primal::impl_DIV(primal::vm* v)
 {
-    v->debug(opcodes::DIV(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* dest = v->fetch();
-    primal::valued* src  = v->fetch();
+    primal::operand dest = v->fetch();
+    primal::operand src  = v->fetch();
 
-    if(src->value() == 0)
+    if(src.value() == 0)
     {
         v->panic("Division by 0");
     }
 
-    *dest /= *src;
-    v->set_flag(dest->value() != 0);
-    v->debug(opcodes::DIV(), OpcodeDebugState::VM_DEBUG_AFTER);
+    v->set_flag(dest.set_value(dest.value() / src.value()) != 0);
     return true;
 }
 
@@ -0,0 +1,15 @@
+#include <DJEQ.h>
+#include <vm.h>
+
+#include <iostream>
+
+// DJEQ a, b, delta: jumps with delta if a == b, the fused form of a comparison followed by a DJT
+bool primal::impl_DJEQ(primal::vm* v)
+{
+    primal::operand first = v->fetch();
+    primal::operand second = v->fetch();
+    auto delta = v->fetch();
+    if(first.value() == second.value()) v->ip() += delta.value();
+    v->set_flag(0);
+    return true;
+}
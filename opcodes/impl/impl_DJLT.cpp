@@ -0,0 +1,15 @@
+#include <DJLT.h>
+#include <vm.h>
+
+#include <iostream>
+
+// DJLT a, b, delta: jumps with delta if a < b, the fused form of a comparison followed by a DJT
+bool primal::impl_DJLT(primal::vm* v)
+{
+    primal::operand first = v->fetch();
+    primal::operand second = v->fetch();
+    auto delta = v->fetch();
+    if(first.value() < second.value()) v->ip() += delta.value();
+    v->set_flag(0);
+    return true;
+}
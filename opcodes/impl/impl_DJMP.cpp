@@ -5,10 +5,8 @@
 
 bool primal::impl_DJMP(primal::vm* v)
 {
-    v->debug(opcodes::DJMP(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    auto* delta = v->fetch();
-    v->ip() += delta->value();
-    v->debug(opcodes::DJMP(), OpcodeDebugState::VM_DEBUG_AFTER);
+    auto delta = v->fetch();
+    v->ip() += delta.value();
     return true;
 }
 
@@ -0,0 +1,18 @@
+#include <ENTER.h>
+#include <vm.h>
+
+// ENTER size: the prologue of the script functions, saves the frame pointer of the caller, points the frame
+// pointer at the top of the stack and moves the stack pointer down with size. The same as the sequence
+// PUSH $r254, MOV $r254 $r255, SUB $r255 size but without touching the flag.
+bool primal::impl_ENTER(primal::vm* v)
+{
+    auto size = v->fetch();
+    if(!v->push(v->r(VM_REG_FP).value()))
+    {
+        return false;
+    }
+    word_t sp = v->r(VM_REG_SP).value();
+    v->r(VM_REG_FP) = sp;
+    v->r(VM_REG_SP) = sp - size.value();
+    return true;
+}
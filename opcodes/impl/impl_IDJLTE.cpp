@@ -0,0 +1,17 @@
+#include <IDJLTE.h>
+#include <vm.h>
+
+#include <iostream>
+
+// IDJLTE counter, limit, delta: increments the counter and jumps with delta if it is still <= limit,
+// the back-edge of a FOR loop with a step of 1
+bool primal::impl_IDJLTE(primal::vm* v)
+{
+    primal::operand counter = v->fetch();
+    primal::operand limit = v->fetch();
+    auto delta = v->fetch();
+    counter.set_value(counter.value() + 1);
+    if(counter.value() <= limit.value()) v->ip() += delta.value();
+    v->set_flag(0);
+    return true;
+}
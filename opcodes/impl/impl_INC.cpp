@@ -4,7 +4,7 @@
 
 bool primal::impl_INC(vm* v)
 {
-    valued* dest = v->fetch();
-    dest->set_value(dest->value() + 1);
+    operand dest = v->fetch();
+    dest.set_value(dest.value() + 1);
     return true;
 }
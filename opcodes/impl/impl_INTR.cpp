@@ -3,10 +3,9 @@
 
 bool primal::impl_INTR(primal::vm* v)
 {
-    v->debug(opcodes::INTR(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    auto* intnr = v->fetch();
-    v->interrupt(intnr->value());
-    v->debug(opcodes::INTR(), OpcodeDebugState::VM_DEBUG_AFTER);
-    return true;
+    auto intnr = v->fetch();
+    v->interrupt(intnr.value());
+    // an interrupt suspending the machine stops the dispatch loop after this instruction
+    return !v->stop_requested();
 }
 
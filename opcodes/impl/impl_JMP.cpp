@@ -5,8 +5,7 @@
 
 bool primal::impl_JMP(primal::vm* v)
 {
-    v->debug(opcodes::JMP(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    auto* loc = v->fetch();
-    return v->jump(loc->value());
+    auto loc = v->fetch();
+    return v->jump(loc.value());
 }
 
@@ -0,0 +1,15 @@
+#include <LEAVE.h>
+#include <vm.h>
+
+// LEAVE: the epilogue of the script functions called by CALLA, restores the stack and the frame pointer of
+// the caller, returns to it and drops the arguments it pushed. The same as the sequence MOV $r255 $r254,
+// POP $r254, RET followed by SUB $r255 with the size of the arguments at the caller, without touching the flag.
+bool primal::impl_LEAVE(primal::vm* v)
+{
+    v->r(VM_REG_SP) = v->r(VM_REG_FP).value();
+    v->r(VM_REG_FP) = v->pop();
+    v->ip() = v->pop();
+    word_t argc = v->pop();
+    v->r(VM_REG_SP) = v->r(VM_REG_SP).value() - argc * word_size;
+    return true;
+}
@@ -5,13 +5,10 @@
 
 bool primal::impl_MUL(primal::vm* v)
 {
-    v->debug(opcodes::MUL(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* dest = v->fetch();
-    primal::valued* src  = v->fetch();
+    primal::operand dest = v->fetch();
+    primal::operand src  = v->fetch();
 
-    *dest *= *src;
-    v->set_flag(dest->value() != 0);
-    v->debug(opcodes::MUL(), OpcodeDebugState::VM_DEBUG_AFTER);
+    v->set_flag(dest.set_value(dest.value() * src.value()) != 0);
     return true;
 }
 
@@ -5,13 +5,11 @@
 
 bool primal::impl_NEQ(primal::vm* v)
 {
-    v->debug(opcodes::NEQ(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* first = v->fetch();
-    primal::valued* second = v->fetch();
+    primal::operand first = v->fetch();
+    primal::operand second = v->fetch();
 
-    v->set_flag(*first != *second);
+    v->set_flag(first.value() != second.value());
 
-    v->debug(opcodes::NEQ(), OpcodeDebugState::VM_DEBUG_AFTER);
     return true;
 }
 
@@ -5,11 +5,8 @@
 
 bool primal::impl_NOT(primal::vm* v)
 {
-    v->debug(opcodes::NOT(), OpcodeDebugState::VM_DEBUG_BEFORE);
-    primal::valued* dest = v->fetch();
-    dest->set_value(!dest->value());
-    v->set_flag(dest->value() != 0);
-    v->debug(opcodes::NOT(), OpcodeDebugState::VM_DEBUG_AFTER);
+    primal::operand dest = v->fetch();
+    v->set_flag(dest.set_value(!dest.value()) != 0);
     return true;
 }
 
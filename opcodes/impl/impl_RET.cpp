@@ -5,10 +5,8 @@
 
 bool primal::impl_RET(primal::vm* v)
 {
-    v->debug(opcodes::RET(), OpcodeDebugState::VM_DEBUG_BEFORE);
     word_t dest = v->pop();
     v->ip() = dest;
-    v->debug(opcodes::RET(), OpcodeDebugState::VM_DEBUG_AFTER);
     return true;
 }
 
@@ -0,0 +1,9 @@
+#include <YIELD.h>
+#include <vm.h>
+
+bool primal::impl_YIELD(primal::vm* v)
+{
+    // the dispatch loop stops after this instruction, resume() continues with the next one
+    v->yield();
+    return false;
+}
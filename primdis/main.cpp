@@ -63,35 +63,9 @@ using OpcodeMap = std::map<uint8_t, std::shared_ptr<primal::opcodes::opcode>>;
 // Function to create and populate the opcode map.
 OpcodeMap create_opcode_map() {
     OpcodeMap opcodes;
-    opcodes[primal::opcodes::MOV().bin()] = std::make_shared<primal::opcodes::MOV>();
-    opcodes[primal::opcodes::ADD().bin()] = std::make_shared<primal::opcodes::ADD>();
-    opcodes[primal::opcodes::SUB().bin()] = std::make_shared<primal::opcodes::SUB>();
-    opcodes[primal::opcodes::MUL().bin()] = std::make_shared<primal::opcodes::MUL>();
-    opcodes[primal::opcodes::DIV().bin()] = std::make_shared<primal::opcodes::DIV>();
-    opcodes[primal::opcodes::MOD().bin()] = std::make_shared<primal::opcodes::MOD>();
-    opcodes[primal::opcodes::OR().bin()] = std::make_shared<primal::opcodes::OR>();
-    opcodes[primal::opcodes::AND().bin()] = std::make_shared<primal::opcodes::AND>();
-    opcodes[primal::opcodes::EQ().bin()] = std::make_shared<primal::opcodes::EQ>();
-    opcodes[primal::opcodes::NEQ().bin()] = std::make_shared<primal::opcodes::NEQ>();
-    opcodes[primal::opcodes::JT().bin()] = std::make_shared<primal::opcodes::JT>();
-    opcodes[primal::opcodes::JNT().bin()] = std::make_shared<primal::opcodes::JNT>();
-    opcodes[primal::opcodes::JMP().bin()] = std::make_shared<primal::opcodes::JMP>();
-    opcodes[primal::opcodes::LT().bin()] = std::make_shared<primal::opcodes::LT>();
-    opcodes[primal::opcodes::GT().bin()] = std::make_shared<primal::opcodes::GT>();
-    opcodes[primal::opcodes::LTE().bin()] = std::make_shared<primal::opcodes::LTE>();
-    opcodes[primal::opcodes::GTE().bin()] = std::make_shared<primal::opcodes::GTE>();
-    opcodes[primal::opcodes::PUSH().bin()] = std::make_shared<primal::opcodes::PUSH>();
-    opcodes[primal::opcodes::POP().bin()] = std::make_shared<primal::opcodes::POP>();
-    opcodes[primal::opcodes::COPY().bin()] = std::make_shared<primal::opcodes::COPY>();
-    opcodes[primal::opcodes::DJT().bin()] = std::make_shared<primal::opcodes::DJT>();
-    opcodes[primal::opcodes::DJNT().bin()] = std::make_shared<primal::opcodes::DJNT>();
-    opcodes[primal::opcodes::DJMP().bin()] = std::make_shared<primal::opcodes::DJMP>();
-    opcodes[primal::opcodes::XOR().bin()] = std::make_shared<primal::opcodes::XOR>();
-    opcodes[primal::opcodes::NOT().bin()] = std::make_shared<primal::opcodes::NOT>();
-    opcodes[primal::opcodes::CALL().bin()] = std::make_shared<primal::opcodes::CALL>();
-    opcodes[primal::opcodes::RET().bin()] = std::make_shared<primal::opcodes::RET>();
-    opcodes[primal::opcodes::INTR().bin()] = std::make_shared<primal::opcodes::INTR>();
-    opcodes[primal::opcodes::INC().bin()] = std::make_shared<primal::opcodes::INC>();
+#define PRIMAL_OPCODE_MAP_ENTRY(name, code) opcodes[primal::opcodes::name().bin()] = std::make_shared<primal::opcodes::name>();
+    PRIMAL_OPCODE_LIST(PRIMAL_OPCODE_MAP_ENTRY)
+#undef PRIMAL_OPCODE_MAP_ENTRY
     return opcodes;
 }
 
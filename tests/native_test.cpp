@@ -0,0 +1,74 @@
+#include <numeric_decl.h>
+#include <vm.h>
+#include <interface.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// the same class, once running the script in the VM and once translated to C++ by primc --emit-cpp
+namespace on_vm
+{
+#include "native_sample_vm.h"
+}
+
+namespace native
+{
+#include "native_sample_native.h"
+}
+
+namespace
+{
+
+// the variables of the script, as read through the accessors of the generated class, which expect them in the
+// memory in the order they are declared: the script sets them first in that order
+template<typename S>
+std::vector<word_t> numbers(S& s)
+{
+    return { s.get_total(), s.get_fib(), s.get_odd(), s.get_calls(), s.get_k(), s.get_r(),
+             s.get_a(), s.get_b(), s.get_t(), s.get_i() };
+}
+
+}
+
+int main()
+{
+    primal::function_registry::instance().add("native_sample_mix", [](word_t x) -> word_t { return x / 10 + 7; });
+
+    on_vm::Native_sample vm;
+    native::Native_sample translated;
+    if(!vm.run() || !translated.run())
+    {
+        std::cerr << "Error: The sample script did not run to its end" << std::endl;
+        return 1;
+    }
+
+    const std::vector<word_t> expected = numbers(vm);
+    const std::vector<word_t> actual = numbers(translated);
+    bool ok = expected == actual && vm.get_name() == translated.get_name();
+    if(!ok)
+    {
+        std::cerr << "Error: The C++ translation computed other values than the VM" << std::endl;
+        for(size_t i = 0; i < expected.size(); i++)
+        {
+            std::cerr << "  " << i << ": " << expected[i] << " " << actual[i] << std::endl;
+        }
+        std::cerr << "  name: '" << vm.get_name() << "' '" << translated.get_name() << "'" << std::endl;
+        return 1;
+    }
+
+    // and the script ran through its loops, its calls and its extern call
+    if(expected[1] != 832040 || expected[2] != 100 || expected[3] != 20 || expected[8] == 0 || vm.get_name() != "native")
+    {
+        std::cerr << "Error: The sample script computed wrong values" << std::endl;
+        return 1;
+    }
+
+    std::cout << "The C++ translation computed what the VM did" << std::endl;
+    return 0;
+}
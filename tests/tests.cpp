@@ -4,8 +4,17 @@
 #include <vm.h>
 #include <vm_impl.h>
 #include <compiler.h>
+#include <cpp_translator.h>
+#include <vm_pool.h>
+#include <vm_scheduler.h>
+#include <vm_watchdog.h>
+#include <opcodes.h>
 #include <options.h>
 #include <iostream>
+#include <sstream>
+#include <future>
+#include <limits>
+#include <thread>
 
 TEST_CASE("Compiler compiles, string indexed assignment", "[compiler]")
 {
@@ -801,3 +810,1540 @@ TEST_CASE("Compiler handles array declaration and access", "[compiler]")
     REQUIRE(vm->get_mem(base_offset + 1 * word_size) == 22); // check2 should be 22
     REQUIRE(vm->get_mem(base_offset + 2 * word_size) == 99); // check3 should be 99
 }
+
+#ifdef TICKS
+TEST_CASE("VM threaded dispatch runs the same as the instrumented loop", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a,b
+                   let a = 50
+                   let b = 0
+                   while a > 0
+                      let a = a - 1
+                      let b = b + 2
+                   end
+               )code"
+             );
+
+    auto slow = primal::vm::create();
+    REQUIRE(slow->run(c->bytecode()));
+
+    // unthrottled: the VM does not need to stop between instructions, so it takes the threaded path
+    auto fast = primal::vm::create();
+    fast->set_speed(0);
+    REQUIRE(fast->run(c->bytecode()));
+
+    REQUIRE(fast->get_mem(0) == 0);
+    REQUIRE(fast->get_mem(word_size) == 100);
+    REQUIRE(fast->get_mem(word_size) == slow->get_mem(word_size));
+}
+#endif
+
+TEST_CASE("VM pre-decoded program runs the same as the bytecode", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a,b,c
+                   let a = 20
+                   let b = 0
+                   let c = 0
+                   while a > 0
+                      let a = a - 1
+                      if a > 9 then
+                         let b = b + 3
+                      else
+                         let c = c + 1
+                      end
+                   end
+               )code"
+             );
+
+    auto decoded = primal::vm::create();
+    auto raw = primal::vm::create();
+    raw->set_predecode(false);
+#ifdef TICKS
+    decoded->set_speed(0);
+    raw->set_speed(0);
+#endif
+    REQUIRE(decoded->run(c->bytecode()));
+    REQUIRE(raw->run(c->bytecode()));
+
+    REQUIRE(decoded->get_mem(0) == 0);
+    REQUIRE(decoded->get_mem(word_size) == 30);
+    REQUIRE(decoded->get_mem(2 * word_size) == 10);
+    for(word_t i = 0; i < 3; i++)
+    {
+        REQUIRE(decoded->get_mem(i * word_size) == raw->get_mem(i * word_size));
+    }
+    REQUIRE(decoded->ip() == raw->ip());
+}
+
+TEST_CASE("ASM compiler - Register byte operands", "[asm-compiler]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                      asm MOV $r1 258
+                      asm MOV $r2 $r1@1
+                      asm MOV $r1@0 5
+                )code"
+    );
+
+    auto vm = primal::vm::create();
+    REQUIRE(vm->run(c->bytecode()));
+    REQUIRE(vm->r(2).value() == 1);
+    REQUIRE(vm->r(1).value() == 261);
+}
+
+TEST_CASE("VM specialized handlers for register, immediate and memory operands", "[vm]")
+{
+    auto c = primal::compiler::create();
+    std::string code(R"code(
+              asm MOV $r1 10
+              asm MOV $r2 $r1
+              asm ADD $r2 5
+              asm MOV [0] $r2
+              asm SUB [0] 3
+              asm MUL $r1 [0]
+              asm XOR $r3 [0]
+              asm OR [0] $r1
+              asm MOV $r4 0
+              asm LT $r2 [0]
+              asm JNT end
+              asm MOV $r4 1
+           :end
+           )code");
+
+    c->compile(code);
+
+    auto decoded = primal::vm::create();
+    auto raw = primal::vm::create();
+    raw->set_predecode(false);
+#ifdef TICKS
+    decoded->set_speed(0);
+    raw->set_speed(0);
+#endif
+    REQUIRE(decoded->run(c->bytecode()));
+    REQUIRE(raw->run(c->bytecode()));
+
+    REQUIRE(decoded->r(1).value() == 120);
+    REQUIRE(decoded->r(2).value() == 15);
+    REQUIRE(decoded->r(3).value() == 12);
+    REQUIRE(decoded->get_mem(0) == (12 | 120));
+    REQUIRE(decoded->r(4).value() == 1);
+    for(uint8_t i = 1; i < 5; i++)
+    {
+        REQUIRE(decoded->r(i).value() == raw->r(i).value());
+    }
+    REQUIRE(decoded->get_mem(0) == raw->get_mem(0));
+}
+
+TEST_CASE("Script compiler - Compare-and-branch and loop superinstructions", "[script-compiler]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var s, i, n, w
+                   let s = 0
+                   let n = 5
+                   let w = 0
+                   let i = 1
+                   for i = 1 to 5
+                      let s = s + i
+                   next
+                   while s > 3
+                      let s = s - 4
+                      let w = w + 1
+                   end
+                   if w == 3 then
+                      let n = 7
+                   else
+                      let n = 9
+                   end
+               )code"
+             );
+
+    auto decoded = primal::vm::create();
+    auto raw = primal::vm::create();
+    raw->set_predecode(false);
+#ifdef TICKS
+    decoded->set_speed(0);
+    raw->set_speed(0);
+#endif
+    REQUIRE(decoded->run(c->bytecode()));
+    REQUIRE(raw->run(c->bytecode()));
+
+    // the variables are laid out in the order of their first assignment: s, n, w, i
+    REQUIRE(decoded->get_mem(0) == 3);
+    REQUIRE(decoded->get_mem(word_size) == 7);
+    REQUIRE(decoded->get_mem(2 * word_size) == 3);
+    REQUIRE(decoded->get_mem(3 * word_size) == 6);
+    for(word_t i = 0; i < 4; i++)
+    {
+        REQUIRE(decoded->get_mem(i * word_size) == raw->get_mem(i * word_size));
+    }
+}
+
+TEST_CASE("VM JIT runs hot functions the same as the interpreter", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, b, k
+                   fun work(...)
+                      let k = 0
+                      while k < 20
+                         let k = k + 1
+                         let a = a + k * 3
+                         if a > 100 then
+                            let b = b + 1
+                            let a = a - 50
+                         end
+                      end
+                      asm MOV $r2 [$r254+0]
+                      asm MOV $r3 $r2
+                      asm XOR $r3 7
+                      asm NOT $r2
+                      asm INC $r3
+                      asm MOV $r5 0
+                   :loop
+                      asm ADD $r5 1
+                      asm MOV $r6 $r5
+                      asm MUL $r6 3
+                      asm ADD [0] $r6
+                      asm GT [0] 1000
+                      asm JNT skip
+                      asm ADD [8] 1
+                      asm SUB [0] 500
+                   :skip
+                      asm LT $r5 5000
+                      asm JT loop
+                   end
+                   let a = 1
+                   let b = 0
+                   work(1)
+                   work(1)
+                   work(1)
+               )code"
+             );
+
+    auto jitted = primal::vm::create();
+    auto raw = primal::vm::create();
+    jitted->set_jit(true);
+    jitted->set_jit_threshold(1);
+    raw->set_predecode(false);
+#ifdef TICKS
+    jitted->set_speed(0);
+    raw->set_speed(0);
+#endif
+    REQUIRE(jitted->run(c->bytecode()));
+    REQUIRE(raw->run(c->bytecode()));
+
+    if(primal::vm::jit_supported())
+    {
+        REQUIRE(jitted->jit_translated_functions() == 1);
+    }
+    REQUIRE(raw->get_mem(word_size) > 0);
+    for(word_t i = 0; i < 3; i++)
+    {
+        REQUIRE(jitted->get_mem(i * word_size) == raw->get_mem(i * word_size));
+    }
+    for(uint8_t i = 0; i < 7; i++)
+    {
+        REQUIRE(jitted->r(i).value() == raw->r(i).value());
+    }
+    REQUIRE(jitted->flag() == raw->flag());
+    REQUIRE(jitted->ip() == raw->ip());
+}
+
+TEST_CASE("VM JIT panics on the same memory access as the interpreter", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    // the address comes from a, so the function is translated before it goes out of the memory
+    c->compile(R"code(
+                   var a
+                   fun work(...)
+                      asm MOV $r2 [0]
+                      asm MOV $r3 [$r2]
+                   end
+                   let a = 8
+                   work(1)
+                   work(1)
+                   let a = 99999999
+                   work(1)
+               )code"
+             );
+
+    for(bool jit : {false, true})
+    {
+        auto v = primal::vm::create();
+        v->set_jit(jit);
+        v->set_jit_threshold(1);
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE_THROWS(v->run(c->bytecode()));
+        if(jit && primal::vm::jit_supported())
+        {
+            REQUIRE(v->jit_translated_functions() == 1);
+        }
+    }
+}
+
+TEST_CASE("Compiler translates the bytecode to C++", "[compiler]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, k
+                   fun step(...)
+                      let a = a + 2
+                   end
+                   let a = 0
+                   let k = 0
+                   while k < 10
+                      let k = k + 1
+                      step(1)
+                   end
+               )code"
+             );
+
+    auto bytecode = c->bytecode();
+    std::stringstream ss;
+    primal::translate_to_cpp(bytecode, ss);
+    std::string cpp = ss.str();
+
+    // the loop and the call are direct jumps, the return goes through the dispatch
+    REQUIRE(cpp.find("bool run()") != std::string::npos);
+    REQUIRE(cpp.find("if(taken) goto L_") != std::string::npos);
+    REQUIRE(cpp.find("push(") != std::string::npos);
+    REQUIRE(cpp.find("ip = pop();") != std::string::npos);
+    REQUIRE(cpp.find("void call_foreign()") != std::string::npos);
+
+    std::vector<uint8_t> truncated(bytecode.begin(), bytecode.begin() + 8);
+    REQUIRE_THROWS(primal::translate_to_cpp(truncated, ss));
+}
+
+TEST_CASE("VM verifier proves immediate memory accesses safe", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, b
+                   let a = 5
+                   let b = a + 3
+                   asm MOV $r1 0
+                   asm EQ $r1 1
+                   asm JT 2029
+               )code"
+             );
+
+    auto verified = primal::vm::create();
+    auto checked = primal::vm::create();
+    checked->set_verify(false);
+#ifdef TICKS
+    verified->set_speed(0);
+    checked->set_speed(0);
+#endif
+    REQUIRE(verified->run(c->bytecode()));
+    REQUIRE(checked->run(c->bytecode()));
+
+    // the jump is never taken, but it would land in the middle of the first instruction
+    REQUIRE(verified->verification_error().find("Jump outside of the instructions") == 0);
+    REQUIRE(verified->proven_safe_accesses() > 0);
+    REQUIRE(checked->verification_error().empty());
+    REQUIRE(checked->proven_safe_accesses() == 0);
+
+    REQUIRE(verified->get_mem(0) == 5);
+    REQUIRE(verified->get_mem(word_size) == 8);
+    REQUIRE(checked->get_mem(word_size) == verified->get_mem(word_size));
+}
+
+TEST_CASE("VM memory with a heap and a guarded stack", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, b, i
+                   let a = 0
+                   let i = 0
+                   for i = 1 to 10 do
+                       let a = a + i
+                   end
+                   let b = a * 2
+               )code"
+             );
+
+    primal::memory_config config;
+    config.heap_size = 1024 * 1024;
+    config.stack_size = 64 * 1024;
+    config.guard_pages = true;
+
+    auto guarded = primal::vm::create(config);
+    auto legacy = primal::vm::create();
+#ifdef TICKS
+    guarded->set_speed(0);
+    legacy->set_speed(0);
+#endif
+    REQUIRE(guarded->run(c->bytecode()));
+    REQUIRE(legacy->run(c->bytecode()));
+
+    REQUIRE(guarded->get_mem(0) == legacy->get_mem(0));
+    REQUIRE(guarded->get_mem(word_size) == legacy->get_mem(word_size));
+
+    // the heap follows the application, the stack follows the heap and gets the rounding to the pages
+    REQUIRE(guarded->heap_start() >= VM_MEM_SEGMENT_SIZE + static_cast<word_t>(c->bytecode().size()));
+    REQUIRE(guarded->stack_start() == guarded->heap_start() + config.heap_size);
+    REQUIRE(guarded->memory_size() >= guarded->stack_start() + config.stack_size);
+    REQUIRE(legacy->memory_size() == VM_MEM_SEGMENT_SIZE + static_cast<word_t>(c->bytecode().size()));
+
+    // the heap is addressable, the default memory ends with the application
+    guarded->set_mem(guarded->heap_start() + config.heap_size - word_size, 42);
+    REQUIRE(guarded->get_mem(guarded->heap_start() + config.heap_size - word_size) == 42);
+    REQUIRE_FALSE(legacy->address_is_valid(legacy->memory_size() + 1));
+}
+
+TEST_CASE("VM keeps the pushes inside the stack wherever the script moves the stack pointer", "[vm]")
+{
+    primal::memory_config config;
+    config.stack_size = 64 * 1024;
+    config.guard_pages = true;
+
+    for(word_t sp : {word_t(100000), word_t(-100000), word_t(-8)})
+    {
+        auto c = primal::compiler::create();
+        c->compile("asm MOV $r255 " + std::to_string(sp) + "\nasm PUSH 305419896\n");
+
+        // far from the guard pages as well as right next to them
+        for(bool guarded : {false, true})
+        {
+            auto v = guarded ? primal::vm::create(config) : primal::vm::create();
+#ifdef TICKS
+            v->set_speed(0);
+#endif
+            REQUIRE_THROWS(v->run(c->bytecode()));
+        }
+    }
+}
+
+TEST_CASE("VM keeps the pops and the copies inside the memory", "[vm]")
+{
+    primal::memory_config config;
+    config.heap_size = 64 * 1024;
+    config.stack_size = 64 * 1024;
+
+    // nothing was pushed, the word below the stack is not the script's to pop
+    auto popping = primal::compiler::create();
+    popping->compile("asm POP $r1\n");
+    for(bool separate : {false, true})
+    {
+        auto v = separate ? primal::vm::create(config) : primal::vm::create();
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE_THROWS(v->run(popping->bytecode()));
+    }
+
+    auto c = primal::compiler::create();
+    c->compile("var a\nlet a = 42\n");
+    auto v = primal::vm::create(config);
+#ifdef TICKS
+    v->set_speed(0);
+#endif
+    REQUIRE(v->run(c->bytecode()));
+
+    // the heap is reachable past the first segment, the source is checked as well as the destination
+    word_t last = v->heap_start() + config.heap_size - word_size;
+    REQUIRE(last > VM_MEM_SEGMENT_SIZE);
+    REQUIRE(v->copy(last, 0, word_size));
+    REQUIRE(v->get_mem(last) == 42);
+    REQUIRE_FALSE(v->copy(0, v->memory_size() - 4, word_size));
+    REQUIRE_FALSE(v->copy(0, v->memory_size() + 1000000, word_size));
+    REQUIRE_FALSE(v->copy(v->memory_size() - 4, 0, word_size));
+    REQUIRE_FALSE(v->copy(0, 8, -1));
+    REQUIRE(v->get_mem(0) == 42);
+}
+
+TEST_CASE("VM instruction budget stops and resumes the run", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, i
+                   let a = 0
+                   let i = 0
+                   for i = 1 to 100 do
+                       let a = a + i
+                   end
+               )code"
+             );
+
+    auto unlimited = primal::vm::create();
+#ifdef TICKS
+    unlimited->set_speed(0);
+#endif
+    REQUIRE(unlimited->run(c->bytecode()));
+    REQUIRE(unlimited->status() == primal::run_status::finished);
+
+    for(bool predecode : {true, false})
+    {
+        auto v = primal::vm::create();
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        v->set_predecode(predecode);
+        v->set_instruction_budget(50);
+
+        REQUIRE_FALSE(v->run(c->bytecode()));
+        REQUIRE(v->status() == primal::run_status::budget_exhausted);
+        REQUIRE(v->executed_instructions() == 50);
+
+        int resumptions = 0;
+        while(!v->resume())
+        {
+            REQUIRE(v->executed_instructions() == 50);
+            resumptions ++;
+        }
+        REQUIRE(resumptions > 0);
+        REQUIRE(v->status() == primal::run_status::finished);
+        REQUIRE(v->get_mem(0) == unlimited->get_mem(0));
+    }
+}
+
+TEST_CASE("VM pool runs programs on several threads", "[vm]")
+{
+    std::vector<std::shared_ptr<const std::vector<uint8_t>>> apps;
+    for(int limit : {10, 20, 30})
+    {
+        auto c = primal::compiler::create();
+        c->compile(R"code(
+                       var a, i
+                       let a = 0
+                       let i = 0
+                       for i = 1 to )code" + std::to_string(limit) + R"code( do
+                           let a = a + i
+                       end
+                   )code"
+                 );
+        apps.push_back(std::make_shared<const std::vector<uint8_t>>(c->bytecode()));
+    }
+
+    // what a machine of its own gives for every program
+    std::vector<word_t> expected;
+    for(const auto& app : apps)
+    {
+        auto v = primal::vm::create();
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE(v->run(*app));
+        expected.push_back(v->get_mem(0));
+    }
+
+    const size_t runs = 60;
+    std::vector<word_t> results(runs, -1);
+    std::vector<std::future<bool>> finished;
+    {
+        primal::vm_pool pool(4);
+        REQUIRE(pool.workers() == 4);
+        for(size_t i = 0; i < runs; i++)
+        {
+            finished.push_back(pool.submit(apps[i % apps.size()], [&results, i](primal::vm& v) { results[i] = v.get_mem(0); }));
+        }
+        for(auto& f : finished)
+        {
+            REQUIRE(f.get());
+        }
+    }
+
+    for(size_t i = 0; i < runs; i++)
+    {
+        REQUIRE(results[i] == expected[i % apps.size()]);
+    }
+}
+
+TEST_CASE("VM forks run from a snapshot of a stopped machine", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, b, i
+                   let a = 0
+                   let b = 0
+                   let i = 0
+                   for i = 1 to 20 do
+                       let a = a + i
+                   end
+                   let b = a + 1
+               )code"
+             );
+
+    for(bool guarded : {false, true})
+    {
+        primal::memory_config config;
+        if(guarded)
+        {
+            config.stack_size = 4096;
+            config.guard_pages = true;
+        }
+
+        auto original = primal::vm::create(config);
+#ifdef TICKS
+        original->set_speed(0);
+#endif
+        original->set_instruction_budget(30);
+        REQUIRE_FALSE(original->run(c->bytecode()));
+
+        auto snapshot = original->snapshot();
+        REQUIRE(snapshot != nullptr);
+        word_t a_at_snapshot = original->get_mem(0);
+
+        original->set_instruction_budget(0);
+        REQUIRE(original->resume());
+
+        // a fork continues from where the original stopped, and gets to the same end
+        auto fork = primal::vm::create();
+#ifdef TICKS
+        fork->set_speed(0);
+#endif
+        fork->fork_from(*snapshot);
+        REQUIRE(fork->status() == primal::run_status::ready);
+        REQUIRE(fork->get_mem(0) == a_at_snapshot);
+        REQUIRE(fork->resume());
+        REQUIRE(fork->get_mem(0) == original->get_mem(0));
+        REQUIRE(fork->get_mem(word_size) == original->get_mem(word_size));
+
+        // what-if: a change in a fork stays in that fork
+        auto what_if = primal::vm::create();
+#ifdef TICKS
+        what_if->set_speed(0);
+#endif
+        what_if->fork_from(*snapshot);
+        what_if->set_mem(0, a_at_snapshot + 1000);
+        REQUIRE(what_if->resume());
+        REQUIRE(what_if->get_mem(0) == original->get_mem(0) + 1000);
+
+        fork->fork_from(*snapshot);
+        REQUIRE(fork->get_mem(0) == a_at_snapshot);
+        REQUIRE(fork->resume());
+        REQUIRE(fork->get_mem(word_size) == original->get_mem(word_size));
+    }
+}
+
+TEST_CASE("VM profiler counts opcodes and functions", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var a, k
+                   fun inner(...)
+                      let k = 0
+                      while k < 10
+                         let k = k + 1
+                         let a = a + k
+                      end
+                   end
+                   fun once(...)
+                      let a = a + 1
+                   end
+                   let a = 0
+                   inner(1)
+                   once(1)
+                   inner(1)
+               )code"
+             );
+
+    auto profiled = primal::vm::create();
+    auto plain = primal::vm::create();
+#ifdef TICKS
+    profiled->set_speed(0);
+    plain->set_speed(0);
+#endif
+    profiled->set_profiling(true);
+    REQUIRE(profiled->run(c->bytecode()));
+    REQUIRE(plain->run(c->bytecode()));
+    REQUIRE(profiled->get_mem(0) == plain->get_mem(0));
+
+    std::stringstream stacks;
+    profiled->profile_collapsed_stacks(stacks);
+    std::map<std::string, uint64_t> counts;
+    std::string stack;
+    uint64_t count = 0;
+    while(stacks >> stack >> count)
+    {
+        counts[stack] = count;
+    }
+    REQUIRE(counts.count("main") == 1);
+    REQUIRE(counts.count("main;inner") == 1);
+    REQUIRE(counts.count("main;once") == 1);
+
+    // inner ran twice with the loop, once just the one addition
+    REQUIRE(counts["main;inner"] > 2 * counts["main;once"]);
+
+    uint64_t total = 0;
+    for(const auto& kv : counts)
+    {
+        total += kv.second;
+    }
+
+    std::stringstream report;
+    profiled->profile_report(report);
+    REQUIRE(report.str().find("--- Profile: " + std::to_string(total) + " instructions") == 0);
+    REQUIRE(report.str().find("CALL") != std::string::npos);
+    REQUIRE(report.str().find("inner") != std::string::npos);
+    REQUIRE(report.str().find("Hottest addresses") != std::string::npos);
+}
+
+TEST_CASE("VM trace and debug policies tell the observer about every instruction", "[vm]")
+{
+    auto c = primal::compiler::create();
+
+    c->compile(R"code(
+                   var k
+                   fun twice(integer x)
+                      let x = x * 2
+                   end
+                   let k = 0
+                   while k < 10
+                      twice(k)
+                      let k = k + 1
+                   end
+               )code"
+             );
+
+    struct counter : public primal::vm_observer
+    {
+        void started(primal::vm&) override { starts ++; }
+        void before(primal::vm& v, word_t address, uint8_t) override { befores ++; ok = ok && address == v.ip(); }
+        void after(primal::vm&, word_t, uint8_t opcode) override { afters ++; calls += opcode == primal::opcodes::CALLA().bin(); }
+        void finished(primal::vm&) override { ends ++; }
+
+        int starts = 0, ends = 0, calls = 0;
+        uint64_t befores = 0, afters = 0;
+        bool ok = true;
+    };
+
+    // the release machine counts the instructions, but never calls its observer
+    auto release = primal::vm::create();
+    auto ignored = std::make_shared<counter>();
+    release->set_observer(ignored);
+    release->set_instruction_budget(1000000);
+#ifdef TICKS
+    release->set_speed(0);
+#endif
+    REQUIRE(release->policy() == primal::execution_policy::release);
+    REQUIRE(release->run(c->bytecode()));
+    REQUIRE(ignored->befores == 0);
+    REQUIRE(ignored->starts == 0);
+
+    for(auto policy : {primal::execution_policy::trace, primal::execution_policy::debug})
+    {
+        auto observed = primal::vm::create(primal::memory_config(), policy);
+        auto seen = std::make_shared<counter>();
+        observed->set_observer(seen);
+#ifdef TICKS
+        observed->set_speed(0);
+#endif
+        REQUIRE(observed->run(c->bytecode()));
+        REQUIRE(observed->get_mem(0) == release->get_mem(0));
+        REQUIRE(observed->get_mem(0) == 10);
+
+        REQUIRE(seen->ok);
+        REQUIRE(seen->starts == 1);
+        REQUIRE(seen->ends == 1);
+        REQUIRE(seen->calls == 10);
+        // the exit is seen before, but it does not run
+        REQUIRE(seen->befores == release->executed_instructions() + 1);
+        REQUIRE(seen->afters == release->executed_instructions());
+    }
+}
+
+TEST_CASE("VM host registered interrupts", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   asm MOV $r1 5
+                   asm INTR 7
+                   asm MOV $r1 6
+                   asm INTR 7
+                   asm MOV $r1 0
+                   asm MOV $r2 0
+                   asm INTR 1
+               )code"
+             );
+
+    // the first machine sums with a callable, and replaces the printing built-in
+    auto first = primal::vm::create();
+    word_t sum = 0;
+    first->register_interrupt(7, [&sum](primal::vm* v) -> bool { sum += v->r(1).value(); return true; });
+    first->register_interrupt(1, [](primal::vm* v) -> bool { v->r(2) = 42; return true; });
+#ifdef TICKS
+    first->set_speed(0);
+#endif
+    REQUIRE(first->run(c->bytecode()));
+    REQUIRE(sum == 11);
+    REQUIRE(first->r(2).value() == 42);
+
+    // the second one has its own interrupt 7 and the built-in 1
+    auto second = primal::vm::create();
+    second->register_interrupt(7, [](primal::vm* v) -> bool { v->r(3) = v->r(3).value() + v->r(1).value() * 10; return true; });
+#ifdef TICKS
+    second->set_speed(0);
+#endif
+    REQUIRE(second->run(c->bytecode()));
+    REQUIRE(second->r(3).value() == 110);
+    REQUIRE(second->r(2).value() == 0);
+    REQUIRE(sum == 11);
+}
+
+TEST_CASE("VM extern functions are linked when the application is loaded", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun ffi_linked_add(integer x) int extern
+                   end
+                   var k
+                   let k = 0
+                   while k < 4
+                      ffi_linked_add(k)
+                      let k = k + 1
+                   end
+               )code"
+             );
+
+    // the registry outlives the test, so the functions only touch statics
+    static word_t sum = 0;
+    static size_t length = 0;
+    auto vm = primal::vm::create();
+    vm->register_function("ffi_linked_add", [](word_t x) -> word_t { sum += x; return sum; });
+    vm->register_function("ffi_linked_len", [](std::string s) -> word_t { length += s.length(); return static_cast<word_t>(s.length()); });
+#ifdef TICKS
+    vm->set_speed(0);
+#endif
+    REQUIRE(vm->run(c->bytecode()));
+    REQUIRE(sum == 6);
+
+    // a function registered again under the name is called through the slot linked before
+    vm->register_function("ffi_linked_add", [](word_t x) -> word_t { sum += 10 * x; return sum; });
+    REQUIRE(vm->run(c->bytecode()));
+    REQUIRE(sum == 66);
+
+    // and the slots are the ones the names are called by
+    auto& registry = primal::function_registry::instance();
+    size_t slot = registry.link("ffi_linked_add");
+    REQUIRE(slot == registry.link("ffi_linked_add"));
+    primal::ffi_arg arg;
+    arg.value = 1;
+    REQUIRE(std::get<word_t>(registry.call_linked(slot, &arg, 1)) == 76);
+    REQUIRE(std::get<word_t>(registry.call("ffi_linked_add", {word_t(1)})) == 86);
+
+    // the strings are converted from the view of the memory of the VM
+    std::string hello = "hello";
+    arg.is_string = true;
+    arg.text = hello;
+    REQUIRE(std::get<word_t>(registry.call_linked(registry.link("ffi_linked_len"), &arg, 1)) == 5);
+    REQUIRE(length == 5);
+    REQUIRE_THROWS(registry.call_linked(slot, &arg, 1));
+}
+
+TEST_CASE("VM foreign functions take views of the strings and keep their results apart", "[vm]")
+{
+    auto& registry = primal::function_registry::instance();
+
+    // the views point to the characters given, nothing is copied
+    static const char* seen = nullptr;
+    registry.add("ffi_view_len", [](std::string_view s, std::string_view b) -> word_t
+                 {
+                     seen = s.data();
+                     return static_cast<word_t>(s.size() + b.size());
+                 });
+    std::string text = "abcdef";
+    primal::ffi_arg args[2];
+    args[0].is_string = args[1].is_string = true;
+    args[0].text = text;
+    args[1].text = std::string_view(text).substr(2);
+    REQUIRE(std::get<word_t>(registry.call_linked(registry.link("ffi_view_len"), args, 2)) == 10);
+    REQUIRE(seen == text.data());
+    REQUIRE(std::get<word_t>(registry.call("ffi_view_len", {std::string("xy"), std::string("z")})) == 3);
+
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun ffi_repeat(integer x) string extern
+                   end
+                   ffi_repeat(3)
+                   asm MOV $r10 $r0
+                   ffi_repeat(5)
+                   asm MOV $r11 $r0
+               )code"
+             );
+    registry.add("ffi_repeat", [](word_t x) -> std::string { return std::string(static_cast<size_t>(x), static_cast<char>('a' + x)); });
+
+    // every result gets its own place in the result area
+    primal::memory_config config;
+    config.ffi_result_size = 64;
+    auto vm = primal::vm::create(config);
+#ifdef TICKS
+    vm->set_speed(0);
+#endif
+    REQUIRE(vm->run(c->bytecode()));
+    word_t first = vm->r(10).value();
+    word_t second = vm->r(11).value();
+    REQUIRE(first >= vm->heap_start());
+    REQUIRE(second == first + 4);
+    REQUIRE(vm->get_mem_byte(first) == 3);
+    REQUIRE(vm->get_mem_byte(first + 1) == 'd');
+    REQUIRE(vm->get_mem_byte(second) == 5);
+    REQUIRE(vm->get_mem_byte(second + 5) == 'f');
+
+    // without a result area they all go to the same place
+    auto shared = primal::vm::create();
+#ifdef TICKS
+    shared->set_speed(0);
+#endif
+    REQUIRE(shared->run(c->bytecode()));
+    REQUIRE(shared->r(10).value() == STRING_RESULT_INDEX_IN_MEM);
+    REQUIRE(shared->r(11).value() == STRING_RESULT_INDEX_IN_MEM);
+}
+
+TEST_CASE("VM suspends on asynchronous foreign functions and resumes with their result", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun ffi_later(integer x) int extern
+                   end
+                   ffi_later(4)
+                   asm MOV $r10 $r0
+                   ffi_later(5)
+                   asm MOV $r11 $r0
+               )code"
+             );
+    auto app = std::make_shared<const std::vector<uint8_t>>(c->bytecode());
+
+    // the results are given by the test, the calls only hand out the futures
+    static std::vector<std::promise<word_t>> promises;
+    static std::vector<word_t> asked;
+    primal::function_registry::instance().add("ffi_later", [](word_t x) -> std::future<word_t>
+                                              {
+                                                  asked.push_back(x);
+                                                  promises.emplace_back();
+                                                  return promises.back().get_future();
+                                              });
+    promises.reserve(16);
+
+    auto vm = primal::vm::create();
+#ifdef TICKS
+    vm->set_speed(0);
+#endif
+    REQUIRE_FALSE(vm->run(*app));
+    REQUIRE(vm->status() == primal::run_status::suspended);
+    REQUIRE_FALSE(vm->ready());
+    REQUIRE(asked == std::vector<word_t>{4});
+
+    promises[0].set_value(40);
+    REQUIRE(vm->ready());
+    REQUIRE_FALSE(vm->resume());
+    REQUIRE(vm->r(10).value() == 40);
+    REQUIRE(asked == std::vector<word_t>{4, 5});
+
+    // a result already there does not suspend the machine
+    promises[1].set_value(50);
+    REQUIRE(vm->resume());
+    REQUIRE(vm->status() == primal::run_status::finished);
+    REQUIRE(vm->r(11).value() == 50);
+
+    // every dispatch loop stops after the call
+    for(int how = 0; how < 5; how++)
+    {
+        promises.clear();
+        auto other = primal::vm::create(primal::memory_config(), how == 0 ? primal::execution_policy::trace : primal::execution_policy::release);
+#ifdef TICKS
+        other->set_speed(0);
+#endif
+        other->set_predecode(how != 1);
+        other->set_profiling(how == 2);
+        other->set_instruction_budget(how == 3 ? 1000 : 0);
+        other->set_jit(how == 4);
+        REQUIRE_FALSE(other->run(*app));
+        promises[0].set_value(6);
+        REQUIRE_FALSE(other->resume());
+        promises[1].set_value(7);
+        REQUIRE(other->resume());
+        REQUIRE(other->r(10).value() == 6);
+        REQUIRE(other->r(11).value() == 7);
+    }
+
+    // the scheduler runs the others while some wait
+    promises.clear();
+    asked.clear();
+    primal::vm_scheduler scheduler;
+    std::vector<std::future<bool>> done;
+    std::vector<word_t> sums(3, 0);
+    for(size_t i = 0; i < sums.size(); i++)
+    {
+        auto machine = primal::vm::create();
+#ifdef TICKS
+        machine->set_speed(0);
+#endif
+        done.push_back(scheduler.add(machine, app, [&sums, i](primal::vm& m) { sums[i] = m.r(10).value() + m.r(11).value(); }));
+    }
+    REQUIRE(scheduler.step() == 3);
+    REQUIRE(scheduler.waiting() == 3);
+    REQUIRE(promises.size() == 3);
+    REQUIRE(scheduler.step() == 3);
+
+    promises[1].set_value(1);
+    REQUIRE(scheduler.step() == 3);
+    REQUIRE(scheduler.waiting() == 3);
+    REQUIRE(promises.size() == 4);
+    promises[3].set_value(2);
+    REQUIRE(scheduler.step() == 2);
+
+    promises[0].set_value(10);
+    promises[2].set_value(10);
+    REQUIRE(scheduler.step() == 2);
+    REQUIRE(promises.size() == 6);
+    promises[4].set_value(20);
+    promises[5].set_value(30);
+    scheduler.run();
+    REQUIRE(scheduler.size() == 0);
+    for(auto& d : done)
+    {
+        REQUIRE(d.get());
+    }
+    REQUIRE(sums[1] == 3);
+    REQUIRE(sums[0] + sums[2] == 70);
+}
+
+TEST_CASE("VM runs in slices and yields", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   var a
+                   let a = 1
+                   yield
+                   let a = a + 2
+                   asm YIELD
+                   let a = a + 4
+               )code");
+    std::vector<uint8_t> app = c->bytecode();
+
+    // the trace, bytecode, profiled, metered and JIT loops all stop on YIELD
+    for(int how = 0; how < 5; how++)
+    {
+        auto v = primal::vm::create(primal::memory_config(), how == 0 ? primal::execution_policy::trace : primal::execution_policy::release);
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        v->set_predecode(how != 1);
+        v->set_profiling(how == 2);
+        v->set_instruction_budget(how == 3 ? 1000 : 0);
+        v->set_jit(how == 4);
+        v->load(app);
+        REQUIRE(v->status() == primal::run_status::ready);
+        REQUIRE_FALSE(v->resume());
+        REQUIRE(v->status() == primal::run_status::yielded);
+        REQUIRE(v->get_mem(0) == 1);
+        REQUIRE_FALSE(v->resume());
+        REQUIRE(v->status() == primal::run_status::yielded);
+        REQUIRE(v->get_mem(0) == 3);
+        REQUIRE(v->resume());
+        REQUIRE(v->status() == primal::run_status::finished);
+        REQUIRE(v->get_mem(0) == 7);
+    }
+
+    // stepping goes through the same instructions one by one
+    auto v = primal::vm::create();
+#ifdef TICKS
+    v->set_speed(0);
+#endif
+    v->set_instruction_budget(1000);
+    v->load(app);
+    REQUIRE(v->run_for(0) == primal::run_status::ready);
+    int steps = 0;
+    int yields = 0;
+    for(primal::run_status s = v->step(); s != primal::run_status::finished; s = v->step())
+    {
+        REQUIRE(v->executed_instructions() == 1);
+        yields += s == primal::run_status::yielded;
+        steps ++;
+    }
+    REQUIRE(yields == 2);
+    REQUIRE(steps > 4);
+    REQUIRE(v->get_mem(0) == 7);
+
+    // a long running script gives the thread back when its slice or its deadline runs out
+    c = primal::compiler::create();
+    c->compile(R"code(
+                   var i
+                   let i = 0
+                   while i < 100000000
+                      let i = i + 1
+                   end
+               )code");
+    v->load(c->bytecode());
+    REQUIRE(v->run_for(10) == primal::run_status::budget_exhausted);
+    REQUIRE(v->executed_instructions() == 10);
+    REQUIRE(v->run_for(std::chrono::milliseconds(1)) == primal::run_status::budget_exhausted);
+    REQUIRE(v->executed_instructions() > 0);
+    REQUIRE(v->run_until(std::chrono::steady_clock::now()) == primal::run_status::budget_exhausted);
+    REQUIRE(v->executed_instructions() == 0);
+
+    // the budget of the machine is back for the next resumption
+    REQUIRE_FALSE(v->resume());
+    REQUIRE(v->executed_instructions() == 1000);
+}
+
+TEST_CASE("VM stops when asked to from another thread", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   var i
+                   fun spin(integer x)
+                      while x > 0
+                         let i = i + 1
+                      end
+                   end
+                   let i = 0
+                   spin(1)
+               )code");
+    auto app = std::make_shared<const std::vector<uint8_t>>(c->bytecode());
+
+    auto stop_soon = [](primal::vm& v) { return std::thread([&v]() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); v.request_stop(); }); };
+
+    // the trace, bytecode, profiled, metered and JIT loops all look at the request
+    for(int how = 0; how < 5; how++)
+    {
+        auto v = primal::vm::create(primal::memory_config(), how == 0 ? primal::execution_policy::trace : primal::execution_policy::release);
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        v->set_predecode(how != 1);
+        v->set_profiling(how == 2);
+        v->set_instruction_budget(how == 3 ? std::numeric_limits<uint64_t>::max() : 0);
+        v->set_jit(how == 4);
+        v->set_jit_threshold(10);
+
+        std::thread t = stop_soon(*v);
+        REQUIRE_FALSE(v->run(*app));
+        t.join();
+        REQUIRE(v->status() == primal::run_status::cancelled);
+        word_t counted = v->get_mem(0);
+        REQUIRE(counted > 0);
+        if(how == 4 && primal::vm::jit_supported())
+        {
+            REQUIRE(v->jit_translated_functions() == 1);
+        }
+
+        t = stop_soon(*v);
+        REQUIRE_FALSE(v->resume());
+        t.join();
+        REQUIRE(v->status() == primal::run_status::cancelled);
+        REQUIRE(v->get_mem(0) > counted);
+
+        // asked before the run, it stops at the first backward jump, and loading drops it
+        v->request_stop();
+        REQUIRE_FALSE(v->resume());
+        REQUIRE(v->status() == primal::run_status::cancelled);
+        v->request_stop();
+        v->load(*app);
+        v->set_instruction_budget(1000);
+        REQUIRE_FALSE(v->resume());
+        REQUIRE(v->status() == primal::run_status::budget_exhausted);
+    }
+
+    // the watchdog reports the runs going past their deadline and the panics instead of throwing
+    primal::vm_watchdog watchdog;
+    std::vector<primal::watched_run> runs(3);
+    std::vector<std::thread> workers;
+    for(size_t i = 0; i < runs.size(); i++)
+    {
+        workers.emplace_back([&watchdog, &runs, &app, i]()
+                             {
+                                 auto v = primal::vm::create();
+#ifdef TICKS
+                                 v->set_speed(0);
+#endif
+                                 runs[i] = watchdog.run(*v, *app, std::chrono::milliseconds(10 * (i + 1)));
+                             });
+    }
+    for(auto& w : workers)
+    {
+        w.join();
+    }
+    for(size_t i = 0; i < runs.size(); i++)
+    {
+        REQUIRE(runs[i].status == primal::run_status::cancelled);
+        REQUIRE_FALSE(runs[i].finished());
+        REQUIRE(runs[i].panic.empty());
+        REQUIRE(runs[i].elapsed >= std::chrono::milliseconds(10 * (i + 1)));
+    }
+    REQUIRE(watchdog.stopped() == 3);
+    REQUIRE(watchdog.watched() == 0);
+
+    auto v = primal::vm::create();
+#ifdef TICKS
+    v->set_speed(0);
+#endif
+    c = primal::compiler::create();
+    c->compile(R"code(
+                   var a
+                   let a = 6 * 7
+               )code");
+    primal::watched_run r = watchdog.run(*v, c->bytecode(), std::chrono::seconds(10));
+    REQUIRE(r.finished());
+    REQUIRE(v->get_mem(0) == 42);
+
+    c = primal::compiler::create();
+    c->compile(R"code(
+                   asm INTR 99
+               )code");
+    r = watchdog.run(*v, c->bytecode(), std::chrono::seconds(10));
+    REQUIRE_FALSE(r.finished());
+    REQUIRE(r.panic.find("Unimplemented interrupt") != std::string::npos);
+    REQUIRE(watchdog.stopped() == 3);
+}
+
+TEST_CASE("VM keeps the registers in a flat register file", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   asm MOV $r1 40
+                   asm ADD $r1 2
+                   asm MOV $r2 $r1
+                   asm YIELD
+                   asm ADD $r2 1
+               )code");
+    auto v = primal::vm::create();
+#ifdef TICKS
+    v->set_speed(0);
+#endif
+    v->load(c->bytecode());
+    REQUIRE_FALSE(v->resume());
+    REQUIRE(v->status() == primal::run_status::yielded);
+
+    // the references write through to the machine and copy values, not the registers
+    REQUIRE(v->r(1).value() == 42);
+    REQUIRE(v->r(2) == 42);
+    v->r(3) = v->r(1);
+    v->r(1) = 7;
+    REQUIRE(v->r(3).value() == 42);
+    REQUIRE(v->r(1).idx() == 1);
+
+    auto snapshot = v->snapshot();
+    auto fork = primal::vm::create();
+    fork->fork_from(*snapshot);
+    REQUIRE(fork->r(1) == 7);
+    REQUIRE(fork->r(3) == 42);
+    REQUIRE(fork->ip() == v->ip());
+
+    REQUIRE(v->resume());
+    REQUIRE(v->r(2) == 43);
+    REQUIRE(fork->r(2) == 42);
+
+    // a const machine only lets its registers be read, not even a copy of what r() gives back is writable
+    const primal::vm& read_only = *v;
+    auto copy = read_only.r(2);
+    REQUIRE(copy.value() == 43);
+    REQUIRE(copy.idx() == 2);
+    static_assert(!std::is_assignable_v<decltype(copy)&, word_t>);
+    static_assert(std::is_assignable_v<decltype(v->r(2))&, word_t>);
+}
+
+TEST_CASE("VM skips the flags nothing can read", "[vm]")
+{
+    // the flags of most of the instructions are overwritten right away, the ones read by MOV and JNT are not
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun work(integer x)
+                      asm MOV $r1 5
+                      asm ADD $r1 3
+                      asm MOV $r2 $r253
+                      asm SUB $r1 8
+                      asm MOV $r3 7
+                      asm MUL $r3 2
+                      asm EQ $r3 14
+                      asm MOV $r4 $r253
+                      asm SUB $r3 14
+                      asm JNT zero
+                      asm MOV $r5 99
+                   :zero
+                      asm ADD $r6 1
+                      asm LT $r6 20
+                      asm JT zero
+                   end
+                   work(1)
+                   work(1)
+               )code");
+
+    std::vector<std::shared_ptr<primal::vm>> machines;
+    machines.push_back(primal::vm::create(primal::memory_config(), primal::execution_policy::trace));
+    machines.push_back(primal::vm::create());
+    machines.push_back(primal::vm::create());
+    machines.back()->set_predecode(false);
+    machines.push_back(primal::vm::create());
+    machines.back()->set_jit(true);
+    machines.back()->set_jit_threshold(1);
+    for(auto& v : machines)
+    {
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE(v->run(c->bytecode()));
+        REQUIRE(v->r(1) == 0);
+        REQUIRE(v->r(2) == 1);
+        REQUIRE(v->r(3) == 0);
+        REQUIRE(v->r(4) == 1);
+        REQUIRE(v->r(5) == 0);
+        for(uint8_t i = 0; i < 8; i++)
+        {
+            REQUIRE(v->r(i).value() == machines.front()->r(i).value());
+        }
+        REQUIRE(v->flag() == machines.front()->flag());
+    }
+}
+
+TEST_CASE("VM calls the script functions with the frame opcodes", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   var b
+                   fun sub(integer x, integer y)
+                      let b = x - y
+                      asm ADD $r7 [$r254+0]
+                      asm ADD $r8 1
+                   end
+                   asm MOV $r9 $r255
+                   let b = 0
+                   sub(50, 8)
+                   sub(10, 3)
+               )code");
+
+    struct counter : public primal::vm_observer
+    {
+        void after(primal::vm&, word_t, uint8_t opcode) override
+        {
+            calls += opcode == primal::opcodes::CALLA().bin();
+            enters += opcode == primal::opcodes::ENTER().bin();
+            leaves += opcode == primal::opcodes::LEAVE().bin();
+            rets += opcode == primal::opcodes::RET().bin();
+        }
+        int calls = 0, enters = 0, leaves = 0, rets = 0;
+    };
+
+    auto observer = std::make_shared<counter>();
+    std::vector<std::shared_ptr<primal::vm>> machines;
+    machines.push_back(primal::vm::create(primal::memory_config(), primal::execution_policy::trace));
+    machines.back()->set_observer(observer);
+    machines.push_back(primal::vm::create());
+    machines.push_back(primal::vm::create());
+    machines.back()->set_predecode(false);
+    for(auto& v : machines)
+    {
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE(v->run(c->bytecode()));
+
+        // the parameters are found in the frame and the LEAVE dropped them
+        REQUIRE(v->r(7) == 49);
+        REQUIRE(v->r(8) == 2);
+        REQUIRE(v->r(255) == v->r(9));
+    }
+    REQUIRE(observer->calls == 2);
+    REQUIRE(observer->enters == 2);
+    REQUIRE(observer->leaves == 2);
+    REQUIRE(observer->rets == 0);
+
+    std::stringstream ss;
+    primal::translate_to_cpp(c->bytecode(), ss);
+    REQUIRE(ss.str().find("const word_t argc = pop();") != std::string::npos);
+}
+
+TEST_CASE("VM calls the extern functions by their index", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun ffi_native_twice(integer x) int extern
+                   end
+                   fun ffi_native_add(integer x) int extern
+                   end
+                   var k, t
+                   asm MOV $r9 $r255
+                   let k = 0
+                   let t = 0
+                   while k < 5
+                      ffi_native_add(k)
+                      let t = ffi_native_twice(t)
+                      let k = k + 1
+                   end
+               )code");
+
+    // the registry outlives the test, so the functions only touch statics
+    static word_t sum = 0;
+    auto& registry = primal::function_registry::instance();
+    registry.add("ffi_native_add", [](word_t x) -> word_t { sum += x; return sum; });
+    registry.add("ffi_native_twice", [](word_t x) -> word_t { return 2 * x + 1; });
+
+    struct counter : public primal::vm_observer
+    {
+        void after(primal::vm&, word_t, uint8_t opcode) override
+        {
+            natives += opcode == primal::opcodes::CALLN().bin();
+            calls += opcode == primal::opcodes::CALLA().bin() || opcode == primal::opcodes::CALL().bin();
+            interrupts += opcode == primal::opcodes::INTR().bin();
+        }
+        int natives = 0, calls = 0, interrupts = 0;
+    };
+
+    auto observer = std::make_shared<counter>();
+    std::vector<std::shared_ptr<primal::vm>> machines;
+    machines.push_back(primal::vm::create(primal::memory_config(), primal::execution_policy::trace));
+    machines.back()->set_observer(observer);
+    machines.push_back(primal::vm::create());
+    machines.push_back(primal::vm::create());
+    machines.back()->set_predecode(false);
+    machines.push_back(primal::vm::create());
+    machines.back()->set_jit(true);
+    for(auto& v : machines)
+    {
+        sum = 0;
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE(v->run(c->bytecode()));
+
+        // the functions are numbered in the order of the function table, and they popped their arguments
+        REQUIRE(sum == 10);
+        REQUIRE(v->get_mem(word_size) == 31);
+        REQUIRE(v->r(255) == v->r(9));
+    }
+    REQUIRE(observer->natives == 10);
+    REQUIRE(observer->calls == 0);
+    REQUIRE(observer->interrupts == 0);
+
+    // the extern functions have no code in the application
+    for(const auto& f : machines[0]->functions())
+    {
+        REQUIRE(f.is_extern);
+        REQUIRE(f.address == 0);
+    }
+
+    // interrupt 2 takes the index in r249, an index without a function is a panic
+    auto v = primal::vm::create();
+    REQUIRE(v->run(c->bytecode()));
+    v->r(249) = 1;
+    REQUIRE(v->push(static_cast<word_t>(primal::entity_type::ET_NUMERIC)));
+    REQUIRE(v->push(20));
+    REQUIRE(v->push(1));
+    REQUIRE(v->interrupt(2));
+    REQUIRE(v->r(0) == 41);
+    REQUIRE_THROWS(v->call_native(2));
+
+    std::stringstream ss;
+    primal::translate_to_cpp(c->bytecode(), ss);
+    REQUIRE(ss.str().find("call_native(" + std::to_string(1) + ");") != std::string::npos);
+}
+
+TEST_CASE("VM runs the next application after a panic of a decoded instruction", "[vm]")
+{
+    auto failing = primal::compiler::create();
+    failing->compile(R"code(
+                   var a, b
+                   let b = 0
+                   let a = 5 / b
+               )code");
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   var a
+                   let a = 6
+                   let a = a * 7
+               )code");
+
+    for(bool predecode : {false, true})
+    {
+        auto v = primal::vm::create();
+#ifdef TICKS
+        v->set_speed(0);
+#endif
+        REQUIRE_THROWS(v->run(failing->bytecode()));
+
+        // the instruction the panic left behind is not the one the operands are fetched from
+        v->set_predecode(predecode);
+        REQUIRE(v->run(c->bytecode()));
+        REQUIRE(v->get_mem(0) == 42);
+    }
+}
+
+TEST_CASE("VM forks keep the foreign result area of their snapshot", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   fun ffi_fork_text(integer x) string extern
+                   end
+                   asm YIELD
+                   ffi_fork_text(3)
+                   asm MOV $r10 $r0
+               )code");
+    primal::function_registry::instance().add("ffi_fork_text", [](word_t x) -> std::string { return std::string(static_cast<size_t>(x), 'x'); });
+
+    // the snapshot has no result area, the strings all go to the same place
+    primal::memory_config config;
+    config.heap_size = 4096;
+    config.stack_size = 8192;
+    auto original = primal::vm::create(config);
+#ifdef TICKS
+    original->set_speed(0);
+#endif
+    REQUIRE_FALSE(original->run(c->bytecode()));
+    auto snapshot = original->snapshot();
+    REQUIRE(snapshot != nullptr);
+
+    // and neither have the machines forked from it, whatever their own configuration says
+    config.ffi_result_size = 256;
+    auto fork = primal::vm::create(config);
+#ifdef TICKS
+    fork->set_speed(0);
+#endif
+    fork->fork_from(*snapshot);
+    REQUIRE(fork->resume());
+    REQUIRE(fork->r(10) == STRING_RESULT_INDEX_IN_MEM);
+    REQUIRE(fork->get_mem_byte(STRING_RESULT_INDEX_IN_MEM) == 3);
+    REQUIRE(fork->stack_start() == original->stack_start());
+}
+
+TEST_CASE("VM forks start without the stop request of a previous run", "[vm]")
+{
+    auto c = primal::compiler::create();
+    c->compile(R"code(
+                   var a, i
+                   let a = 0
+                   let i = 0
+                   for i = 1 to 20 do
+                       let a = a + i
+                   end
+               )code");
+
+    auto original = primal::vm::create();
+#ifdef TICKS
+    original->set_speed(0);
+#endif
+    original->set_instruction_budget(30);
+    REQUIRE_FALSE(original->run(c->bytecode()));
+    auto snapshot = original->snapshot();
+    REQUIRE(snapshot != nullptr);
+
+    // a fork is a new run, like load() it drops the request made before it
+    auto fork = primal::vm::create();
+#ifdef TICKS
+    fork->set_speed(0);
+#endif
+    fork->request_stop();
+    fork->fork_from(*snapshot);
+    REQUIRE(fork->resume());
+    REQUIRE(fork->status() == primal::run_status::finished);
+    REQUIRE(fork->get_mem(0) == 210);
+}
@@ -0,0 +1,79 @@
+#include "console_debugger.h"
+
+#include "vm.h"
+#include "vm_impl.h"
+
+#include <opcodes.h>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace primal;
+
+void console_debugger::before(vm& v, word_t address, uint8_t opcode)
+{
+    v.get_impl()->bindump("VM STATE", -1, -1, true);
+    describe(v, address, opcode);
+    std::cout << " =>> ";
+}
+
+void console_debugger::after(vm& v, word_t address, uint8_t opcode)
+{
+    describe(v, address, opcode);
+    std::cout << std::endl;
+
+    const char* GREEN   = "\033[1;32m";
+    const char* RESET   = "\033[0m";
+
+    std::cout << GREEN << "$ " << RESET ;
+
+    std::string cmd;
+    std::getline(std::cin, cmd);
+
+    if(cmd == "q")
+    {
+        exit(1);
+    }
+    if(cmd.starts_with("pr") && cmd.size() > 2) // print a register
+    {
+        int rig = std::stoi(cmd.substr(2));
+        std::cout << " =" << v.r(static_cast<uint8_t>(rig)).value() << std::endl;
+    }
+}
+
+void console_debugger::finished(vm& v)
+{
+    v.get_impl()->bindump("FINAL VM STATE", -1, -1, true);
+}
+
+void console_debugger::describe(vm& v, word_t address, uint8_t opcode) const
+{
+    std::cout << "->" << std::setw(5) << std::dec << address << ":";
+
+    word_t paramcount = 0;
+    switch(opcode)
+    {
+#define PRIMAL_DEBUGGER_OPCODE(name, code) \
+    case code: \
+        std::cout << #name; \
+        paramcount = opcodes::name().paramcount(); \
+        break;
+    PRIMAL_OPCODE_LIST(PRIMAL_DEBUGGER_OPCODE)
+#undef PRIMAL_DEBUGGER_OPCODE
+    default:
+        std::cout << "??";
+    }
+    std::cout << " (" << paramcount << ") ";
+
+    size_t ip = static_cast<size_t>(address) + 1;
+    for(word_t i = 0; i < paramcount; i++)
+    {
+        v.get_impl()->peek(ip);
+    }
+
+    if(opcode == opcodes::POP().bin() || opcode == opcodes::PUSH().bin())
+    {
+        std::cout << " SP= [" << v.r(255).value() << "] ";
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef PRIMAL_CONSOLE_DEBUGGER_H
+#define PRIMAL_CONSOLE_DEBUGGER_H
+
+#include "vm_observer.h"
+
+namespace primal
+{
+
+/**
+ * @brief The interactive debugger of primv -d: dumps the state of the machine and the instruction
+ * before it runs, then waits for a command on the standard input after it ran.
+ *
+ * The commands are: an empty line to continue with the next instruction, "pr<n>" to print the register
+ * n and "q" to quit.
+ */
+class console_debugger final : public vm_observer
+{
+public:
+
+    void before(vm& v, word_t address, uint8_t opcode) override;
+    void after(vm& v, word_t address, uint8_t opcode) override;
+    void finished(vm& v) override;
+
+private:
+
+    // writes the instruction at the address with its operands
+    void describe(vm& v, word_t address, uint8_t opcode) const;
+};
+
+}
+
+#endif // PRIMAL_CONSOLE_DEBUGGER_H
@@ -0,0 +1,183 @@
+#include "decoder.h"
+
+#include <opcodes.h>
+
+#include <array>
+#include <cstring>
+
+using namespace primal;
+
+namespace
+{
+
+// what the decoder needs to know about an opcode
+struct opcode_info
+{
+    bool (*handler)(vm*) = nullptr;
+    word_t paramcount = 0;
+};
+
+const std::array<opcode_info, 256> opcode_infos = []() -> std::array<opcode_info, 256> {
+    std::array<opcode_info, 256> arr;
+#define PRIMAL_DECODER_ENTRY(name, code) arr[code] = { &impl_##name, opcodes::name().paramcount() };
+    PRIMAL_OPCODE_LIST(PRIMAL_DECODER_ENTRY)
+#undef PRIMAL_DECODER_ENTRY
+    return arr;
+}();
+
+bool is_valid_offset_operation(uint8_t op)
+{
+    return op == '+' || op == '-' || op == '*' || op == '/';
+}
+
+// the register based addressing modes of the operand use the given register
+bool uses_register(const decoded_operand& o, uint8_t r)
+{
+    switch(o.type)
+    {
+    case type_destination::TYPE_MOD_IMM:        // [[fallthrough]]
+    case type_destination::TYPE_MOD_IMM_BYTE:
+    case type_destination::TYPE_MOD_MEM_IMM:
+    case type_destination::TYPE_MOD_MEM_IMM_BYTE:
+        return false;
+    case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+        return o.ridx == r || o.ridx2 == r;
+    default:
+        return o.ridx == r;
+    }
+}
+
+}
+
+bool primal::is_absolute_jump(uint8_t opc)
+{
+    return opc == opcodes::JMP().bin() || opc == opcodes::JT().bin() || opc == opcodes::JNT().bin() || opc == opcodes::CALL().bin()
+        || opc == opcodes::CALLA().bin();
+}
+
+bool primal::is_relative_jump(uint8_t opc)
+{
+    return opc == opcodes::DJMP().bin() || opc == opcodes::DJT().bin() || opc == opcodes::DJNT().bin()
+        || opc == opcodes::DJEQ().bin() || opc == opcodes::DJNEQ().bin() || opc == opcodes::DJLT().bin()
+        || opc == opcodes::DJGT().bin() || opc == opcodes::DJLTE().bin() || opc == opcodes::DJGTE().bin()
+        || opc == opcodes::IDJLTE().bin();
+}
+
+bool primal::sets_flag(uint8_t opc)
+{
+    using namespace opcodes;
+    return opc == MOV().bin() || opc == ADD().bin() || opc == SUB().bin() || opc == MUL().bin() || opc == DIV().bin()
+        || opc == MOD().bin() || opc == AND().bin() || opc == OR().bin() || opc == XOR().bin() || opc == NOT().bin()
+        || opc == EQ().bin() || opc == NEQ().bin() || opc == LT().bin() || opc == GT().bin() || opc == LTE().bin()
+        || opc == GTE().bin() || opc == DJEQ().bin() || opc == DJNEQ().bin() || opc == DJLT().bin() || opc == DJGT().bin()
+        || opc == DJLTE().bin() || opc == DJGTE().bin() || opc == IDJLTE().bin();
+}
+
+bool primal::decode_program(const uint8_t* mem, word_t mem_size, word_t code_start, word_t code_end, decoded_program& p)
+{
+    p.instructions.clear();
+    p.boundaries.clear();
+    p.code_start = code_start;
+
+    if(code_start < 0 || code_end < code_start || code_end > mem_size)
+    {
+        return false;
+    }
+
+    p.boundaries.assign(static_cast<size_t>(code_end - code_start), -1);
+
+    word_t at = code_start;
+    while(at < code_end)
+    {
+        decoded_instruction ins;
+        ins.address = at;
+        ins.opcode = mem[at++];
+
+        // the exit marker has no handler, the interpreter stops there
+        if(ins.opcode != 0xFF)
+        {
+            const auto& info = opcode_infos[ins.opcode];
+            if(!info.handler || info.paramcount > 3)
+            {
+                return false;
+            }
+
+            ins.handler = info.handler;
+            ins.operand_count = static_cast<uint8_t>(info.paramcount);
+            for(uint8_t i = 0; i < ins.operand_count; i++)
+            {
+                auto& o = ins.operands[i];
+                if(!decode_operand(mem, code_end, at, o))
+                {
+                    return false;
+                }
+                if((o.type == type_destination::TYPE_MOD_MEM_REG_IDX_OFFS || o.type == type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS)
+                    && !is_valid_offset_operation(o.op))
+                {
+                    return false;
+                }
+            }
+        }
+
+        ins.next = at;
+        p.boundaries[static_cast<size_t>(ins.address - code_start)] = static_cast<int32_t>(p.instructions.size());
+        p.instructions.push_back(ins);
+    }
+
+    // whatever runs past the code section is left to the raw interpreter
+    decoded_instruction end;
+    end.address = code_end;
+    end.next = code_end;
+    p.instructions.push_back(end);
+
+    // and now resolve the jumps which have their target in the bytecode
+    for(auto& ins : p.instructions)
+    {
+        if(ins.operand_count == 0)
+        {
+            continue;
+        }
+
+        const auto& first = ins.operands[0];
+        const auto& last = ins.operands[ins.operand_count - 1];
+        if(is_absolute_jump(ins.opcode) && first.type == type_destination::TYPE_MOD_IMM)
+        {
+            ins.target = first.imm;
+        }
+        else if(is_relative_jump(ins.opcode) && last.type == type_destination::TYPE_MOD_IMM)
+        {
+            ins.target = ins.next + last.imm;
+        }
+        else
+        {
+            continue;
+        }
+
+        ins.target_index = p.index(ins.target);
+        if(ins.target_index == -1)
+        {
+            ins.target = -1;
+        }
+    }
+
+    // the flag set by an instruction falling through into one setting the flag again, without reading the
+    // flag register first, can never be read: the VM does not need to compute it
+    for(size_t i = 0; i + 1 < p.instructions.size(); i++)
+    {
+        auto& ins = p.instructions[i];
+        const auto& next = p.instructions[i + 1];
+        if(!sets_flag(ins.opcode) || is_relative_jump(ins.opcode) || !next.handler || !sets_flag(next.opcode))
+        {
+            continue;
+        }
+
+        bool reads_flag = false;
+        for(uint8_t j = 0; j < next.operand_count; j++)
+        {
+            reads_flag = reads_flag || uses_register(next.operands[j], VM_REG_FLAG);
+        }
+        ins.flag_dead = !reads_flag;
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef PRIMAL_DECODER_H
+#define PRIMAL_DECODER_H
+
+#include <hal.h>
+#include <numeric_decl.h>
+#include <decoded_operand.h>
+
+#include <vector>
+#include <cstdint>
+
+namespace primal
+{
+
+class vm;
+
+/**
+ * @brief A fully decoded instruction, as executed by the pre-decoded interpreter.
+ */
+struct decoded_instruction
+{
+    /** The implementation of the opcode, nullptr for the exit marker and the end of the code. */
+    bool (*handler)(vm*) = nullptr;
+
+    /** The binary value of the opcode. */
+    uint8_t opcode = 0;
+
+    /** The number of operands in @ref operands. */
+    uint8_t operand_count = 0;
+
+    /** The operands of the instruction, in the order the handler fetches them. */
+    decoded_operand operands[3];
+
+    /** The address of the opcode byte in the VM memory. */
+    word_t address = -1;
+
+    /** The address of the following instruction. */
+    word_t next = -1;
+
+    /** The address a jump with an immediate target lands on, -1 if it is not statically known. */
+    word_t target = -1;
+
+    /** The index of the instruction at @ref target in the decoded program. */
+    int32_t target_index = -1;
+
+    /** The flag this instruction sets is overwritten by the next one before anything can read it. */
+    bool flag_dead = false;
+};
+
+/**
+ * @brief The code section of an application, decoded once when it is loaded.
+ *
+ * The code section is expected not to be modified while running, the string table and the
+ * data areas of the application are not part of the decoded program.
+ */
+struct decoded_program
+{
+    /** The instructions, in the order they are found in the code section. */
+    std::vector<decoded_instruction> instructions;
+
+    /** The instruction index of each byte of the code section, -1 if it is not an instruction boundary. */
+    std::vector<int32_t> boundaries;
+
+    /** The address of the first byte of the code section. */
+    word_t code_start = 0;
+
+    /**
+     * @brief The index of the instruction starting at the given address.
+     *
+     * @param address A VM memory address.
+     * @return The index of the instruction, -1 if no instruction starts at the address.
+     */
+    int32_t index(word_t address) const
+    {
+        word_t offset = address - code_start;
+        if(offset < 0 || offset >= static_cast<word_t>(boundaries.size()))
+        {
+            return -1;
+        }
+        return boundaries[static_cast<size_t>(offset)];
+    }
+};
+
+/**
+ * @return True for the jumps having their absolute target address as their first operand (JMP, JT, JNT, CALL
+ * and CALLA).
+ */
+bool is_absolute_jump(uint8_t opc);
+
+/**
+ * @return True for the jumps having the delta to their target as their last operand (DJMP, DJT, DJNT
+ * and the compare-and-branch superinstructions).
+ */
+bool is_relative_jump(uint8_t opc);
+
+/**
+ * @return True for the opcodes always setting the flag without reading it: the arithmetic, the comparisons
+ * and the compare-and-branch superinstructions.
+ */
+bool sets_flag(uint8_t opc);
+
+/**
+ * @brief Decodes the code section of an application loaded into the memory of the VM.
+ *
+ * Jump targets given as immediates (absolute for JMP, JT, JNT, CALL and CALLA, relative for DJMP, DJT,
+ * DJNT and the compare-and-branch superinstructions) are resolved to instruction indexes. The instructions
+ * followed by one setting the flag again get their @ref decoded_instruction::flag_dead marked.
+ *
+ * @param mem The memory of the VM.
+ * @param mem_size The size of the memory.
+ * @param code_start The address of the first instruction.
+ * @param code_end The address of the first byte following the code section.
+ * @param p Receives the decoded program.
+ * @return False if the code section contains something that can only be interpreted from the raw bytes.
+ */
+bool decode_program(const uint8_t* mem, word_t mem_size, word_t code_start, word_t code_end, decoded_program& p);
+
+}
+
+#endif // PRIMAL_DECODER_H
@@ -0,0 +1,797 @@
+#include "jit.h"
+
+#include <opcodes.h>
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <map>
+
+#if TARGET_ARCH == 64 && defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define PRIMAL_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+using namespace primal;
+
+#ifdef PRIMAL_JIT_X86_64
+
+namespace
+{
+
+// The x86-64 registers used by the native code. All of them are caller saved in the System V ABI
+// and nothing is pushed on the stack, so every translated instruction can be entered by a call.
+enum x86 : uint8_t
+{
+    RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R8 = 8, R9 = 9
+};
+
+// the arguments of the native code: the registers and the memory of the VM
+constexpr uint8_t REGS = RDI;
+constexpr uint8_t MEM = RSI;
+
+// the loops read the stop request of the VM as a plain byte
+static_assert(sizeof(std::atomic<bool>) == 1 && std::atomic<bool>::is_always_lock_free);
+
+// the condition codes of the SETcc and Jcc instructions
+enum condition : uint8_t
+{
+    CC_A = 0x7, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+// the extensions of the ALU operations with an immediate operand (81 /ext)
+enum alu_extension : uint8_t
+{
+    EXT_ADD = 0, EXT_SUB = 5, EXT_CMP = 7
+};
+
+/*
+ * Emits the handful of instruction forms the translator needs.
+ */
+class assembler
+{
+public:
+
+    size_t size() const { return m_code.size(); }
+    const std::vector<uint8_t>& code() const { return m_code; }
+    void truncate(size_t s) { m_code.resize(s); }
+
+    // mov r, [REGS + disp]
+    void load(uint8_t r, int32_t disp) { reg_disp(0x8B, r, disp); }
+
+    // mov [REGS + disp], r
+    void store(int32_t disp, uint8_t r) { reg_disp(0x89, r, disp); }
+
+    // op r, [REGS + disp], for the ADD (03) and SUB (2B) opcodes
+    void alu_disp(uint8_t opc, uint8_t r, int32_t disp) { reg_disp(opc, r, disp); }
+
+    // mov qword [REGS + disp], imm32
+    void store_imm(int32_t disp, int32_t imm)
+    {
+        rex(true, 0, 0, REGS);
+        byte(0xC7);
+        byte(0x80 | (REGS & 7));
+        dword(disp);
+        dword(imm);
+    }
+
+    // mov r, [MEM + index]
+    void load_word(uint8_t r, uint8_t index) { mem_index(true, { 0x8B }, r, index); }
+
+    // movzx r32, byte [MEM + index]
+    void load_byte(uint8_t r, uint8_t index) { mem_index(false, { 0x0F, 0xB6 }, r, index); }
+
+    // movzx r32, byte [base], base being neither RSP nor RBP
+    void load_byte_at(uint8_t r, uint8_t base)
+    {
+        rex(false, r, 0, base);
+        byte(0x0F);
+        byte(0xB6);
+        byte(((r & 7) << 3) | (base & 7));
+    }
+
+    // mov [MEM + index], r
+    void store_word(uint8_t index, uint8_t r) { mem_index(true, { 0x89 }, r, index); }
+
+    // mov byte [MEM + index], r8
+    void store_byte(uint8_t index, uint8_t r) { mem_index(false, { 0x88 }, r, index); }
+
+    // mov r, imm64
+    void mov_imm(uint8_t r, word_t imm)
+    {
+        rex(true, 0, 0, r);
+        byte(0xB8 | (r & 7));
+        qword(imm);
+    }
+
+    // op dst, src for the two register forms of ADD (01), SUB (29), AND (21), OR (09), XOR (31), CMP (39), TEST (85) and MOV (89)
+    void alu(uint8_t opc, uint8_t dst, uint8_t src)
+    {
+        rex(true, src, 0, dst);
+        byte(opc);
+        byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    // imul dst, src
+    void imul(uint8_t dst, uint8_t src)
+    {
+        rex(true, dst, 0, src);
+        byte(0x0F);
+        byte(0xAF);
+        byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+    }
+
+    // op r, imm32 with op being one of alu_extension
+    void alu_imm(uint8_t ext, uint8_t r, int32_t imm)
+    {
+        rex(true, 0, 0, r);
+        byte(0x81);
+        byte(0xC0 | (ext << 3) | (r & 7));
+        dword(imm);
+    }
+
+    // setcc r8 followed by movzx r32, r8, so r holds 0 or 1
+    void set(uint8_t cc, uint8_t r)
+    {
+        rex(false, 0, 0, r);
+        byte(0x0F);
+        byte(0x90 | cc);
+        byte(0xC0 | (r & 7));
+        zero_extend_byte(r);
+    }
+
+    // movzx r32, r8
+    void zero_extend_byte(uint8_t r)
+    {
+        rex(false, r, 0, r);
+        byte(0x0F);
+        byte(0xB6);
+        byte(0xC0 | ((r & 7) << 3) | (r & 7));
+    }
+
+    // jcc rel32, gives back the location of the displacement to be patched
+    size_t jcc(uint8_t cc)
+    {
+        byte(0x0F);
+        byte(0x80 | cc);
+        dword(0);
+        return size() - 4;
+    }
+
+    // jmp rel32, gives back the location of the displacement to be patched
+    size_t jmp()
+    {
+        byte(0xE9);
+        dword(0);
+        return size() - 4;
+    }
+
+    void ret() { byte(0xC3); }
+
+    // points the jump having its displacement at the given location to the given target
+    void patch(size_t at, size_t target)
+    {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(m_code.data() + at, &rel, sizeof(rel));
+    }
+
+private:
+
+    void byte(uint8_t b) { m_code.push_back(b); }
+    void dword(int32_t v) { append(&v, sizeof(v)); }
+    void qword(int64_t v) { append(&v, sizeof(v)); }
+
+    void append(const void* p, size_t n)
+    {
+        const auto* b = static_cast<const uint8_t*>(p);
+        m_code.insert(m_code.end(), b, b + n);
+    }
+
+    // the REX prefix, emitted only when needed: 64 bit operand or any of the extended registers in modrm.reg, sib.index or modrm.rm
+    void rex(bool w, uint8_t r, uint8_t x, uint8_t b)
+    {
+        uint8_t v = 0x40 | (w ? 0x08 : 0) | ((r & 8) ? 0x04 : 0) | ((x & 8) ? 0x02 : 0) | ((b & 8) ? 0x01 : 0);
+        if(v != 0x40)
+        {
+            byte(v);
+        }
+    }
+
+    // opc r, [REGS + disp32]
+    void reg_disp(uint8_t opc, uint8_t r, int32_t disp)
+    {
+        rex(true, r, 0, REGS);
+        byte(opc);
+        byte(0x80 | ((r & 7) << 3) | (REGS & 7));
+        dword(disp);
+    }
+
+    // opc r, [MEM + index]
+    void mem_index(bool w, std::initializer_list<uint8_t> opc, uint8_t r, uint8_t index)
+    {
+        rex(w, r, index, MEM);
+        for(auto b : opc)
+        {
+            byte(b);
+        }
+        byte(0x04 | ((r & 7) << 3));
+        byte(((index & 7) << 3) | (MEM & 7));
+    }
+
+    std::vector<uint8_t> m_code;
+};
+
+// where an operand of the instruction being translated lives
+struct location
+{
+    enum class kind { immediate, reg, word, byte };
+
+    kind k = kind::immediate;
+    word_t imm = 0;         // the value of the immediate
+    int32_t disp = 0;       // the offset of the register from the REGS
+    uint8_t index = 0;      // the x86 register holding the memory address
+};
+
+/*
+ * Translates the instructions of one function. An instruction is either translated as a whole or replaced
+ * by a return to the interpreter, so the native code of a translated instruction always does exactly what
+ * its handler would do.
+ */
+class translation
+{
+public:
+
+    translation(const decoded_program& p, word_t mem_size, const std::atomic<bool>* stop) :
+        m_program(p), m_mem_size(mem_size), m_stop(stop) {}
+
+    static constexpr size_t not_translated = std::numeric_limits<size_t>::max();
+
+    // translates the instructions in [first, last), gives back the offset of the native code of each of them
+    std::vector<size_t> run(int32_t first, int32_t last)
+    {
+        std::vector<size_t> offsets(static_cast<size_t>(last - first), not_translated);
+        for(int32_t i = first; i < last; i++)
+        {
+            const auto& ins = m_program.instructions[static_cast<size_t>(i)];
+            size_t mark = m_asm.size();
+            size_t fixup_mark = m_fixups.size();
+            size_t bailout_mark = m_bailouts.size();
+            m_address = ins.address;
+
+            if(instruction(ins))
+            {
+                offsets[static_cast<size_t>(i - first)] = mark;
+            }
+            else
+            {
+                // roll back whatever was emitted and leave this one to the interpreter
+                m_asm.truncate(mark);
+                m_fixups.resize(fixup_mark);
+                m_bailouts.resize(bailout_mark);
+                exit(ins.address);
+            }
+        }
+        // falling off the end of the function
+        exit(m_program.instructions[static_cast<size_t>(last)].address);
+
+        // the jumps landing on translated instructions go straight there, all the others leave to the interpreter
+        std::map<word_t, size_t> exits;
+        std::map<word_t, size_t> polls;
+        for(const auto& f : m_fixups)
+        {
+            int32_t idx = m_program.index(f.target);
+            if(idx >= first && idx < last && offsets[static_cast<size_t>(idx - first)] != not_translated)
+            {
+                size_t target = offsets[static_cast<size_t>(idx - first)];
+                if(m_stop && f.target <= f.from)
+                {
+                    // the loops go through a look at the stop request of the machine, and leave if there is one
+                    auto it = polls.find(f.target);
+                    if(it == polls.end())
+                    {
+                        it = polls.emplace(f.target, m_asm.size()).first;
+                        m_asm.mov_imm(RAX, static_cast<word_t>(reinterpret_cast<uintptr_t>(m_stop)));
+                        m_asm.load_byte_at(RAX, RAX);
+                        m_asm.alu(0x85, RAX, RAX);
+                        m_asm.patch(m_asm.jcc(CC_E), target);
+                        exit(f.target);
+                    }
+                    target = it->second;
+                }
+                m_asm.patch(f.at, target);
+                continue;
+            }
+
+            auto it = exits.find(f.target);
+            if(it == exits.end())
+            {
+                it = exits.emplace(f.target, m_asm.size()).first;
+                exit(f.target);
+            }
+            m_asm.patch(f.at, it->second);
+        }
+
+        // the failed bounds checks always leave, so the interpreter can panic on the instruction
+        for(const auto& f : m_bailouts)
+        {
+            auto it = exits.find(f.target);
+            if(it == exits.end())
+            {
+                it = exits.emplace(f.target, m_asm.size()).first;
+                exit(f.target);
+            }
+            m_asm.patch(f.at, it->second);
+        }
+
+        return offsets;
+    }
+
+    const std::vector<uint8_t>& code() const { return m_asm.code(); }
+
+private:
+
+    struct fixup
+    {
+        size_t at;          // the displacement of the jump
+        word_t target;      // the VM address the jump goes to
+        word_t from;        // the VM address of the jumping instruction
+    };
+
+    // the offset of the given register of the VM from REGS
+    static int32_t disp(uint8_t ridx)
+    {
+        return static_cast<int32_t>(ridx * sizeof(word_t));
+    }
+
+    // the instruction pointer is only written back when leaving the native code, so it cannot be used as an operand
+    static bool usable(uint8_t ridx)
+    {
+        return ridx != 250;
+    }
+
+    static bool fits_int32(word_t v)
+    {
+        return v >= std::numeric_limits<int32_t>::min() && v <= std::numeric_limits<int32_t>::max();
+    }
+
+    void exit(word_t address)
+    {
+        m_asm.mov_imm(RAX, address);
+        m_asm.ret();
+    }
+
+    void jump_to(word_t target)
+    {
+        m_fixups.push_back({ m_asm.jmp(), target, m_address });
+    }
+
+    void jump_to_if(uint8_t cc, word_t target)
+    {
+        m_fixups.push_back({ m_asm.jcc(cc), target, m_address });
+    }
+
+    // leaves to the interpreter at the current instruction if the memory address in index cannot be accessed
+    void check(uint8_t index, word_t width, word_t self)
+    {
+        m_asm.alu_imm(EXT_CMP, index, static_cast<int32_t>(m_mem_size - width));
+        m_bailouts.push_back({ m_asm.jcc(CC_A), self, m_address });
+    }
+
+    // emits the address calculation of a memory operand into index, and describes where the operand is
+    bool prepare(const decoded_operand& o, uint8_t index, location& l, word_t self)
+    {
+        word_t width = word_size;
+        l.index = index;
+        l.k = location::kind::word;
+
+        switch(o.type)
+        {
+        case type_destination::TYPE_MOD_IMM:        // [[fallthrough]]
+        case type_destination::TYPE_MOD_IMM_BYTE:
+            l.k = location::kind::immediate;
+            l.imm = o.imm;
+            return true;
+
+        case type_destination::TYPE_MOD_REG:
+            l.k = location::kind::reg;
+            l.disp = disp(o.ridx);
+            return usable(o.ridx);
+
+        case type_destination::TYPE_MOD_MEM_IMM_BYTE:
+            l.k = location::kind::byte;
+            width = 1;
+            [[fallthrough]];
+        case type_destination::TYPE_MOD_MEM_IMM:
+            // a constant address is checked right now, the ones outside the memory are left for the interpreter to panic on
+            if(o.imm < 0 || o.imm + width > m_mem_size)
+            {
+                return false;
+            }
+            m_asm.mov_imm(index, o.imm);
+            return true;
+
+        case type_destination::TYPE_MOD_MEM_REG_BYTE:
+            l.k = location::kind::byte;
+            width = 1;
+            [[fallthrough]];
+        case type_destination::TYPE_MOD_MEM_REG_IDX:
+            if(!usable(o.ridx))
+            {
+                return false;
+            }
+            m_asm.load(index, disp(o.ridx));
+            check(index, width, self);
+            return true;
+
+        case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
+            if(!usable(o.ridx) || (o.op != '+' && o.op != '-') || !fits_int32(o.imm))
+            {
+                return false;
+            }
+            l.k = location::kind::byte;
+            m_asm.load(index, disp(o.ridx));
+            m_asm.alu_imm(o.op == '+' ? EXT_ADD : EXT_SUB, index, static_cast<int32_t>(o.imm));
+            check(index, 1, self);
+            return true;
+
+        case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+            if(!usable(o.ridx) || !usable(o.ridx2) || (o.op != '+' && o.op != '-'))
+            {
+                return false;
+            }
+            l.k = location::kind::byte;
+            m_asm.load(index, disp(o.ridx));
+            m_asm.alu_disp(o.op == '+' ? 0x03 : 0x2B, index, disp(o.ridx2));
+            check(index, 1, self);
+            return true;
+
+        default:
+            // the bytes of the registers are left to the interpreter
+            return false;
+        }
+    }
+
+    void load(uint8_t r, const location& l)
+    {
+        switch(l.k)
+        {
+        case location::kind::immediate:
+            m_asm.mov_imm(r, l.imm);
+            break;
+        case location::kind::reg:
+            m_asm.load(r, l.disp);
+            break;
+        case location::kind::word:
+            m_asm.load_word(r, l.index);
+            break;
+        case location::kind::byte:
+            m_asm.load_byte(r, l.index);
+            break;
+        }
+    }
+
+    // stores r into the operand, and leaves in r the value the operand has after the store
+    void store(const location& l, uint8_t r)
+    {
+        switch(l.k)
+        {
+        case location::kind::immediate:
+            break;
+        case location::kind::reg:
+            m_asm.store(l.disp, r);
+            break;
+        case location::kind::word:
+            m_asm.store_word(l.index, r);
+            break;
+        case location::kind::byte:
+            m_asm.store_byte(l.index, r);
+            m_asm.zero_extend_byte(r);
+            break;
+        }
+    }
+
+    // the flag becomes 1 if r is not zero, 0 otherwise
+    void set_flag_from(uint8_t r)
+    {
+        m_asm.alu(0x85, r, r);
+        m_asm.set(CC_NE, RDX);
+        m_asm.store(disp(VM_REG_FLAG), RDX);
+    }
+
+    void clear_flag()
+    {
+        m_asm.store_imm(disp(VM_REG_FLAG), 0);
+    }
+
+    // the target of a jump having its delta or its address in the given operand, -1 if not an immediate
+    static word_t relative_target(const decoded_instruction& ins, const decoded_operand& o)
+    {
+        return o.type == type_destination::TYPE_MOD_IMM ? ins.next + o.imm : -1;
+    }
+
+    bool instruction(const decoded_instruction& ins)
+    {
+        using namespace opcodes;
+        const uint8_t opc = ins.opcode;
+        const decoded_operand* ops = ins.operands;
+        location a, b, c;
+
+        // DEST = DEST <op> SRC, FLAG = DEST != 0
+        if(opc == MOV().bin() || opc == ADD().bin() || opc == SUB().bin() || opc == MUL().bin()
+            || opc == AND().bin() || opc == OR().bin() || opc == XOR().bin())
+        {
+            if(!prepare(ops[0], R8, a, ins.address) || !prepare(ops[1], R9, b, ins.address) || a.k == location::kind::immediate)
+            {
+                return false;
+            }
+            if(opc == MOV().bin())
+            {
+                load(RAX, b);
+            }
+            else
+            {
+                load(RAX, a);
+                load(RCX, b);
+                if(opc == ADD().bin()) m_asm.alu(0x01, RAX, RCX);
+                if(opc == SUB().bin()) m_asm.alu(0x29, RAX, RCX);
+                if(opc == MUL().bin()) m_asm.imul(RAX, RCX);
+                if(opc == AND().bin()) m_asm.alu(0x21, RAX, RCX);
+                if(opc == OR().bin())  m_asm.alu(0x09, RAX, RCX);
+                if(opc == XOR().bin()) m_asm.alu(0x31, RAX, RCX);
+            }
+            store(a, RAX);
+            if(!ins.flag_dead)
+            {
+                set_flag_from(RAX);
+            }
+            return true;
+        }
+
+        // FLAG = FIRST <cmp> SECOND
+        static const std::map<uint8_t, uint8_t> comparisons = {
+            { EQ().bin(), CC_E }, { NEQ().bin(), CC_NE }, { LT().bin(), CC_L },
+            { GT().bin(), CC_G }, { LTE().bin(), CC_LE }, { GTE().bin(), CC_GE }
+        };
+        if(auto it = comparisons.find(opc); it != comparisons.end())
+        {
+            if(!prepare(ops[0], R8, a, ins.address) || !prepare(ops[1], R9, b, ins.address))
+            {
+                return false;
+            }
+            // a dead comparison only has its operands checked, by prepare
+            if(ins.flag_dead)
+            {
+                return true;
+            }
+            load(RAX, a);
+            load(RCX, b);
+            m_asm.alu(0x39, RAX, RCX);
+            m_asm.set(it->second, RDX);
+            m_asm.store(disp(VM_REG_FLAG), RDX);
+            return true;
+        }
+
+        // if(FIRST <cmp> SECOND) IP += DELTA, FLAG = 0
+        static const std::map<uint8_t, uint8_t> branches = {
+            { DJEQ().bin(), CC_E }, { DJNEQ().bin(), CC_NE }, { DJLT().bin(), CC_L },
+            { DJGT().bin(), CC_G }, { DJLTE().bin(), CC_LE }, { DJGTE().bin(), CC_GE }
+        };
+        if(auto it = branches.find(opc); it != branches.end())
+        {
+            word_t target = relative_target(ins, ops[2]);
+            if(target == -1 || !prepare(ops[0], R8, a, ins.address) || !prepare(ops[1], R9, b, ins.address))
+            {
+                return false;
+            }
+            load(RAX, a);
+            load(RCX, b);
+            m_asm.alu(0x39, RAX, RCX);
+            clear_flag();
+            jump_to_if(it->second, target);
+            return true;
+        }
+
+        if(opc == IDJLTE().bin())
+        {
+            word_t target = relative_target(ins, ops[2]);
+            if(target == -1 || !prepare(ops[0], R8, a, ins.address) || !prepare(ops[1], R9, b, ins.address)
+                || a.k == location::kind::immediate)
+            {
+                return false;
+            }
+            load(RAX, a);
+            m_asm.alu_imm(EXT_ADD, RAX, 1);
+            store(a, RAX);
+            load(RCX, b);
+            m_asm.alu(0x39, RAX, RCX);
+            clear_flag();
+            jump_to_if(CC_LE, target);
+            return true;
+        }
+
+        if(opc == NOT().bin() || opc == INC().bin())
+        {
+            if(!prepare(ops[0], R8, a, ins.address) || a.k == location::kind::immediate)
+            {
+                return false;
+            }
+            load(RAX, a);
+            if(opc == NOT().bin())
+            {
+                m_asm.alu(0x85, RAX, RAX);
+                m_asm.set(CC_E, RAX);
+                store(a, RAX);
+                if(!ins.flag_dead)
+                {
+                    set_flag_from(RAX);
+                }
+            }
+            else
+            {
+                m_asm.alu_imm(EXT_ADD, RAX, 1);
+                store(a, RAX);
+            }
+            return true;
+        }
+
+        if(opc == DJMP().bin() || opc == DJT().bin() || opc == DJNT().bin())
+        {
+            word_t target = relative_target(ins, ops[0]);
+            if(target == -1)
+            {
+                return false;
+            }
+            if(opc == DJMP().bin())
+            {
+                jump_to(target);
+                return true;
+            }
+            m_asm.load(RAX, disp(VM_REG_FLAG));
+            m_asm.alu(0x85, RAX, RAX);
+            clear_flag();
+            jump_to_if(opc == DJT().bin() ? CC_NE : CC_E, target);
+            return true;
+        }
+
+        // the absolute jumps are translated only if they land on an instruction, the others fail in the interpreter
+        if(opc == JMP().bin() || opc == JT().bin() || opc == JNT().bin())
+        {
+            if(ins.target_index == -1)
+            {
+                return false;
+            }
+            if(opc == JMP().bin())
+            {
+                jump_to(ins.target);
+                return true;
+            }
+            // the flag is cleared only when not jumping
+            m_asm.load(RAX, disp(VM_REG_FLAG));
+            m_asm.alu(0x85, RAX, RAX);
+            jump_to_if(opc == JT().bin() ? CC_NE : CC_E, ins.target);
+            clear_flag();
+            return true;
+        }
+
+        return false;
+    }
+
+    const decoded_program& m_program;
+    word_t m_mem_size;
+    const std::atomic<bool>* m_stop;
+    word_t m_address = -1;      // of the instruction being translated
+    assembler m_asm;
+    std::vector<fixup> m_fixups;
+    std::vector<fixup> m_bailouts;      // the jumps of the bounds checks, these never go to native code
+};
+
+}
+
+#endif
+
+jit::~jit()
+{
+    release();
+}
+
+bool jit::supported()
+{
+#ifdef PRIMAL_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void jit::reset(const decoded_program &p, const std::vector<loaded_function> &functions, word_t mem_size,
+                const std::atomic<bool>* stop)
+{
+    release();
+    m_functions.clear();
+    m_function_of.clear();
+    m_entries.clear();
+    m_translated = 0;
+    m_program = &p;
+    m_mem_size = mem_size;
+    m_stop = stop;
+
+    if(!supported() || mem_size > std::numeric_limits<int32_t>::max())
+    {
+        return;
+    }
+
+    // the functions are laid out one after the other, each of them lasts until the next one or the end of the code
+    for(const auto& f : functions)
+    {
+        int32_t first = f.is_extern ? -1 : p.index(VM_MEM_SEGMENT_SIZE + f.address);
+        if(first != -1)
+        {
+            function_range r;
+            r.first = first;
+            m_functions.push_back(r);
+        }
+    }
+    std::sort(m_functions.begin(), m_functions.end(), [](const function_range& a, const function_range& b) { return a.first < b.first; });
+    m_functions.erase(std::unique(m_functions.begin(), m_functions.end(), [](const function_range& a, const function_range& b) { return a.first == b.first; }), m_functions.end());
+
+    // the last instruction is the end of the code section
+    int32_t end = static_cast<int32_t>(p.instructions.size()) - 1;
+    m_function_of.assign(p.instructions.size(), -1);
+    m_entries.assign(p.instructions.size(), nullptr);
+    for(size_t f = 0; f < m_functions.size(); f++)
+    {
+        m_functions[f].last = f + 1 < m_functions.size() ? m_functions[f + 1].first : end;
+        std::fill(m_function_of.begin() + m_functions[f].first, m_function_of.begin() + m_functions[f].last, static_cast<int32_t>(f));
+    }
+}
+
+void jit::translate(size_t f)
+{
+    auto& fn = m_functions[f];
+    fn.translated = true;
+
+#ifdef PRIMAL_JIT_X86_64
+    translation t(*m_program, m_mem_size, m_stop);
+    auto offsets = t.run(fn.first, fn.last);
+    if(std::all_of(offsets.begin(), offsets.end(), [](size_t o) { return o == translation::not_translated; }))
+    {
+        return;
+    }
+
+    // written while writable, then made executable
+    const auto& code = t.code();
+    void* buffer = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED)
+    {
+        return;
+    }
+    std::memcpy(buffer, code.data(), code.size());
+    if(mprotect(buffer, code.size(), PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(buffer, code.size());
+        return;
+    }
+    m_buffers.emplace_back(buffer, code.size());
+
+    for(size_t i = 0; i < offsets.size(); i++)
+    {
+        if(offsets[i] != translation::not_translated)
+        {
+            m_entries[static_cast<size_t>(fn.first) + i] = reinterpret_cast<native_code>(static_cast<uint8_t*>(buffer) + offsets[i]);
+        }
+    }
+    m_translated ++;
+#endif
+}
+
+void jit::release()
+{
+#ifdef PRIMAL_JIT_X86_64
+    for(const auto& b : m_buffers)
+    {
+        munmap(b.first, b.second);
+    }
+#endif
+    m_buffers.clear();
+}
@@ -0,0 +1,109 @@
+#ifndef PRIMAL_JIT_H
+#define PRIMAL_JIT_H
+
+#include <hal.h>
+#include <numeric_decl.h>
+#include <registers.h>
+
+#include "decoder.h"
+#include "loaded_function.h"
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace primal
+{
+
+/**
+ * @brief The JIT tier: translates the hot script functions of the pre-decoded program into native x86-64 code.
+ *
+ * The calls and the backward jumps landing in a function are counted, and once a function reaches the threshold
+ * its instructions are translated. The registers and the memory of the VM are accessed directly by the native
+ * code, which returns to the interpreter (giving back the address to continue from) when it reaches an
+ * instruction it has no translation for, when it leaves the function, when a memory access would fail or,
+ * at a backward jump, when the machine was asked to stop.
+ * On other platforms nothing is ever translated and the interpreter runs everything.
+ */
+class jit final
+{
+public:
+
+    /** The translated code of an instruction, returns the address the interpreter continues from. */
+    using native_code = word_t(*)(word_t* regs, uint8_t* mem);
+
+    jit() = default;
+    ~jit();
+
+    jit(const jit&) = delete;
+    jit& operator=(const jit&) = delete;
+
+    /** @return True if native code can be generated on this platform. */
+    static bool supported();
+
+    /**
+     * @brief Drops the translated code and prepares for a new run of the given program.
+     *
+     * @param p The decoded code section, it must outlive the translated code.
+     * @param functions The function table of the application, the addresses relative to the application.
+     * @param mem_size The size of the memory of the VM, the native code checks its accesses against it.
+     * @param stop The stop request of the VM, the loops of the native code leave when it is set. Not looked
+     * at when nullptr.
+     */
+    void reset(const decoded_program& p, const std::vector<loaded_function>& functions, word_t mem_size,
+               const std::atomic<bool>* stop = nullptr);
+
+    /**
+     * @brief Notes that the execution got into the instruction with the given index through a call or a
+     * backward jump and translates the function the instruction is in if it became hot.
+     */
+    void tick(int32_t index)
+    {
+        int32_t f = m_function_of.empty() ? -1 : m_function_of[static_cast<size_t>(index)];
+        if(f != -1 && !m_functions[static_cast<size_t>(f)].translated && ++m_functions[static_cast<size_t>(f)].hotness >= m_threshold)
+        {
+            translate(static_cast<size_t>(f));
+        }
+    }
+
+    /** @return The native code of the instruction with the given index, nullptr if it was not translated. */
+    native_code entry(int32_t index) const
+    {
+        return m_entries.empty() ? nullptr : m_entries[static_cast<size_t>(index)];
+    }
+
+    /** @brief The number of calls and backward jumps after which a function is translated. */
+    void set_threshold(uint32_t threshold) { m_threshold = threshold; }
+
+    /** @return The number of functions translated since the last reset. */
+    size_t translated() const { return m_translated; }
+
+private:
+
+    struct function_range
+    {
+        int32_t first = -1;         // the index of the first instruction of the function
+        int32_t last = -1;          // the index of the first instruction following the function
+        uint32_t hotness = 0;
+        bool translated = false;
+    };
+
+    void translate(size_t f);
+    void release();
+
+    const decoded_program* m_program = nullptr;
+    word_t m_mem_size = 0;
+    const std::atomic<bool>* m_stop = nullptr;
+    uint32_t m_threshold = 1000;
+    size_t m_translated = 0;
+
+    std::vector<function_range> m_functions;
+    std::vector<int32_t> m_function_of;                 // the function of each instruction, -1 if outside of functions
+    std::vector<native_code> m_entries;                 // the native code of each instruction
+    std::vector<std::pair<void*, size_t>> m_buffers;    // the executable memory holding the native code
+};
+
+}
+
+#endif // PRIMAL_JIT_H
@@ -22,10 +22,10 @@ struct loaded_function
     /** The name of the function as defined in the bytecode. */
     std::string name;
 
-    /** The address of the function in the compiled bytecode. */
+    /** The address of the function in the compiled bytecode, 0 for the extern functions which have no code. */
     word_t address;
 
-    /** Whether this function refers to an external C++ call. */
+    /** Whether this function refers to an external C++ call, called by its index among the extern functions of the table. */
     bool is_extern;
 
     /** The return type of the function, encoded as @ref entity_type. */
@@ -1,6 +1,7 @@
 #include "util.h"
 
 #include "vm.h"
+#include "console_debugger.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,7 +11,8 @@
 [[noreturn]] static void usage()
 {
     std::cout << "Primal VM" << std::endl;
-    std::cout << "Usage: primv <app.pric> [-d|--debug] [--speed <Hz>]" << std::endl;
+    std::cout << "Usage: primv <app.pric> [-d|--debug] [--speed <Hz>] [--jit] [--budget <instructions>] [--heap <bytes>] [--stack <bytes>] [--guard-pages]"
+                 " [--profile] [--flamegraph <stacks.txt>]" << std::endl;
     exit(1);
 }
 
@@ -27,9 +29,11 @@ int main(int argc, char **argv)
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         // If the argument is a known flag, skip it.
-        if (arg == "-h" || arg == "-d" || arg == "--debug" || arg == "--speed") {
+        if (arg == "-h" || arg == "-d" || arg == "--debug" || arg == "--speed" || arg == "--jit"
+            || arg == "--budget" || arg == "--heap" || arg == "--stack" || arg == "--guard-pages"
+            || arg == "--profile" || arg == "--flamegraph") {
             // If the flag takes a value (like --speed), skip the next argument as well.
-            if (arg == "--speed") {
+            if (arg == "--speed" || arg == "--budget" || arg == "--heap" || arg == "--stack" || arg == "--flamegraph") {
                 i++;
             }
             continue;
@@ -65,19 +69,47 @@ int main(int argc, char **argv)
     vec.reserve(fileSize);
     vec.insert(vec.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
 
-    auto vm = primal::vm::create();
+    primal::memory_config memory;
+    try {
+        if (!input.getCmdOption("--heap").empty()) {
+            memory.heap_size = static_cast<word_t>(std::stoull(input.getCmdOption("--heap")));
+        }
+        if (!input.getCmdOption("--stack").empty()) {
+            memory.stack_size = static_cast<word_t>(std::stoull(input.getCmdOption("--stack")));
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Error: Invalid value for --heap or --stack argument." << std::endl;
+        usage();
+    }
+    memory.guard_pages = input.cmdOptionExists("--guard-pages");
+
+    // only a debugging machine pays for looking at every instruction
+    bool debug = input.cmdOptionExists("-d") || input.cmdOptionExists("--debug");
+    auto vm = primal::vm::create(memory, debug ? primal::execution_policy::debug : primal::execution_policy::release);
 
-    if (input.cmdOptionExists("-d") || input.cmdOptionExists("--debug")) {
-        vm->set_debug(true);
+    if (debug) {
+        vm->set_observer(std::make_shared<primal::console_debugger>());
         std::cout << "--- VM DEBUG ENABLED ---" << std::endl;
     }
 
+    // the native code of the JIT does not count its instructions, so it does not run when the speed is capped
+    if (input.cmdOptionExists("--jit")) {
+        vm->set_jit(true);
+#ifdef TICKS
+        if (input.getCmdOption("--speed").empty()) {
+            vm->set_speed(0);
+        }
+#endif
+    }
+
+#ifdef TICKS
     const std::string& speed_str = input.getCmdOption("--speed");
     if (!speed_str.empty()) {
         try {
+            // 0 runs at full speed
             uint64_t speed_hz = std::stoull(speed_str);
+            vm->set_speed(speed_hz);
             if (speed_hz > 0) {
-                vm->set_speed(speed_hz);
                 std::cout << "--- VM SPEED CAPPED AT " << speed_hz << " Hz ---" << std::endl;
             }
         } catch (const std::exception&) {
@@ -85,7 +117,39 @@ int main(int argc, char **argv)
             usage();
         }
     }
+#endif
+
+    const std::string& budget_str = input.getCmdOption("--budget");
+    if (!budget_str.empty()) {
+        try {
+            vm->set_instruction_budget(std::stoull(budget_str));
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid value for --budget argument." << std::endl;
+            usage();
+        }
+    }
+
+    // the report goes to stderr, so it does not mix with the output of the application
+    const std::string& flamegraph = input.getCmdOption("--flamegraph");
+    bool profile = input.cmdOptionExists("--profile");
+    vm->set_profiling(profile || !flamegraph.empty());
 
+    bool finished = vm->run(vec);
 
-    vm->run(vec);
+    if (profile) {
+        vm->profile_report(std::cerr);
+    }
+    if (!flamegraph.empty()) {
+        std::ofstream stacks(flamegraph);
+        if (!stacks) {
+            std::cerr << "Error: Cannot open output file '" << flamegraph << "'" << std::endl;
+            return 1;
+        }
+        vm->profile_collapsed_stacks(stacks);
+    }
+
+    if (!finished) {
+        std::cerr << "Error: The instruction budget of " << budget_str << " was exhausted." << std::endl;
+        return 2;
+    }
 }
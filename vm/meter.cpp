@@ -0,0 +1,60 @@
+#include "meter.h"
+
+#include <algorithm>
+#include <limits>
+#ifdef TICKS
+#include <thread>
+#endif
+
+using namespace primal;
+
+void meter::start()
+{
+    m_executed = 0;
+#ifdef TICKS
+    m_started = std::chrono::steady_clock::now();
+#endif
+}
+
+uint64_t meter::next_batch() const
+{
+    uint64_t batch = std::numeric_limits<uint64_t>::max();
+    if(m_budget > 0)
+    {
+        batch = m_budget > m_executed ? m_budget - m_executed : 0;
+    }
+#ifdef TICKS
+    if(m_hertz > 0)
+    {
+        // the instructions of about a millisecond, so the clock is read at most a thousand times a second
+        batch = std::min<uint64_t>(batch, std::max<uint64_t>(m_hertz / 1000, 1));
+    }
+#endif
+    if(m_has_deadline)
+    {
+        // the clock is read once per batch, a batch is short enough to overrun the deadline by microseconds
+        if(std::chrono::steady_clock::now() >= m_deadline)
+        {
+            return 0;
+        }
+        batch = std::min<uint64_t>(batch, deadline_batch);
+    }
+    return batch;
+}
+
+void meter::account(uint64_t executed)
+{
+    m_executed += executed;
+#ifdef TICKS
+    if(m_hertz > 0)
+    {
+        // the due time of the next instruction is computed from the start, so the sleeps do not drift
+        using namespace std::chrono;
+        auto due = m_started + duration_cast<steady_clock::duration>(duration<double>(static_cast<double>(m_executed) / static_cast<double>(m_hertz)));
+        if(steady_clock::now() < due)
+        {
+            std::this_thread::sleep_until(due);
+        }
+    }
+#endif
+}
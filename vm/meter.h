@@ -0,0 +1,84 @@
+#ifndef PRIMAL_METER_H
+#define PRIMAL_METER_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace primal
+{
+
+/**
+ * @brief Counts the executed instructions in batches: enforces the instruction budget of a run and,
+ * with TICKS, paces the execution to the clock speed. A run can also be given a deadline.
+ *
+ * The dispatch loop asks for a batch, runs at most that many instructions counting down a local
+ * counter, then accounts for them. The clock is only looked at between two batches, about once
+ * every millisecond of the paced execution.
+ */
+class meter final
+{
+public:
+
+    /** @return True if the execution needs to be metered at all. */
+    bool enabled() const
+    {
+#ifdef TICKS
+        return m_budget > 0 || m_hertz > 0 || m_has_deadline;
+#else
+        return m_budget > 0 || m_has_deadline;
+#endif
+    }
+
+    /** @brief The number of instructions a run may execute, 0 for no limit. */
+    void set_budget(uint64_t instructions) { m_budget = instructions; }
+
+    /** @return The number of instructions a run may execute, 0 for no limit. */
+    uint64_t budget() const { return m_budget; }
+
+    /** @brief The time point after which no new batch is started. */
+    void set_deadline(std::chrono::steady_clock::time_point deadline)
+    {
+        m_deadline = deadline;
+        m_has_deadline = true;
+    }
+
+    /** @brief Lets the runs go on without a deadline. */
+    void clear_deadline() { m_has_deadline = false; }
+
+#ifdef TICKS
+    /** @brief The number of instructions to execute per second, 0 to run at full speed. */
+    void set_speed(uint64_t hertz) { m_hertz = hertz; }
+#endif
+
+    /** @brief Starts metering a new run, or the resumption of one. */
+    void start();
+
+    /**
+     * @return The number of instructions which can run before calling @ref account, 0 if the
+     * budget of the run is exhausted or its deadline has passed.
+     */
+    uint64_t next_batch() const;
+
+    /** @brief Counts the executed instructions, and waits if the execution is ahead of the clock. */
+    void account(uint64_t executed);
+
+    /** @return The number of instructions executed since @ref start. */
+    uint64_t executed() const { return m_executed; }
+
+private:
+
+    static constexpr uint64_t deadline_batch = 4096;  // the instructions run between two looks at the deadline
+
+    uint64_t m_budget = 0;
+    uint64_t m_executed = 0;
+    bool m_has_deadline = false;
+    std::chrono::steady_clock::time_point m_deadline;
+#ifdef TICKS
+    uint64_t m_hertz = 1000;
+    std::chrono::steady_clock::time_point m_started;
+#endif
+};
+
+}
+
+#endif // PRIMAL_METER_H
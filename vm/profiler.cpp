@@ -0,0 +1,216 @@
+#include "profiler.h"
+
+#include <opcodes.h>
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace primal;
+
+namespace
+{
+
+const char* opcode_name(uint8_t opcode)
+{
+    switch(opcode)
+    {
+#define PRIMAL_PROFILER_NAME(name, code) case code: return #name;
+    PRIMAL_OPCODE_LIST(PRIMAL_PROFILER_NAME)
+#undef PRIMAL_PROFILER_NAME
+    default:
+        return "?";
+    }
+}
+
+}
+
+profiler::profiler()
+{
+    reset({}, 0, 0);
+}
+
+void profiler::reset(const std::vector<loaded_function>& functions, word_t code_start, word_t code_size)
+{
+    m_call = opcodes::CALL().bin();
+    m_ret = opcodes::RET().bin();
+    m_calla = opcodes::CALLA().bin();
+    m_leave = opcodes::LEAVE().bin();
+    m_code_start = code_start;
+    m_total = 0;
+    std::fill(std::begin(m_opcodes), std::end(m_opcodes), opcode_stats());
+    m_addresses.assign(static_cast<size_t>(std::max<word_t>(code_size, 0)), 0);
+    m_address_opcodes.assign(m_addresses.size(), 0);
+
+    m_names.clear();
+    m_entries.clear();
+    for(const auto& f : functions)
+    {
+        if(!f.is_extern)
+        {
+            m_entries[code_start + f.address] = static_cast<int32_t>(m_names.size());
+            m_names.push_back(f.name);
+        }
+    }
+
+    m_nodes.assign(1, node());
+    m_current = 0;
+}
+
+void profiler::called(word_t target)
+{
+    auto e = m_entries.find(target);
+    int32_t function = -1;
+    if(e != m_entries.end())
+    {
+        function = e->second;
+    }
+    else
+    {
+        // not in the function table, it gets a name from its address
+        function = static_cast<int32_t>(m_names.size());
+        m_names.push_back("@" + std::to_string(target));
+        m_entries[target] = function;
+    }
+
+    auto& children = m_nodes[static_cast<size_t>(m_current)].children;
+    auto c = children.find(function);
+    if(c != children.end())
+    {
+        m_current = c->second;
+        return;
+    }
+
+    node n;
+    n.function = function;
+    n.parent = m_current;
+    int32_t index = static_cast<int32_t>(m_nodes.size());
+    m_nodes.push_back(n);
+    m_nodes[static_cast<size_t>(m_current)].children[function] = index;
+    m_current = index;
+}
+
+std::string profiler::path(int32_t n) const
+{
+    std::vector<int32_t> chain;
+    for(int32_t i = n; i > 0; i = m_nodes[static_cast<size_t>(i)].parent)
+    {
+        chain.push_back(m_nodes[static_cast<size_t>(i)].function);
+    }
+
+    std::string result = "main";
+    for(auto f = chain.rbegin(); f != chain.rend(); ++f)
+    {
+        result += ";" + m_names[static_cast<size_t>(*f)];
+    }
+    return result;
+}
+
+void profiler::report(std::ostream& out, size_t hottest) const
+{
+    using namespace std::chrono;
+    auto percent = [this](uint64_t n) { return m_total ? 100.0 * static_cast<double>(n) / static_cast<double>(m_total) : 0.0; };
+
+    out << "--- Profile: " << m_total << " instructions ---" << std::endl;
+
+    out << std::endl << "Opcodes:" << std::endl;
+    out << std::left << std::setw(10) << "  opcode" << std::right << std::setw(14) << "count" << std::setw(9) << "%"
+        << std::setw(14) << "time (us)" << std::setw(12) << "avg (ns)" << std::endl;
+    std::vector<size_t> opcodes;
+    for(size_t i = 0; i < 256; i++)
+    {
+        if(m_opcodes[i].count)
+        {
+            opcodes.push_back(i);
+        }
+    }
+    std::sort(opcodes.begin(), opcodes.end(), [this](size_t a, size_t b) { return m_opcodes[a].count > m_opcodes[b].count; });
+    for(size_t i : opcodes)
+    {
+        const opcode_stats& s = m_opcodes[i];
+        auto ns = duration_cast<nanoseconds>(s.time).count();
+        out << "  " << std::left << std::setw(8) << opcode_name(static_cast<uint8_t>(i)) << std::right << std::setw(14) << s.count
+            << std::setw(8) << std::fixed << std::setprecision(2) << percent(s.count) << "%"
+            << std::setw(14) << ns / 1000 << std::setw(12) << ns / static_cast<long long>(s.count) << std::endl;
+    }
+
+    // inclusive: the instructions of the call stacks a function is in, counted once for recursive calls
+    std::vector<uint64_t> total(m_nodes.size(), 0);
+    for(size_t i = m_nodes.size(); i-- > 0; )
+    {
+        // the children always come after their parent
+        total[i] += m_nodes[i].instructions;
+        if(m_nodes[i].parent != -1)
+        {
+            total[static_cast<size_t>(m_nodes[i].parent)] += total[i];
+        }
+    }
+    std::vector<uint64_t> inclusive(m_names.size(), 0);
+    std::vector<uint64_t> exclusive(m_names.size(), 0);
+    for(size_t i = 1; i < m_nodes.size(); i++)
+    {
+        auto f = static_cast<size_t>(m_nodes[i].function);
+        exclusive[f] += m_nodes[i].instructions;
+
+        bool outermost = true;
+        for(int32_t p = m_nodes[i].parent; p > 0 && outermost; p = m_nodes[static_cast<size_t>(p)].parent)
+        {
+            outermost = m_nodes[static_cast<size_t>(p)].function != m_nodes[i].function;
+        }
+        if(outermost)
+        {
+            inclusive[f] += total[i];
+        }
+    }
+
+    out << std::endl << "Functions:" << std::endl;
+    out << std::left << std::setw(26) << "  function" << std::right << std::setw(14) << "inclusive" << std::setw(9) << "%"
+        << std::setw(14) << "exclusive" << std::setw(9) << "%" << std::endl;
+    out << "  " << std::left << std::setw(24) << "main" << std::right << std::setw(14) << m_total << std::setw(8) << percent(m_total) << "%"
+        << std::setw(14) << m_nodes[0].instructions << std::setw(8) << percent(m_nodes[0].instructions) << "%" << std::endl;
+    std::vector<size_t> functions;
+    for(size_t i = 0; i < m_names.size(); i++)
+    {
+        if(inclusive[i])
+        {
+            functions.push_back(i);
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [&inclusive](size_t a, size_t b) { return inclusive[a] > inclusive[b]; });
+    for(size_t f : functions)
+    {
+        out << "  " << std::left << std::setw(24) << m_names[f] << std::right << std::setw(14) << inclusive[f] << std::setw(8) << percent(inclusive[f]) << "%"
+            << std::setw(14) << exclusive[f] << std::setw(8) << percent(exclusive[f]) << "%" << std::endl;
+    }
+
+    out << std::endl << "Hottest addresses:" << std::endl;
+    std::vector<size_t> addresses;
+    for(size_t i = 0; i < m_addresses.size(); i++)
+    {
+        if(m_addresses[i])
+        {
+            addresses.push_back(i);
+        }
+    }
+    size_t shown = std::min(hottest, addresses.size());
+    std::partial_sort(addresses.begin(), addresses.begin() + static_cast<std::ptrdiff_t>(shown), addresses.end(),
+                      [this](size_t a, size_t b) { return m_addresses[a] > m_addresses[b]; });
+    for(size_t i = 0; i < shown; i++)
+    {
+        size_t a = addresses[i];
+        out << "  " << std::setw(9) << m_code_start + static_cast<word_t>(a) << " [:" << std::setw(5) << a << "] "
+            << std::left << std::setw(8) << opcode_name(m_address_opcodes[a]) << std::right << std::setw(14) << m_addresses[a] << std::setw(8) << percent(m_addresses[a]) << "%" << std::endl;
+    }
+
+    out.unsetf(std::ios::floatfield);
+}
+
+void profiler::collapsed_stacks(std::ostream& out) const
+{
+    for(size_t i = 0; i < m_nodes.size(); i++)
+    {
+        if(m_nodes[i].instructions)
+        {
+            out << path(static_cast<int32_t>(i)) << " " << m_nodes[i].instructions << "\n";
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef PRIMAL_PROFILER_H
+#define PRIMAL_PROFILER_H
+
+#include <numeric_decl.h>
+
+#include "loaded_function.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace primal
+{
+
+/**
+ * @brief Collects where a script spends its time, fed by the profiling dispatch loop of the VM.
+ *
+ * Every instruction is counted and timed per opcode and counted per address. The script functions are
+ * followed through the calls and the returns: the instructions are counted for the chain of functions
+ * being executed (a call stack), which gives the exclusive and inclusive counts of the functions and the
+ * collapsed stacks the flamegraph tools take.
+ */
+class profiler final
+{
+public:
+
+    profiler();
+
+    /**
+     * @brief Drops what was collected and prepares for the given application.
+     *
+     * @param functions The function table of the application, the addresses relative to the application.
+     * @param code_start The address of the application in the memory.
+     * @param code_size The size of the application, the instructions outside of it are not counted per address.
+     */
+    void reset(const std::vector<loaded_function>& functions, word_t code_start, word_t code_size);
+
+    /** @brief Called before the instruction at the given address runs. */
+    void enter(word_t address, uint8_t opcode)
+    {
+        m_started = std::chrono::steady_clock::now();
+        m_opcodes[opcode].count ++;
+        m_nodes[static_cast<size_t>(m_current)].instructions ++;
+        word_t offset = address - m_code_start;
+        if(offset >= 0 && offset < static_cast<word_t>(m_addresses.size()))
+        {
+            m_addresses[static_cast<size_t>(offset)] ++;
+            m_address_opcodes[static_cast<size_t>(offset)] = opcode;
+        }
+        m_total ++;
+    }
+
+    /** @brief Called after the instruction ran, with the address the execution continues from. */
+    void leave(uint8_t opcode, word_t ip)
+    {
+        m_opcodes[opcode].time += std::chrono::steady_clock::now() - m_started;
+        if(opcode == m_call || opcode == m_calla)
+        {
+            called(ip);
+        }
+        else if((opcode == m_ret || opcode == m_leave) && m_current != 0)
+        {
+            m_current = m_nodes[static_cast<size_t>(m_current)].parent;
+        }
+    }
+
+    /** @return The number of instructions counted since the last reset. */
+    uint64_t instructions() const { return m_total; }
+
+    /**
+     * @brief Writes the human readable report: the opcodes, the functions and the hottest addresses.
+     *
+     * @param out Receives the report.
+     * @param hottest The number of addresses to list.
+     */
+    void report(std::ostream& out, size_t hottest = 10) const;
+
+    /**
+     * @brief Writes a line for every call stack the instructions ran in: the functions separated by
+     * semicolons, followed by the number of instructions, as taken by flamegraph.pl and its relatives.
+     */
+    void collapsed_stacks(std::ostream& out) const;
+
+private:
+
+    struct opcode_stats
+    {
+        uint64_t count = 0;
+        std::chrono::steady_clock::duration time {0};
+    };
+
+    // a call stack, the root is the code outside of the functions
+    struct node
+    {
+        int32_t function = -1;
+        int32_t parent = -1;
+        uint64_t instructions = 0;
+        std::map<int32_t, int32_t> children;
+    };
+
+    void called(word_t target);
+    std::string path(int32_t n) const;
+
+    uint8_t m_call = 0;
+    uint8_t m_ret = 0;
+    uint8_t m_calla = 0;
+    uint8_t m_leave = 0;
+    word_t m_code_start = 0;
+    uint64_t m_total = 0;
+    std::chrono::steady_clock::time_point m_started;
+
+    opcode_stats m_opcodes[256];
+    std::vector<uint64_t> m_addresses;                  // the counts of the addresses of the application
+    std::vector<uint8_t> m_address_opcodes;             // the opcode found at the addresses counted
+    std::vector<std::string> m_names;                   // the functions, as indexed by the nodes
+    std::unordered_map<word_t, int32_t> m_entries;      // the function starting at an address
+    std::vector<node> m_nodes;
+    int32_t m_current = 0;
+};
+
+}
+
+#endif // PRIMAL_PROFILER_H
@@ -0,0 +1,151 @@
+#include "vm_impl.h"
+#include "vm.h"
+
+#include <opcodes.h>
+#include <opcode_variants.h>
+
+#include <array>
+#include <cstring>
+#include <utility>
+
+using namespace primal;
+
+namespace
+{
+
+// the operand kinds the specialized handlers are generated for, in the order of the handler table
+constexpr operand::kind specialized_kinds[] = { operand::kind::reg, operand::kind::immediate, operand::kind::mem };
+constexpr size_t specialized_kind_count = sizeof(specialized_kinds) / sizeof(specialized_kinds[0]);
+
+// the index of the kind of the given addressing mode in specialized_kinds, -1 if it has no specialized handlers
+int specialized_kind_index(type_destination t)
+{
+    switch(t)
+    {
+    case type_destination::TYPE_MOD_REG:
+        return 0;
+    case type_destination::TYPE_MOD_IMM:        // [[fallthrough]]
+    case type_destination::TYPE_MOD_IMM_BYTE:
+        return 1;
+    case type_destination::TYPE_MOD_MEM_IMM:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+// every combination has a handler setting the flag and one leaving it alone, for when it is dead
+constexpr size_t table_index(uint8_t opc, size_t dest, size_t src, bool flag)
+{
+    return ((opc * specialized_kind_count + dest) * specialized_kind_count + src) * 2 + (flag ? 1 : 0);
+}
+
+using runner_table = std::array<vm_impl::opcode_runner, 256 * specialized_kind_count * specialized_kind_count * 2>;
+
+template<class OP, size_t D, size_t S>
+void add_specialized(runner_table& arr, uint8_t opc)
+{
+    // nothing can be written into an immediate, those are left to the generic handler to complain about
+    if constexpr(!(OP::writes && specialized_kinds[D] == operand::kind::immediate))
+    {
+        arr[table_index(opc, D, S, true)] = &vm_impl::run_specialized<OP, specialized_kinds[D], specialized_kinds[S], true>;
+        arr[table_index(opc, D, S, false)] = &vm_impl::run_specialized<OP, specialized_kinds[D], specialized_kinds[S], false>;
+    }
+}
+
+template<class OP, size_t... I>
+void add_specialized_opcode(runner_table& arr, uint8_t opc, std::index_sequence<I...>)
+{
+    (add_specialized<OP, I / specialized_kind_count, I % specialized_kind_count>(arr, opc), ...);
+}
+
+const runner_table specialized_runners = []() -> runner_table {
+    runner_table arr;
+    arr.fill(nullptr);
+#define PRIMAL_SPECIALIZED_ENTRY(name) \
+    add_specialized_opcode<specialized::name>(arr, opcodes::name().bin(), std::make_index_sequence<specialized_kind_count * specialized_kind_count>());
+    PRIMAL_SPECIALIZED_OPCODE_LIST(PRIMAL_SPECIALIZED_ENTRY)
+#undef PRIMAL_SPECIALIZED_ENTRY
+    return arr;
+}();
+
+}
+
+template<operand::kind K>
+word_t vm_impl::read(const decoded_operand &o)
+{
+    if constexpr(K == operand::kind::reg)
+    {
+        return m_r[o.ridx];
+    }
+    else if constexpr(K == operand::kind::immediate)
+    {
+        return o.imm;
+    }
+    else
+    {
+        word_t v = 0;
+        std::memcpy(&v, mem_at(o, word_size), sizeof(v));
+        return v;
+    }
+}
+
+template<operand::kind K>
+void vm_impl::write(const decoded_operand &o, word_t v)
+{
+    static_assert(K != operand::kind::immediate, "cannot assign to a numeric value");
+
+    if constexpr(K == operand::kind::reg)
+    {
+        m_r[o.ridx] = v;
+    }
+    else
+    {
+        std::memcpy(mem_at(o, word_size), &v, sizeof(v));
+    }
+}
+
+template<class OP, operand::kind D, operand::kind S, bool FLAG>
+bool vm_impl::run_specialized(vm *v)
+{
+    vm_impl* self = v->m_impl.get();
+    const decoded_operand* ops = self->m_current->operands;
+
+    word_t result = OP::apply(self->read<D>(ops[0]), self->read<S>(ops[1]));
+    if constexpr(OP::writes)
+    {
+        self->write<D>(ops[0], result);
+    }
+    if constexpr(FLAG)
+    {
+        self->reg_flag() = OP::writes ? result != 0 : result;
+    }
+    return true;
+}
+
+vm_impl::opcode_runner vm_impl::specialized_runner(uint8_t opc, type_destination dest, type_destination src, bool flag)
+{
+    int d = specialized_kind_index(dest);
+    int s = specialized_kind_index(src);
+    if(d == -1 || s == -1)
+    {
+        return nullptr;
+    }
+    return specialized_runners[table_index(opc, static_cast<size_t>(d), static_cast<size_t>(s), flag)];
+}
+
+void vm_impl::specialize(decoded_program &p, bool dead_flags)
+{
+    for(auto& ins : p.instructions)
+    {
+        if(ins.operand_count != 2)
+        {
+            continue;
+        }
+
+        if(auto r = specialized_runner(ins.opcode, ins.operands[0].type, ins.operands[1].type, !(dead_flags && ins.flag_dead)))
+        {
+            ins.handler = r;
+        }
+    }
+}
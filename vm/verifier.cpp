@@ -0,0 +1,109 @@
+#include "verifier.h"
+
+#include <hal.h>
+#include <opcodes.h>
+
+#include <limits>
+
+using namespace primal;
+
+// the register indexes are single bytes in the bytecode, all of them must name an existing register
+static_assert(VM_REG_COUNT > std::numeric_limits<uint8_t>::max(), "every register index of the bytecode must name a register");
+
+namespace
+{
+
+// the opcodes writing their first operand, which cannot be an immediate
+bool writes_first_operand(uint8_t opc)
+{
+    return opc == opcodes::MOV().bin() || opc == opcodes::ADD().bin() || opc == opcodes::SUB().bin()
+        || opc == opcodes::MUL().bin() || opc == opcodes::DIV().bin() || opc == opcodes::MOD().bin()
+        || opc == opcodes::OR().bin() || opc == opcodes::AND().bin() || opc == opcodes::XOR().bin()
+        || opc == opcodes::NOT().bin() || opc == opcodes::INC().bin() || opc == opcodes::POP().bin()
+        || opc == opcodes::IDJLTE().bin();
+}
+
+bool is_immediate(type_destination t)
+{
+    return t == type_destination::TYPE_MOD_IMM || t == type_destination::TYPE_MOD_IMM_BYTE;
+}
+
+// the width of the memory accessed by the operand, 0 if it is not a memory operand
+word_t memory_width(type_destination t)
+{
+    switch(t)
+    {
+    case type_destination::TYPE_MOD_MEM_IMM:            // [[fallthrough]]
+    case type_destination::TYPE_MOD_MEM_REG_IDX:
+        return word_size;
+    case type_destination::TYPE_MOD_MEM_IMM_BYTE:       // [[fallthrough]]
+    case type_destination::TYPE_MOD_MEM_REG_BYTE:
+    case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
+    case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+}
+
+verification primal::verify_program(decoded_program& p, word_t mem_size)
+{
+    verification result;
+    auto fail = [&result](const decoded_instruction& ins, const std::string& what) {
+        if(result.error.empty())
+        {
+            result.error = what + " at " + std::to_string(ins.address);
+        }
+    };
+
+    for(auto& ins : p.instructions)
+    {
+        // the exit marker and the end of the code section
+        if(!ins.handler)
+        {
+            continue;
+        }
+
+        if(ins.operand_count > 0 && writes_first_operand(ins.opcode) && is_immediate(ins.operands[0].type))
+        {
+            fail(ins, "Assignment to a numeric value");
+        }
+
+        bool absolute = is_absolute_jump(ins.opcode) && ins.operands[0].type == type_destination::TYPE_MOD_IMM;
+        bool relative = is_relative_jump(ins.opcode) && ins.operands[ins.operand_count - 1].type == type_destination::TYPE_MOD_IMM;
+        if((absolute || relative) && ins.target_index == -1)
+        {
+            fail(ins, "Jump outside of the instructions");
+        }
+
+        for(uint8_t i = 0; i < ins.operand_count; i++)
+        {
+            auto& o = ins.operands[i];
+            word_t width = memory_width(o.type);
+            if(width == 0)
+            {
+                continue;
+            }
+
+            if(o.type != type_destination::TYPE_MOD_MEM_IMM && o.type != type_destination::TYPE_MOD_MEM_IMM_BYTE)
+            {
+                result.checked ++;
+                continue;
+            }
+
+            if(o.imm < 0 || o.imm > mem_size - width)
+            {
+                fail(ins, "Memory address " + std::to_string(o.imm) + " out of range");
+                result.checked ++;
+                continue;
+            }
+
+            o.unchecked = true;
+            result.proven_safe ++;
+        }
+    }
+
+    return result;
+}
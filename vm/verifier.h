@@ -0,0 +1,48 @@
+#ifndef PRIMAL_VERIFIER_H
+#define PRIMAL_VERIFIER_H
+
+#include <numeric_decl.h>
+
+#include "decoder.h"
+
+#include <string>
+#include <cstddef>
+
+namespace primal
+{
+
+/**
+ * @brief What the verifier found out about a decoded program.
+ */
+struct verification
+{
+    /** The description of the first failed check, empty if the program passed all of them. */
+    std::string error;
+
+    /** The number of memory operands proven to stay within the memory, these are not checked at runtime. */
+    size_t proven_safe = 0;
+
+    /** The number of memory operands with an address computed at runtime, these are checked on every access. */
+    size_t checked = 0;
+};
+
+/**
+ * @brief Verifies the decoded code section of an application, done once when it is loaded.
+ *
+ * Every instruction must have a valid opcode with operands matching what it does, the jumps with an
+ * immediate target must land on the start of an instruction and the immediate memory addresses must be
+ * within the memory. The memory operands with an immediate address within the memory are marked as
+ * @ref decoded_operand::unchecked, so the VM can skip their bounds checks.
+ *
+ * A program failing a check can still be run, the failing instruction panics when it gets executed
+ * just like without the verifier.
+ *
+ * @param p The decoded program, its proven safe operands are marked.
+ * @param mem_size The size of the memory of the VM.
+ * @return The result of the verification.
+ */
+verification verify_program(decoded_program& p, word_t mem_size);
+
+}
+
+#endif // PRIMAL_VERIFIER_H
@@ -9,28 +9,125 @@
 #include <types.h>
 #include <util.h>
 
-#include <algorithm>
 #include <algorithm>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <iomanip>
 
 using namespace primal;
 
+namespace
+{
+
+// the opcode and interrupt tables are shared by all the machines, and only read once they are filled
+void register_builtins()
+{
+    static std::once_flag registered;
+    std::call_once(registered, []()
+    {
+        // these functions are autogenerated by cmake in their own files
+        register_opcodes();
+        register_interrupts();
+    });
+}
+
+}
+
+vm::vm() : m_impl(new vm_impl(memory_config(), execution_policy::release)), m_regs(m_impl->m_r)
+{
+    register_builtins();
+    m_impl->m_interrupts = vm_impl::builtin_interrupts;
+}
 
-vm::vm() : m_impl(new vm_impl)
+vm::vm(const memory_config& config, execution_policy policy) : m_impl(new vm_impl(config, policy)), m_regs(m_impl->m_r)
 {
+    register_builtins();
+    m_impl->m_interrupts = vm_impl::builtin_interrupts;
 }
 
 bool vm::run(const std::vector<uint8_t> &app)
+{
+    load(app);
+    return m_impl->resume(this);
+}
+
+void vm::load(const std::vector<uint8_t> &app)
 {
     m_functions = load_function_table(app);
-    return m_impl->run(app, this);
+    m_impl->link_functions(m_functions);
+    m_impl->load(app, this);
+}
+
+bool vm::resume()
+{
+    return m_impl->resume(this);
+}
+
+run_status vm::run_for(uint64_t instructions)
+{
+    return m_impl->run_for(this, instructions);
+}
+
+run_status vm::run_for(std::chrono::steady_clock::duration slice)
+{
+    return m_impl->run_until(this, std::chrono::steady_clock::now() + slice);
+}
+
+run_status vm::run_until(std::chrono::steady_clock::time_point deadline)
+{
+    return m_impl->run_until(this, deadline);
 }
 
-word_t &vm::ip()      {return m_impl->ip();}
+run_status vm::step()
+{
+    return m_impl->run_for(this, 1);
+}
 
-word_t vm::ip() const {return m_impl->ip();}
+run_status vm::status() const
+{
+    return m_impl->m_status;
+}
+
+void vm::suspend(std::shared_ptr<pending_call> pending)
+{
+    m_impl->suspend(std::move(pending));
+}
+
+void vm::request_stop()
+{
+    m_impl->m_stop_request.store(true, std::memory_order_relaxed);
+}
+
+void vm::clear_stop_request()
+{
+    m_impl->m_stop_request.store(false, std::memory_order_relaxed);
+}
+
+void vm::yield()
+{
+    m_impl->yield();
+}
+
+bool vm::stop_requested() const
+{
+    return m_impl->stop_requested();
+}
+
+bool vm::ready() const
+{
+    return m_impl->m_status != run_status::suspended || !m_impl->m_pending || m_impl->m_pending->ready();
+}
+
+std::shared_ptr<const vm_snapshot> vm::snapshot() const
+{
+    return m_impl->take_snapshot(this);
+}
+
+void vm::fork_from(const vm_snapshot& s)
+{
+    m_impl->fork_from(s, this);
+}
 
 void vm::set_mem(word_t address, word_t new_value)
 {
@@ -54,22 +151,20 @@ uint8_t vm::get_mem_byte(word_t address)
 
 std::shared_ptr<vm> vm::create()
 {
-    // these functions are autogenerated by cmake in their own files
-    register_opcodes();
-    register_interrupts();
-
     return std::make_shared<vm>();
 }
 
+std::shared_ptr<vm> vm::create(const memory_config& config, execution_policy policy)
+{
+    return std::make_shared<vm>(config, policy);
+}
+
 
-valued *vm::fetch()
+operand vm::fetch()
 {
     return m_impl->fetch();
 }
 
-reg &vm::r(uint8_t i)             { return m_impl->m_r[i];}
-const reg &vm::r(uint8_t i) const { return m_impl->m_r[i];}
-
 bool vm::copy(word_t dest, word_t src, word_t cnt)
 {
     return m_impl->copy(dest, src, cnt);
@@ -90,130 +185,40 @@ word_t vm::pop()
     return m_impl->pop();
 }
 
+bool vm::jump(word_t v)
+{
+    m_impl->reg_ip() = v;
+    return m_impl->reg_ip() < VM_MEM_SEGMENT_SIZE + m_impl->app_size;
+}
 
-word_t vm::flag() const {return m_impl->flag();}
-
-void vm::set_flag(word_t v)
+bool vm::interrupt(word_t i)
 {
-    m_impl->m_r[253].set_value( v );
+    return m_impl->call_interrupt(i, this);
 }
 
-bool vm::jump(word_t v)
+bool vm::call_native(word_t index)
 {
-    m_impl->m_ip = v;
-    return m_impl->m_ip < VM_MEM_SEGMENT_SIZE + m_impl->app_size;
+    return m_impl->call_native(index, this);
 }
 
-bool vm::interrupt(word_t i)
+void vm::register_interrupt(uint8_t i, bool (*handler)(vm*))
 {
-    std::function<bool(vm*)> fun;
-    if(m_impl->interrupts.count(i) > 0)
-    {
-        return m_impl->interrupts[i].runner(this);
-    }
-    else
-    {
-        panic(std::string(("Unimplemented interrupt called: ") + std::to_string(i)).c_str());
-    }
+    vm_impl::interrupt_entry& e = m_impl->m_interrupts[i];
+    e = vm_impl::interrupt_entry();
+    e.handler = handler;
 }
 
-bool vm::address_is_valid(word_t addr)
+void vm::set_interrupt(uint8_t i, bool (*thunk)(void*, vm*), std::shared_ptr<void> target)
 {
-    return addr <= m_impl->app_size + VM_MEM_SEGMENT_SIZE && addr >= 0;
+    vm_impl::interrupt_entry& e = m_impl->m_interrupts[i];
+    e = vm_impl::interrupt_entry();
+    e.thunk = thunk;
+    e.target = std::move(target);
 }
 
-void vm::debug(opcodes::opcode &&o, OpcodeDebugState ods)
+bool vm::address_is_valid(word_t addr)
 {
-    if(m_debug)
-    {
-        static size_t last_debugged_ip = 0 ;
-        if(ods == OpcodeDebugState::VM_DEBUG_BEFORE)
-        {
-            size_t local_ip = m_impl->ip();
-            last_debugged_ip = local_ip;
-
-            std::cout << "->" << std::setw(5) << std::dec << local_ip << ":";
-
-            std::cout << o.name() << " (" << o.paramcount() << ") ";
-
-            for(word_t i=0; i<o.paramcount(); i++)
-            {
-                m_impl->peek(local_ip);
-            }
-
-            if(o.bin() == primal::opcodes::POP().bin())
-            {
-                std::cout << " SP= ["<< m_impl->sp.value() <<"] ";
-            }
-            if(o.bin() == primal::opcodes::PUSH().bin())
-            {
-                std::cout << " SP= ["<< m_impl->sp.value() <<"] ";
-            }
-
-            std::cout << " =>> ";
-
-
-        }
-
-        if(ods == OpcodeDebugState::VM_DEBUG_AFTER)
-        {
-            size_t local_ip = last_debugged_ip;
-
-            std::cout << "->" << std::setw(5) << std::dec << local_ip << ":";
-
-            std::cout << o.name() << " (" << o.paramcount() << ") ";
-
-            for(word_t i=0; i<o.paramcount(); i++)
-            {
-                m_impl->peek(local_ip);
-            }
-            if(o.bin() == primal::opcodes::POP().bin())
-            {
-                std::cout << " SP= ["<< m_impl->sp.value() <<"] ";
-            }
-            if(o.bin() == primal::opcodes::PUSH().bin())
-            {
-                std::cout << " SP= ["<< m_impl->sp.value() <<"] ";
-            }
-
-            std::cout << std::endl;
-
-            const char* GREEN   = "\033[1;32m";
-            const char* RESET   = "\033[0m";
-
-
-            std::cout << GREEN << "$ " << RESET ;
-
-            std::string cmd;
-            std::getline(std::cin, cmd);
-
-            if(!cmd.empty())
-            {
-                if(cmd == "q")
-                {
-                    exit(1);
-                }
-                if(cmd.starts_with("p")) // print something
-                {
-                    cmd = cmd.substr(1, cmd.size() - 1);
-                    if(!cmd.empty())
-                    {
-                        if(cmd.starts_with("r")) // print a register
-                        {
-                            cmd = cmd.substr(1, cmd.size() - 1);
-                            if(!cmd.empty())
-                            {
-                                int rig = std::stoi(cmd);
-                                std::cout << " =" << r(rig).value() << std::endl;
-                            }
-                        }
-                    }
-                }
-            }
-
-        }
-
-    }
+    return addr <= static_cast<word_t>(m_impl->ms.size()) && addr >= 0;
 }
 
 std::shared_ptr<vm_impl> vm::get_impl() const
@@ -221,18 +226,109 @@ std::shared_ptr<vm_impl> vm::get_impl() const
     return m_impl;
 }
 
-void vm::set_debug(bool newDebug)
+void vm::set_observer(std::shared_ptr<vm_observer> observer)
 {
-    m_debug = newDebug;
-    m_impl->set_debug(newDebug);
+    m_impl->m_observer = std::move(observer);
 }
 
+execution_policy vm::policy() const
+{
+    return m_impl->m_policy;
+}
+
+#ifdef TICKS
 void vm::set_speed(uint64_t hertz)
 {
     m_impl->set_speed(hertz);
 }
+#endif
+
+void vm::set_profiling(bool profiling)
+{
+    m_impl->set_profiling(profiling);
+}
+
+void vm::profile_report(std::ostream& out) const
+{
+    m_impl->m_profiler.report(out);
+}
+
+void vm::profile_collapsed_stacks(std::ostream& out) const
+{
+    m_impl->m_profiler.collapsed_stacks(out);
+}
+
+void vm::set_instruction_budget(uint64_t instructions)
+{
+    m_impl->set_instruction_budget(instructions);
+}
+
+uint64_t vm::executed_instructions() const
+{
+    return m_impl->m_meter.executed();
+}
+
+void vm::set_predecode(bool predecode)
+{
+    m_impl->set_predecode(predecode);
+}
+
+void vm::set_jit(bool jit)
+{
+    m_impl->set_jit(jit);
+}
+
+void vm::set_jit_threshold(uint32_t threshold)
+{
+    m_impl->m_jit.set_threshold(threshold);
+}
+
+size_t vm::jit_translated_functions() const
+{
+    return m_impl->m_jit.translated();
+}
+
+bool vm::jit_supported()
+{
+    return jit::supported();
+}
+
+void vm::set_verify(bool verify)
+{
+    m_impl->set_verify(verify);
+}
+
+std::string vm::verification_error() const
+{
+    return m_impl->m_verification.error;
+}
+
+size_t vm::proven_safe_accesses() const
+{
+    return m_impl->m_verification.proven_safe;
+}
+
+bool vm::guard_pages_supported()
+{
+    return vm_memory::guards_supported();
+}
+
+word_t vm::memory_size() const
+{
+    return static_cast<word_t>(m_impl->ms.size());
+}
+
+word_t vm::heap_start() const
+{
+    return m_impl->m_heap_start;
+}
+
+word_t vm::stack_start() const
+{
+    return m_impl->m_stack_start;
+}
 
-std::vector<loaded_function> vm::functions() const
+const std::vector<loaded_function>& vm::functions() const
 {
     return m_functions;
 }
@@ -5,29 +5,80 @@
 #include <opcode.h>
 #include "numeric_decl.h"
 #include <registers.h>
+#include <operand.h>
 #include <interface.h>
 #include "loaded_function.h"
+#include "vm_observer.h"
 
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <iostream>
 #include <functional>
+#include <type_traits>
 
-#define VM_DEBUG 1
+namespace primal
+{
+
+struct vm_impl;
+struct vm_snapshot;
+class pending_call;
 
 /**
- * @brief Describes whether opcode debugging occurs before or after execution.
+ * @brief The memory layout of a virtual machine, given when it is created.
+ *
+ * The memory starts with the data segment of VM_MEM_SEGMENT_SIZE bytes (the global variables, the copy
+ * of the string table and the results of the foreign functions) followed by the application, this part
+ * is fixed by the compiler. By default the stack is in the data segment too, right after the globals.
  */
-enum class OpcodeDebugState
+struct memory_config
 {
-    VM_DEBUG_BEFORE = 1, /**< Debug state before opcode execution */
-    VM_DEBUG_AFTER  = 2  /**< Debug state after opcode execution */
+    /** The number of bytes placed after the application for the scripts to use. */
+    word_t heap_size = 0;
+
+    /** The size of the stack placed after the heap, 0 keeps the stack in the data segment. */
+    word_t stack_size = 0;
+
+    /**
+     * The number of bytes placed after the heap for the strings returned by the foreign functions. Every
+     * call gets its own place, so the earlier results stay valid until the area wraps around. 0 puts every
+     * result at STRING_RESULT_INDEX_IN_MEM in the data segment, overwriting the previous one.
+     */
+    word_t ffi_result_size = 0;
+
+    /**
+     * Back the memory by a mapping with a guard page on each side, so an access escaping the bounds checks
+     * crashes instead of reaching the rest of the process. Needs a @ref stack_size, and a platform with
+     * anonymous mappings (see vm::guard_pages_supported()).
+     */
+    bool guard_pages = false;
 };
 
-namespace primal
+/**
+ * @brief Describes how the last run of a virtual machine stopped.
+ */
+enum class run_status
 {
+    finished,           /**< The application reached its end */
+    budget_exhausted,   /**< The instruction budget, the slice or the deadline ran out, vm::resume() continues the run */
+    ready,              /**< The application or a snapshot was loaded, vm::resume() starts running it */
+    suspended,          /**< Waiting: an asynchronous foreign function was called, vm::resume() continues with its result */
+    yielded,            /**< The application executed YIELD, vm::resume() continues after it */
+    cancelled           /**< vm::request_stop() was called, vm::resume() continues the run */
+};
 
-struct vm_impl;
+/**
+ * @brief How a virtual machine executes, chosen when it is created.
+ *
+ * The release machines run the fastest dispatch loop available and pay nothing for the observers. The
+ * other two run a dispatch loop which tells the observer (see vm::set_observer()) about every instruction.
+ */
+enum class execution_policy
+{
+    release,    /**< No observer is called, the pre-decoded program, the JIT and the profiler are used */
+    trace,      /**< The observer is called around every instruction of the pre-decoded program */
+    debug       /**< The observer is called around every instruction read from the memory, so it can change the code */
+};
 
 /**
  * @brief Virtual Machine class responsible for executing compiled bytecode.
@@ -47,22 +98,144 @@ public:
      */
     static std::shared_ptr<vm> create();
 
+    /**
+     * @brief Create a new virtual machine instance with the given memory layout.
+     *
+     * @param config The sizes of the heap and the stack, and whether to use guard pages.
+     * @param policy How the machine executes, it cannot be changed later.
+     * @return A shared pointer to a newly created VM instance.
+     */
+    static std::shared_ptr<vm> create(const memory_config& config, execution_policy policy = execution_policy::release);
+
     /**
      * @brief Default constructor.
      *
-     * Initializes the virtual machine.
+     * Initializes the virtual machine with the default memory layout.
      */
     vm();
 
+    /**
+     * @brief Constructor.
+     *
+     * Initializes the virtual machine with the given memory layout.
+     *
+     * @param config The memory layout.
+     * @param policy How the machine executes.
+     */
+    explicit vm(const memory_config& config, execution_policy policy = execution_policy::release);
+
     /**
      * @brief Execute the compiled bytecode of an application.
      *
+     * The same as load() followed by resume().
+     *
      * @param app The compiled bytecode to run.
-     * @return True if execution completed normally.
+     * @return True if execution completed normally, false if it stopped before (see status()).
      * @throws primal::vm_panic if invalid bytecode is detected.
      */
     bool run(const std::vector<uint8_t>& app);
 
+    /**
+     * @brief Load an application without running it.
+     *
+     * The memory is laid out, the extern functions are linked and the code is decoded, the status becomes
+     * run_status::ready. The application is then run by resume(), run_for() or step().
+     *
+     * @param app The compiled bytecode to load.
+     * @throws primal::vm_panic if the memory cannot be allocated.
+     */
+    void load(const std::vector<uint8_t>& app);
+
+    /**
+     * @brief Continue the run which stopped because the instruction budget was exhausted, the application
+     * yielded or an asynchronous foreign function was called, or start running the application loaded by
+     * load() or the state loaded by fork_from().
+     *
+     * The registers and the memory are kept, the continued run gets a new instruction budget. A suspended
+     * run waits for the result of the foreign function if it is not ready yet, and continues after the
+     * call with the result in r0.
+     *
+     * @return True if execution completed normally, false if it stopped again (see status()).
+     * @throws primal::vm_panic if invalid bytecode is detected or the foreign function threw.
+     */
+    bool resume();
+
+    /**
+     * @brief Continue the run like resume(), for at most the given number of instructions.
+     *
+     * The slice takes the place of the instruction budget (see set_instruction_budget()) for this call only.
+     *
+     * @param instructions The number of instructions to execute, 0 executes nothing.
+     * @return How the run stopped: run_status::budget_exhausted when the slice ran out.
+     * @throws primal::vm_panic if invalid bytecode is detected or the foreign function threw.
+     */
+    run_status run_for(uint64_t instructions);
+
+    /**
+     * @brief Continue the run like resume(), for about the given time.
+     *
+     * The clock is read between two batches of a few thousand instructions, so a slice can be overrun by
+     * that many instructions, or by a foreign function which takes long.
+     *
+     * @param slice How long the run may go on.
+     * @return How the run stopped: run_status::budget_exhausted when the time ran out.
+     * @throws primal::vm_panic if invalid bytecode is detected or the foreign function threw.
+     */
+    run_status run_for(std::chrono::steady_clock::duration slice);
+
+    /**
+     * @brief Continue the run like resume(), until the given deadline (see run_for()).
+     *
+     * @param deadline When the run has to give the thread back.
+     * @return How the run stopped: run_status::budget_exhausted when the deadline passed.
+     * @throws primal::vm_panic if invalid bytecode is detected or the foreign function threw.
+     */
+    run_status run_until(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Execute a single instruction, the same as run_for(1).
+     *
+     * @return How the run stopped, run_status::budget_exhausted when there are instructions left.
+     */
+    run_status step();
+
+    /**
+     * @brief Whether resume() can continue without waiting.
+     *
+     * @return False while the run is suspended on the result of a foreign function not ready yet.
+     */
+    bool ready() const;
+
+    /**
+     * @brief Capture the registers and the memory of the machine.
+     *
+     * Meant to be taken between two runs, typically when the initialization of an application ran out of
+     * the instruction budget or finished. Any number of machines can be started from the snapshot with
+     * fork_from(), and they share its memory until they write to it.
+     *
+     * @return The snapshot, nullptr if the machine has not run anything yet.
+     */
+    std::shared_ptr<const vm_snapshot> snapshot() const;
+
+    /**
+     * @brief Load the state captured by a snapshot, to be started with resume().
+     *
+     * The memory is a copy-on-write mapping of the one of the snapshot, with the layout of the machine the
+     * snapshot was taken of. The IP is where that machine stopped: when it had finished, set the IP with ip()
+     * to where the run should start.
+     *
+     * @param s The snapshot, it can be dropped once this returns.
+     * @throws primal::vm_panic if the memory cannot be mapped.
+     */
+    void fork_from(const vm_snapshot& s);
+
+    /**
+     * @brief How the last run (or resumption) stopped.
+     *
+     * @return The status of the last run.
+     */
+    run_status status() const;
+
     /**
      * @brief Accessor for the instruction pointer (IP) of the VM.
      *
@@ -70,14 +243,14 @@ public:
      *
      * @return Reference to the IP.
      */
-    word_t& ip();
+    word_t& ip() { return m_regs[VM_REG_IP]; }
 
     /**
      * @brief Read-only accessor for the instruction pointer.
      *
      * @return The current IP value.
      */
-    word_t ip() const;
+    word_t ip() const { return m_regs[VM_REG_IP]; }
 
     /**
      * @brief Write a word to VM memory.
@@ -119,17 +292,17 @@ public:
      * @brief Access a register for read/write.
      *
      * @param i Index of the register.
-     * @return Reference to the register.
+     * @return Refers to the register in the register file of the machine.
      */
-    reg& r(uint8_t i);
+    register_ref r(uint8_t i) { return register_ref(m_regs[i], i); }
 
     /**
      * @brief Access a register for read-only.
      *
      * @param i Index of the register.
-     * @return Const reference to the register.
+     * @return Refers to the register, it cannot be assigned to, not even through a copy.
      */
-    const reg& r(uint8_t i) const;
+    const_register_ref r(uint8_t i) const { return const_register_ref(m_regs[i], i); }
 
     /**
      * @brief Copy a block of memory inside the VM.
@@ -175,25 +348,28 @@ public:
     [[noreturn]] void panic(const char* reason);
 
     /**
-     * @brief Fetch the next object from memory for opcode operations.
+     * @brief Fetch the next operand of the current instruction.
      *
-     * @return Pointer to the valued object.
+     * @return The operand, resolved against the registers and the memory of the VM.
      */
-    valued* fetch();
+    operand fetch();
 
     /**
      * @brief Get the VM's last operation flag.
      *
+     * The release machines do not set the flags which the next instruction overwrites anyway, a run stopped
+     * right before such an instruction shows the flag of an earlier one.
+     *
      * @return The flag value.
      */
-    word_t flag() const;
+    word_t flag() const { return m_regs[VM_REG_FLAG]; }
 
     /**
      * @brief Set the VM's flag value.
      *
      * @param v New flag value.
      */
-    void set_flag(word_t v);
+    void set_flag(word_t v) { m_regs[VM_REG_FLAG] = v; }
 
     /**
      * @brief Execute a jump in the VM memory.
@@ -212,20 +388,98 @@ public:
     bool interrupt(word_t i);
 
     /**
-     * @brief Check if a memory address is valid.
+     * @brief Call an extern function of the application, the way CALLN and interrupt 2 do.
      *
-     * @param addr The address to check.
-     * @return True if the address is valid.
+     * The extern functions are numbered in the order of the function table of the application and linked to
+     * the function registry when the application is loaded. The arguments are popped from the stack, the
+     * result is placed in r0, and a function returning a future which is not ready suspends the machine.
+     *
+     * @param index The index of the extern function.
+     * @return True if the function was called.
+     * @throws primal::vm_panic if the application has no extern function with the index.
      */
-    bool address_is_valid(word_t addr);
+    bool call_native(word_t index);
 
     /**
-     * @brief Output opcode debugging information.
+     * @brief Register a host function as an interrupt of this machine.
+     *
+     * Every machine starts with the interrupts built into the VM, the ones registered here are only seen by
+     * this machine: a free number adds an interrupt, the number of a built-in interrupt replaces it. The
+     * interrupts are kept in a table indexed by the number, INTR finds the handler without a lookup.
      *
-     * @param o The opcode to debug.
-     * @param ods The debug state.
+     * @param i Interrupt number.
+     * @param handler Called with the machine when the interrupt is triggered, nullptr removes the interrupt.
      */
-    void debug(primal::opcodes::opcode&& o, OpcodeDebugState ods);
+    void register_interrupt(uint8_t i, bool (*handler)(vm*));
+
+    /**
+     * @brief Register a callable object as an interrupt of this machine.
+     *
+     * @tparam C Callable type, invoked with the machine (vm*) and returning true on success.
+     * @param i Interrupt number.
+     * @param handler The callable, kept by the machine until it is replaced.
+     */
+    template<typename C>
+    void register_interrupt(uint8_t i, C handler)
+    {
+        if constexpr(std::is_convertible_v<C, bool (*)(vm*)>)
+        {
+            // plain functions, lambdas without captures and nullptr need nothing kept
+            register_interrupt(i, static_cast<bool (*)(vm*)>(handler));
+        }
+        else
+        {
+            set_interrupt(i, [](void* target, vm* v) -> bool { return (*static_cast<C*>(target))(v); },
+                          std::make_shared<C>(std::move(handler)));
+        }
+    }
+
+    /**
+     * @brief Suspend the machine after the instruction being executed, until the result is ready.
+     *
+     * Called by the interrupts starting something asynchronous, the run stops with run_status::suspended
+     * and resume() places the result into r0 before continuing.
+     *
+     * @param pending The result the machine waits for.
+     */
+    void suspend(std::shared_ptr<pending_call> pending);
+
+    /**
+     * @brief Ask the run to stop, from any thread.
+     *
+     * The request is only looked at when the execution jumps backward or calls a function, so the straight
+     * line code pays nothing for it. The run then stops with run_status::cancelled, and can be continued with
+     * resume(). A request made while the machine is not running stops its next run or resumption, load()
+     * and clear_stop_request() drop it.
+     */
+    void request_stop();
+
+    /**
+     * @brief Drop the stop asked for by request_stop() and not yet seen by the run, from any thread.
+     */
+    void clear_stop_request();
+
+    /**
+     * @brief Stop the machine after the instruction being executed, with run_status::yielded.
+     *
+     * Called by the YIELD instruction, resume() continues with the next instruction.
+     */
+    void yield();
+
+    /**
+     * @brief Whether the instruction being executed asked the machine to stop after it.
+     *
+     * @return True once suspend() or yield() was called, until the run is continued.
+     */
+    bool stop_requested() const;
+
+    /**
+     * @brief Check if a memory address is valid.
+     *
+     * @param addr The address to check.
+     * @return True if the address is valid.
+     */
+    bool address_is_valid(word_t addr);
 
     /**
      * @brief Retrieve the implementation pointer.
@@ -248,11 +502,20 @@ public:
     }
 
     /**
-     * @brief Enable or disable debug mode.
+     * @brief Set the observer told about the instructions executed.
+     *
+     * Only used by the machines created with execution_policy::trace or execution_policy::debug.
+     *
+     * @param observer The observer, nullptr for none.
+     */
+    void set_observer(std::shared_ptr<vm_observer> observer);
+
+    /**
+     * @brief How the machine executes.
      *
-     * @param newDebug New debug state.
+     * @return The execution policy the machine was created with.
      */
-    void set_debug(bool newDebug);
+    execution_policy policy() const;
 
 #ifdef TICKS
     /**
@@ -263,17 +526,164 @@ public:
     void set_speed(uint64_t hertz);
 #endif
 
+    /**
+     * @brief Enable or disable the profiler.
+     *
+     * While profiling, a release machine counts and times every instruction, and follows the calls through
+     * the function table. The runs are slower (and the JIT tier is not used), but nothing is paid for the
+     * profiler when it is disabled (the default).
+     *
+     * @param profiling New profiling state.
+     */
+    void set_profiling(bool profiling);
+
+    /**
+     * @brief Write the report of the last profiled run: the opcodes with their counts and times, the
+     * functions with their inclusive and exclusive instruction counts, and the hottest addresses. What a
+     * run collected is kept until the next profiled run starts.
+     *
+     * @param out Receives the report.
+     */
+    void profile_report(std::ostream& out) const;
+
+    /**
+     * @brief Write the instruction counts of the last profiled run per call stack, in the collapsed
+     * format of the flamegraph tools (`main;f;g 123`).
+     *
+     * @param out Receives the stacks.
+     */
+    void profile_collapsed_stacks(std::ostream& out) const;
+
+    /**
+     * @brief Limit the number of instructions a run can execute.
+     *
+     * When the budget is exhausted the run stops with run_status::budget_exhausted, and can be
+     * continued with resume(). The JIT tier is not used while there is a budget, since the native
+     * code does not count its instructions.
+     *
+     * @param instructions The number of instructions per run, 0 for no limit (the default).
+     */
+    void set_instruction_budget(uint64_t instructions);
+
+    /**
+     * @brief The number of instructions the last run (or resumption) executed.
+     *
+     * @return The number of instructions, only counted when there is a budget or a clock speed.
+     */
+    uint64_t executed_instructions() const;
+
+    /**
+     * @brief Enable or disable running the pre-decoded code section.
+     *
+     * When enabled (the default) the code section is decoded once when loaded and the
+     * instructions are executed with their operands already resolved. The machines created
+     * with execution_policy::debug always interpret the bytecode.
+     *
+     * @param predecode New pre-decoding state.
+     */
+    void set_predecode(bool predecode);
+
+    /**
+     * @brief Enable or disable the JIT tier.
+     *
+     * When enabled, the script functions which are called or loop often enough are translated
+     * into native x86-64 code. The instructions the JIT cannot translate are executed by the
+     * interpreter. It builds on the pre-decoded code section, so it is only used by the release
+     * machines, and not when pre-decoding is disabled, and it does nothing where jit_supported() is false.
+     *
+     * @param jit New JIT state.
+     */
+    void set_jit(bool jit);
+
+    /**
+     * @brief Set how hot a function must get before the JIT translates it.
+     *
+     * @param threshold The number of calls and backward jumps into the function.
+     */
+    void set_jit_threshold(uint32_t threshold);
+
+    /**
+     * @brief The number of functions translated to native code during the last run.
+     *
+     * @return The number of translated functions.
+     */
+    size_t jit_translated_functions() const;
+
+    /**
+     * @brief Tells whether the JIT can generate native code on this platform.
+     *
+     * @return True on x86-64.
+     */
+    static bool jit_supported();
+
+    /**
+     * @brief Tells whether the memory can be surrounded by guard pages on this platform.
+     *
+     * @return True where anonymous memory mappings are available.
+     */
+    static bool guard_pages_supported();
+
+    /**
+     * @brief The size of the memory of the last run.
+     *
+     * @return The number of addressable bytes, the data segment, the application, the heap and the stack.
+     */
+    word_t memory_size() const;
+
+    /**
+     * @brief The address of the heap of the last run.
+     *
+     * @return The first address following the application, the heap is memory_config::heap_size bytes.
+     */
+    word_t heap_start() const;
+
+    /**
+     * @brief The address of the bottom of the stack of the last run.
+     *
+     * @return The address the stack grows upwards from.
+     */
+    word_t stack_start() const;
+
+    /**
+     * @brief Enable or disable the verification of the code section when it is loaded.
+     *
+     * When enabled (the default) the pre-decoded code section is verified, and the memory accesses
+     * proven to stay within the memory are executed without bounds checks. The accesses with an
+     * address computed at runtime are always checked.
+     *
+     * @param verify New verification state.
+     */
+    void set_verify(bool verify);
+
+    /**
+     * @brief The first problem the verifier found in the code section during the last run.
+     *
+     * @return The description of the problem, empty if the verification passed or did not run.
+     */
+    std::string verification_error() const;
+
+    /**
+     * @brief The number of memory operands the verifier proved safe during the last run.
+     *
+     * @return The number of memory operands executed without bounds checks.
+     */
+    size_t proven_safe_accesses() const;
+
     /**
      * @brief Retrieve all loaded functions from the VM.
      *
      * @return Vector of loaded_function objects.
      */
-    std::vector<loaded_function> functions() const;
+    const std::vector<loaded_function>& functions() const;
 
 private:
 
+    friend struct vm_impl;
+
+    void set_interrupt(uint8_t i, bool (*thunk)(void*, vm*), std::shared_ptr<void> target);
+
     std::shared_ptr<vm_impl> m_impl; /**< Internal implementation pointer */
-    bool m_debug = false; /**< Debug flag */
+    word_t* m_regs = nullptr; /**< The register file of m_impl, read and written by the handlers without a call */
     std::vector<loaded_function> m_functions; /**< Cached function table */
 };
 
@@ -2,13 +2,12 @@
 #include "vm.h"
 
 #include <exceptions.h>
-#ifdef TICKS
-#include <chrono>
-#include <thread>
-#endif
+#include <opcodes.h>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <type_traits>
 
 
 using namespace primal;
@@ -19,112 +18,825 @@ bool generic_panic(vm* v)
     return false;
 }
 
-std::array<vm_impl::executor, 256> vm_impl::opcode_runners = []()->std::array<vm_impl::executor, 256>{
-    std::array<vm_impl::executor, 256> arr;
-    primal::vm_impl::executor panic_handler = { &generic_panic };
-    arr.fill(panic_handler);
-    return arr;
-}();
-std::map<word_t, vm_impl::executor> vm_impl::interrupts;
+namespace
+{
 
-vm_impl::vm_impl() :  m_ip(m_r[250]), m_lbo(m_r[253]), sp(m_r[255])
+// the bytecode interpreter looks at the stop request of the machine only after these
+constexpr bool may_jump(uint8_t opcode)
 {
-    for(uint8_t i = 0; i<255; i++)
-    {
-        m_r[i].set_idx(i);
-    }
+#define PRIMAL_JUMP_CASE(name, code) if(opcode == code) return true;
+    PRIMAL_JUMP_OPCODE_LIST(PRIMAL_JUMP_CASE)
+#undef PRIMAL_JUMP_CASE
+    return false;
+}
+
 }
 
-vm_impl::~vm_impl()
+std::array<vm_impl::opcode_runner, 256> vm_impl::opcode_runners = []()->std::array<vm_impl::opcode_runner, 256>{
+    std::array<vm_impl::opcode_runner, 256> arr;
+    arr.fill(&generic_panic);
+    return arr;
+}();
+std::array<vm_impl::interrupt_entry, 256> vm_impl::builtin_interrupts;
+
+vm_impl::vm_impl(const memory_config& config, execution_policy policy) :  m_memory_config(config), m_policy(policy),
+    m_call_opcode(opcodes::CALL().bin()), m_calla_opcode(opcodes::CALLA().bin())
 {
-    std::fill(ms.get(), ms.get() + VM_MEM_SEGMENT_SIZE + app_size, 0xFF);
 }
 
-bool vm_impl::run(const std::vector<uint8_t> &app, vm* v)
+void vm_impl::load(const std::vector<uint8_t> &app, vm* v)
 {
-    // firstly set up the memory segment for this machine and initialize it to 0x00
+    // firstly lay out the memory: the data segment, the application, the heap, the foreign results and the stack
     app_size = static_cast<word_t>(app.size());
-    ms = std::make_unique<uint8_t[]>(static_cast<size_t>(app_size + VM_MEM_SEGMENT_SIZE));
-    std::fill(ms.get(), ms.get() + VM_MEM_SEGMENT_SIZE + app_size, 0x00);
+    word_t heap_size = std::max<word_t>(m_memory_config.heap_size, 0);
+    word_t results_size = std::max<word_t>(m_memory_config.ffi_result_size, 0);
+    word_t stack_size = std::max<word_t>(m_memory_config.stack_size, 0);
+    m_heap_start = (VM_MEM_SEGMENT_SIZE + app_size + word_size - 1) / word_size * word_size;
+    m_results_start = m_heap_start + heap_size;
+    m_results_size = results_size;
+    m_results_next = m_results_start;
+    m_pending = nullptr;
+    m_stop_request = false;
+    bool separate_stack = stack_size > 0;
+    bool guarded = separate_stack && m_memory_config.guard_pages && vm_memory::guards_supported();
+    word_t size = separate_stack || heap_size > 0 || results_size > 0 ? m_results_start + results_size + stack_size : VM_MEM_SEGMENT_SIZE + app_size;
+
+    // a new memory segment for this machine, initialized to 0x00
+    if(!ms.allocate(static_cast<size_t>(size), guarded))
+    {
+        panic("Cannot allocate the memory");
+    }
 
     // then copy over the data from app to the end of the memory segment
-    std::copy(app.begin(), app.end(), ms.get() + VM_MEM_SEGMENT_SIZE);
+    std::copy(app.begin(), app.end(), ms.data() + VM_MEM_SEGMENT_SIZE);
     // set the IP and SP to point to the correct location
     word_t ip = VM_MEM_SEGMENT_SIZE + PRIMAL_HEADER_SIZE; // will grow upwards, will skip .P10 and the stringtable loc entry
-    stack_offset = *reinterpret_cast<word_t*>(ms.get() + VM_MEM_SEGMENT_SIZE + 4 + sizeof(word_t));
-    sp = stack_offset * word_size;   // will grow upwards
+    stack_offset = *reinterpret_cast<word_t*>(ms.data() + VM_MEM_SEGMENT_SIZE + 4 + sizeof(word_t));
+    if(separate_stack)
+    {
+        // the stack takes what the rounding up to the guard pages added, so it ends right at the guard page
+        m_stack_start = m_results_start + results_size;
+        m_stack_end = static_cast<word_t>(ms.size());
+    }
+    else
+    {
+        m_stack_start = stack_offset * word_size;
+        m_stack_end = VM_MEM_SEGMENT_SIZE;
+    }
+    reg_sp() = m_stack_start;   // will grow upwards
+    max_used_sp = m_stack_start;
 
     // set the size of the memory into reg 251
     m_r[251] = VM_MEM_SEGMENT_SIZE;
-    m_r[252] = sp;
+    m_r[252] = reg_sp();
     m_r[250] = ip;
 
+    // the code section is decoded once, resume() continues with the same program
+    load_program(v);
+    if(m_profiling)
+    {
+        m_profiler.reset(v->m_functions, VM_MEM_SEGMENT_SIZE, app_size);
+    }
+    m_status = run_status::ready;
+}
+
+void vm_impl::load_program(vm* v)
+{
+    word_t mem_size = static_cast<word_t>(ms.size());
+    m_current = nullptr;
+
+    // the code section ends where the string table starts
+    word_t code_end = VM_MEM_SEGMENT_SIZE + htovm(*reinterpret_cast<word_t*>(ms.data() + VM_MEM_SEGMENT_SIZE + 4 + 2 * sizeof(word_t)));
+    m_decoded = m_predecode && decode_program(ms.data(), mem_size, reg_ip(), code_end, m_program);
+    if(!m_decoded)
+    {
+        // nothing of the program of a previous run may be used
+        m_program = decoded_program();
+        m_verification = verification();
+        return;
+    }
+
+    // the verifier marks the memory operands which need no bounds checks
+    m_verification = m_verify ? verify_program(m_program, mem_size) : verification();
+    specialize(m_program, m_policy == execution_policy::release);
+    if(m_jit_enabled)
+    {
+        m_jit.reset(m_program, v->m_functions, mem_size, &m_stop_request);
+    }
+}
+
+bool vm_impl::execute(vm* v)
+{
+    // the handlers return false on error, and only panics are expected to leave them
+    try
+    {
+        m_stop_requested = false;
+        // a panic leaves the instruction it was raised in behind, fetch() must not take its operands
+        m_current = nullptr;
+        bool result = dispatch(v);
+        m_status = result ? run_status::finished : m_stop_requested ? m_stop_reason : run_status::budget_exhausted;
+        return result;
+    }
+    catch (const primal::vm_panic&)
+    {
+        throw; // Re-throw panic to be caught by the main executable.
+    }
+    catch(...)
+    {
+        // Catch any other unexpected C++ exceptions.
+        panic("Generic exception");
+    }
+}
+
+bool vm_impl::resume(vm* v)
+{
+    if(m_status == run_status::finished)
+    {
+        return true;
+    }
+
+    if(m_status == run_status::suspended && m_pending)
+    {
+        // the call instruction already ran, only its result is missing
+        std::shared_ptr<pending_call> pending = std::move(m_pending);
+        try
+        {
+            store_foreign_result(pending->get());
+        }
+        catch(const primal::vm_panic&)
+        {
+            throw;
+        }
+        catch(const std::exception& e)
+        {
+            panic(e.what());
+        }
+    }
+    return execute(v);
+}
+
+run_status vm_impl::run_for(vm* v, uint64_t instructions)
+{
+    if(instructions == 0)
+    {
+        return m_status;
+    }
+
+    // the slice replaces the budget of the machine for this once
+    uint64_t budget = m_meter.budget();
+    m_meter.set_budget(instructions);
+    try
+    {
+        resume(v);
+    }
+    catch(...)
+    {
+        m_meter.set_budget(budget);
+        throw;
+    }
+    m_meter.set_budget(budget);
+    return m_status;
+}
+
+run_status vm_impl::run_until(vm* v, std::chrono::steady_clock::time_point deadline)
+{
+    m_meter.set_deadline(deadline);
+    try
+    {
+        resume(v);
+    }
+    catch(...)
+    {
+        m_meter.clear_deadline();
+        throw;
+    }
+    m_meter.clear_deadline();
+    return m_status;
+}
+
+std::shared_ptr<const vm_snapshot> vm_impl::take_snapshot(const vm* v) const
+{
+    if(!ms.data())
+    {
+        return nullptr;
+    }
+
+    auto s = std::make_shared<vm_snapshot>(ms);
+    s->guarded = ms.guarded();
+    std::copy(std::begin(m_r), std::end(m_r), std::begin(s->registers));
+    s->app_size = app_size;
+    s->stack_offset = stack_offset;
+    s->heap_start = m_heap_start;
+    s->results_start = m_results_start;
+    s->results_size = m_results_size;
+    s->results_next = m_results_next;
+    s->stack_start = m_stack_start;
+    s->stack_end = m_stack_end;
+    s->max_used_sp = max_used_sp;
+    s->functions = v->m_functions;
+    s->decoded = m_decoded;
+    if(m_decoded)
+    {
+        s->program = m_program;
+        s->verified = m_verification;
+    }
+    return s;
+}
+
+word_t vm_impl::store_foreign_string(std::string_view s)
+{
+    // the strings of the VM have a one byte length prefix
+    if(s.size() > 255)
+    {
+        panic("FFI string return value is too long (max 255 characters).");
+    }
+
+    // the area is the one of the memory layout, a forked machine has the one of its snapshot
+    word_t needed = static_cast<word_t>(s.size()) + 1;
+    word_t at = STRING_RESULT_INDEX_IN_MEM;
+    if(m_results_size > 0)
+    {
+        if(needed > m_results_size)
+        {
+            panic("FFI string return value does not fit in the result area.");
+        }
+        if(m_results_next + needed > m_results_start + m_results_size)
+        {
+            m_results_next = m_results_start;
+        }
+        at = m_results_next;
+        m_results_next += needed;
+    }
+
+    uint8_t* dest = mem_at(at, needed);
+    dest[0] = static_cast<uint8_t>(s.size());
+    std::memcpy(dest + 1, s.data(), s.size());
+    return at;
+}
 
+void vm_impl::store_foreign_result(const script_value& result)
+{
+    if(std::holds_alternative<word_t>(result))
+    {
+        m_r[0] = std::get<word_t>(result);
+    }
+    else if(std::holds_alternative<std::string>(result))
+    {
+        m_r[0] = store_foreign_string(std::get<std::string>(result));
+    }
+    else
+    {
+        m_r[0] = 0; // Convention for a successful void call.
+    }
+}
 
-#ifdef TICKS
-    using namespace std::chrono;
-    nanoseconds time_per_instruction(0);
-    if (m_clock_speed > 0) {
-        time_per_instruction = nanoseconds(1'000'000'000 / m_clock_speed);
+void vm_impl::link_functions(const std::vector<loaded_function>& functions)
+{
+    // the compiler numbers the extern functions the same way, in the order of the function table
+    m_natives.clear();
+    for(const auto& f : functions)
+    {
+        if(f.is_extern)
+        {
+            m_natives.push_back(function_registry::instance().link(f.name));
+        }
     }
-    auto last_tick_time = high_resolution_clock::now();
+}
+
+bool vm_impl::call_native(word_t index, vm* v)
+{
+    if(index < 0 || index >= static_cast<word_t>(m_natives.size()))
+    {
+        panic(("Unknown extern function called: " + std::to_string(index)).c_str());
+    }
+    size_t slot = m_natives[static_cast<size_t>(index)];
+
+    // the arguments are on the stack, each of them above its type and the number of them on the top, the
+    // strings are viewed where they are in the memory
+    word_t arg_count = pop();
+    m_ffi_args.resize(static_cast<size_t>(arg_count));
+    for(size_t i = m_ffi_args.size(); i-- > 0; )
+    {
+        // the last argument comes first
+        ffi_arg& arg = m_ffi_args[i];
+        arg.value = pop();
+        arg.is_string = static_cast<entity_type>(pop()) == entity_type::ET_STRING;
+        if(arg.is_string)
+        {
+            word_t str_len = *mem_at(arg.value, 1);
+            arg.text = std::string_view(reinterpret_cast<const char*>(mem_at(arg.value + 1, str_len)), static_cast<size_t>(str_len));
+        }
+        else
+        {
+            arg.text = std::string_view();
+        }
+    }
+
+    try
+    {
+        // an asynchronous function suspends the machine, the result goes into r0 when it is resumed
+        std::shared_ptr<pending_call> pending;
+        script_value result = function_registry::instance().call_linked(slot, m_ffi_args.data(), m_ffi_args.size(), &pending);
+        if(pending && !pending->ready())
+        {
+            v->suspend(std::move(pending));
+            return true;
+        }
+        if(pending)
+        {
+            result = pending->get();
+        }
+
+        // the strings are copied to the result area of the memory (see memory_config::ffi_result_size)
+        store_foreign_result(result);
+    }
+    catch(const vm_panic&)
+    {
+        throw;
+    }
+    catch(const std::exception& e)
+    {
+        panic(e.what());
+    }
+
+    return true;
+}
+
+void vm_impl::fork_from(const vm_snapshot& s, vm* v)
+{
+    // the pages of the snapshot are only copied when they are written
+    if(!ms.map(s.image, s.guarded))
+    {
+        panic("Cannot map the snapshot");
+    }
+
+    std::copy(std::begin(s.registers), std::end(s.registers), std::begin(m_r));
+    app_size = s.app_size;
+    stack_offset = s.stack_offset;
+    m_heap_start = s.heap_start;
+    m_results_start = s.results_start;
+    m_results_size = s.results_size;
+    m_results_next = s.results_next;
+    m_stack_start = s.stack_start;
+    m_stack_end = s.stack_end;
+    max_used_sp = s.max_used_sp;
+    v->m_functions = s.functions;
+    link_functions(v->m_functions);
+
+    // nothing of a previous run is carried over, like when an application is loaded
+    m_current = nullptr;
+    m_pending = nullptr;
+    m_stop_request = false;
+    m_decoded = s.decoded;
+    m_program = s.decoded ? s.program : decoded_program();
+    m_verification = s.decoded ? s.verified : verification();
+    if(m_decoded)
+    {
+        // the snapshot may come from a machine with another policy
+        specialize(m_program, m_policy == execution_policy::release);
+    }
+    if(m_decoded && m_jit_enabled)
+    {
+        m_jit.reset(m_program, v->m_functions, static_cast<word_t>(ms.size()), &m_stop_request);
+    }
+
+    if(m_profiling)
+    {
+        m_profiler.reset(v->m_functions, VM_MEM_SEGMENT_SIZE, app_size);
+    }
+
+    m_status = run_status::ready;
+}
+
+bool vm_impl::dispatch(vm* v)
+{
+    // the policy is checked once per run, the release loops below have nothing to do with the observers
+    if(m_policy == execution_policy::trace)
+    {
+        return run_observed<trace_policy>(v);
+    }
+    if(m_policy == execution_policy::debug)
+    {
+        return run_observed<debug_policy>(v);
+    }
+
+    if(m_profiling)
+    {
+        return run_profiled(v);
+    }
+
+    // the metered loop is only chosen when there is something to meter, the others do not count
+    if(m_meter.enabled())
+    {
+        return run_metered(v);
+    }
+
+    if(!m_decoded)
+    {
+        return run_threaded(v);
+    }
+    return m_jit_enabled ? run_jit(v) : run_predecoded(v);
+}
+
+bool vm_impl::run_threaded(vm *v)
+{
+#if defined(PRIMAL_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+
+    // Every opcode gets its own label, and every handler jumps straight to the next one
+    void* dispatch_table[256];
+    std::fill(std::begin(dispatch_table), std::end(dispatch_table), &&op_invalid);
+
+#define PRIMAL_DISPATCH_ENTRY(name, code) dispatch_table[code] = &&op_##name;
+    PRIMAL_OPCODE_LIST(PRIMAL_DISPATCH_ENTRY)
+#undef PRIMAL_DISPATCH_ENTRY
+
+    // This is the primary condition for gracefully terminating the program.
+    dispatch_table[0xFF] = &&op_exit;
+
+#define PRIMAL_DISPATCH() goto *dispatch_table[ms[static_cast<size_t>(reg_ip()++)]]
+
+    PRIMAL_DISPATCH();
+
+#define PRIMAL_DISPATCH_HANDLER(name, code) \
+    op_##name: \
+        if(!impl_##name(v)) { stop_or_panic(); return false; } \
+        if constexpr(may_jump(code)) { if(take_stop_request()) return false; } \
+        PRIMAL_DISPATCH();
+
+    PRIMAL_OPCODE_LIST(PRIMAL_DISPATCH_HANDLER)
+#undef PRIMAL_DISPATCH_HANDLER
+#undef PRIMAL_DISPATCH
+
+op_invalid:
+    panic("No opcode executor");
+
+op_exit:
+    return true;
+
+#else
+
+    while(true)
+    {
+        switch(ms[static_cast<size_t>(reg_ip()++)])
+        {
+#define PRIMAL_DISPATCH_CASE(name, code) \
+        case code: \
+            if(!impl_##name(v)) { stop_or_panic(); return false; } \
+            if constexpr(may_jump(code)) { if(take_stop_request()) return false; } \
+            break;
+
+        PRIMAL_OPCODE_LIST(PRIMAL_DISPATCH_CASE)
+#undef PRIMAL_DISPATCH_CASE
+
+        case 0xFF:
+            return true; // Graceful program exit.
+
+        default:
+            panic("No opcode executor");
+        }
+    }
+
 #endif
+}
+
+bool vm_impl::run_predecoded(vm *v)
+{
+    const decoded_instruction* instructions = m_program.instructions.data();
+    int32_t pc = m_program.index(reg_ip());
 
-    // then start running it
-    while (true)
+    while(pc >= 0)
     {
-        if(m_debug)
+        const decoded_instruction& ins = instructions[pc];
+        if(!ins.handler)
         {
-            bindump("VM STATE", -1, -1, true);
+            if(ins.opcode == 0xFF)
+            {
+                reg_ip() = ins.next;
+                return true; // Graceful program exit.
+            }
+            break; // ran out of the code section
         }
 
-        uint8_t opc = ms[static_cast<size_t>(m_ip++)];
+        pc = execute_decoded(v, ins, pc);
+    }
+
+    if(pc == stopped_pc)
+    {
+        return false; // the IP is left on the next instruction
+    }
+
+    // somewhere we did not decode, the bytecode interpreter takes it from here
+    return run_threaded(v);
+}
 
-        // This is the primary condition for gracefully terminating the program.
-        if (opc == 0xFF) {
-            if(m_debug)
+bool vm_impl::run_metered(vm *v)
+{
+    const decoded_instruction* instructions = m_program.instructions.data();
+    int32_t pc = m_program.index(reg_ip());
+    m_meter.start();
+
+    while(true)
+    {
+        uint64_t batch = m_meter.next_batch();
+        if(batch == 0)
+        {
+            return false; // the budget is exhausted, the IP is left on the next instruction
+        }
+
+        for(uint64_t left = batch; left > 0; left--)
+        {
+            if(pc == -1)
             {
-                bindump("FINAL VM STATE", -1, -1, true);
+                // not decoded, this one instruction comes straight from the bytecode
+                word_t address = reg_ip();
+                uint8_t opc = ms[static_cast<size_t>(reg_ip()++)];
+                if(opc == 0xFF)
+                {
+                    m_meter.account(batch - left);
+                    return true; // Graceful program exit.
+                }
+                bool stopped = !opcode_runners[opc](v);
+                if(stopped)
+                {
+                    stop_or_panic();
+                }
+                else
+                {
+                    stopped = polls_stop(address, reg_ip(), opc) && take_stop_request();
+                }
+                if(stopped)
+                {
+                    m_meter.account(batch - left + 1);
+                    return false; // the IP is left on the next instruction
+                }
+                pc = m_program.index(reg_ip());
+                continue;
+            }
+
+            const decoded_instruction& ins = instructions[pc];
+            if(!ins.handler)
+            {
+                if(ins.opcode == 0xFF)
+                {
+                    reg_ip() = ins.next;
+                    m_meter.account(batch - left);
+                    return true; // Graceful program exit.
+                }
+                pc = -1; // ran out of the code section, the bytecode says what comes next
+                left++;
+                continue;
+            }
+
+            pc = execute_decoded(v, ins, pc);
+            if(pc == stopped_pc)
+            {
+                m_meter.account(batch - left + 1);
+                return false; // the IP is left on the next instruction
             }
-            return true; // Graceful program exit.
         }
 
-        const auto& exec = opcode_runners[opc];
+        m_meter.account(batch);
+    }
+}
+
+bool vm_impl::run_profiled(vm *v)
+{
+    const decoded_instruction* instructions = m_program.instructions.data();
+    int32_t pc = m_program.index(reg_ip());
+    m_meter.start();
 
-        try
+    while(true)
+    {
+        if(m_meter.enabled() && m_meter.next_batch() == 0)
         {
-            if (!exec.runner(v))
+            return false; // the budget is exhausted, the IP is left on the next instruction
+        }
+
+        word_t address = reg_ip();
+        uint8_t opc = 0;
+        if(pc == -1)
+        {
+            // not decoded, this one instruction comes straight from the bytecode
+            opc = ms[static_cast<size_t>(reg_ip()++)];
+            if(opc == 0xFF)
+            {
+                return true; // Graceful program exit.
+            }
+            m_profiler.enter(address, opc);
+            if(!opcode_runners[opc](v))
+            {
+                stop_or_panic();
+                pc = stopped_pc;
+            }
+            else if(polls_stop(address, reg_ip(), opc) && take_stop_request())
             {
-                // The handler function returns false on error.
-                panic("Exc failed");
+                pc = stopped_pc;
+            }
+            else
+            {
+                pc = m_program.index(reg_ip());
             }
         }
-        catch (const primal::vm_panic&)
+        else
         {
-            throw; // Re-throw panic to be caught by the main executable.
+            const decoded_instruction& ins = instructions[pc];
+            if(!ins.handler)
+            {
+                if(ins.opcode == 0xFF)
+                {
+                    reg_ip() = ins.next;
+                    return true; // Graceful program exit.
+                }
+                pc = -1; // ran out of the code section, the bytecode says what comes next
+                continue;
+            }
+            opc = ins.opcode;
+            m_profiler.enter(address, opc);
+            pc = execute_decoded(v, ins, pc);
         }
-        catch(...)
+        m_profiler.leave(opc, reg_ip());
+
+        if(m_meter.enabled())
+        {
+            m_meter.account(1);
+        }
+        if(pc == stopped_pc)
+        {
+            return false; // the IP is left on the next instruction
+        }
+    }
+}
+
+bool vm_impl::run_jit(vm *v)
+{
+    const decoded_instruction* instructions = m_program.instructions.data();
+    const uint8_t call = opcodes::CALL().bin();
+    const uint8_t calla = opcodes::CALLA().bin();
+    int32_t pc = m_program.index(reg_ip());
+    bool left_native = false;
+
+    while(pc != -1)
+    {
+        // the native code runs until it gets to something it cannot do, and tells where to continue from,
+        // that instruction is interpreted even if it has native code, a failed bounds check leaves at itself
+        auto native = left_native ? nullptr : m_jit.entry(pc);
+        left_native = false;
+        if(native)
         {
-            // Catch any other unexpected C++ exceptions.
-            panic("Generic exception");
+            reg_ip() = native(m_r, ms.data());
+            if(take_stop_request())
+            {
+                return false; // the native code left at a backward jump to let the stop be seen
+            }
+            pc = m_program.index(reg_ip());
+            left_native = true;
+            continue;
         }
 
-#ifdef TICKS
-        if (m_clock_speed > 0)
+        const decoded_instruction& ins = instructions[pc];
+        if(!ins.handler)
         {
-            auto time_since_last_tick = high_resolution_clock::now() - last_tick_time;
-            if (time_since_last_tick < time_per_instruction)
+            if(ins.opcode == 0xFF)
             {
-                std::this_thread::sleep_for(time_per_instruction - time_since_last_tick);
+                reg_ip() = ins.next;
+                return true; // Graceful program exit.
             }
-            last_tick_time = high_resolution_clock::now();
+            break; // ran out of the code section
+        }
+
+        m_current = &ins;
+        m_operand = 0;
+        reg_ip() = ins.next;
+
+        if(!ins.handler(v))
+        {
+            m_current = nullptr;
+            stop_or_panic();
+            return false; // the IP is left on the next instruction
+        }
+        m_current = nullptr;
+
+        word_t ip = reg_ip();
+        int32_t next = -1;
+        if(ip == ins.next)
+        {
+            next = pc + 1;
+        }
+        else if(ip == ins.target)
+        {
+            next = ins.target_index;
+        }
+        else
+        {
+            next = m_program.index(ip);
+        }
+
+        if(polls_stop(ins.address, ip, ins.opcode) && take_stop_request())
+        {
+            return false; // the IP is left on the next instruction
         }
-#endif
 
+        // calls and loops make the function they land in hotter
+        if(next != -1 && (next <= pc || ins.opcode == call || ins.opcode == calla))
+        {
+            m_jit.tick(next);
+        }
+        pc = next;
     }
 
-    // theoretically we never should end up here, so let's just panic
-    panic("Run out of bytecode");
+    // somewhere we did not decode, the bytecode interpreter takes it from here
+    return run_threaded(v);
+}
+
+template<class POLICY>
+bool vm_impl::run_observed(vm *v)
+{
+    const decoded_instruction* instructions = m_program.instructions.data();
+    int32_t pc = POLICY::decoded && m_decoded ? m_program.index(reg_ip()) : -1;
+    m_meter.start();
+    if(m_observer)
+    {
+        m_observer->started(*v);
+    }
+
+    while(true)
+    {
+        if(m_meter.enabled() && m_meter.next_batch() == 0)
+        {
+            return false; // the budget is exhausted, the IP is left on the next instruction
+        }
+
+        word_t address = reg_ip();
+        uint8_t opc = 0;
+        if(pc == -1)
+        {
+            opc = ms[static_cast<size_t>(address)];
+            if(m_observer)
+            {
+                m_observer->before(*v, address, opc);
+            }
+            reg_ip() ++;
+
+            // This is the primary condition for gracefully terminating the program.
+            if(opc == 0xFF)
+            {
+                break;
+            }
+            if(!opcode_runners[opc](v))
+            {
+                // The handler function returns false on error, or when the machine should stop after it.
+                stop_or_panic();
+                pc = stopped_pc;
+            }
+            else if(polls_stop(address, reg_ip(), opc) && take_stop_request())
+            {
+                pc = stopped_pc;
+            }
+            else
+            {
+                pc = POLICY::decoded && m_decoded ? m_program.index(reg_ip()) : -1;
+            }
+        }
+        else
+        {
+            const decoded_instruction& ins = instructions[pc];
+            if(!ins.handler && ins.opcode != 0xFF)
+            {
+                pc = -1; // ran out of the code section, the bytecode says what comes next
+                continue;
+            }
+            opc = ins.opcode;
+            if(m_observer)
+            {
+                m_observer->before(*v, address, opc);
+            }
+            if(!ins.handler)
+            {
+                reg_ip() = ins.next;
+                break;
+            }
+            pc = execute_decoded(v, ins, pc);
+        }
+
+        if(m_observer)
+        {
+            m_observer->after(*v, address, opc);
+        }
+        if(m_meter.enabled())
+        {
+            m_meter.account(1);
+        }
+        if(pc == stopped_pc)
+        {
+            return false; // the IP is left on the next instruction
+        }
+    }
+
+    if(m_observer)
+    {
+        m_observer->finished(*v);
+    }
+    return true; // Graceful program exit.
 }
 const char* RED     = "\033[1;31m";
 const char* GREEN   = "\033[1;32m";
@@ -147,14 +859,12 @@ void vm_impl::panic(const char* reason)
     std::cout << RED <<    "!!! PRIMAL VM PANIC !!!\n\n" << RESET;
 
     std::cout << "[ " << reason << "]\n" << CYAN << "-= Instruction Dump =-\n" << RESET;
-    word_t start = std::max<word_t>(VM_MEM_SEGMENT_SIZE, m_ip |- 64);
-    word_t end = VM_MEM_SEGMENT_SIZE + m_ip + std::min<word_t>(64, app_size);
+    word_t start = std::max<word_t>(VM_MEM_SEGMENT_SIZE, reg_ip() |- 64);
+    word_t end = VM_MEM_SEGMENT_SIZE + reg_ip() + std::min<word_t>(64, app_size);
     bindump("PANIC", start, end, true);
 
     std::cout << CYAN << "\n-= Memory Dump =--\n" << RESET;
-    memdump(m_ip - 10, m_ip + 10, m_ip);
-
-    getchar();
+    memdump(reg_ip() - 10, reg_ip() + 10, reg_ip());
 
     throw primal::vm_panic(reason);
 }
@@ -173,7 +883,7 @@ void vm_impl::memdump(word_t start, word_t end, word_t mark, bool insert_addr)
             ss << std::setfill(' ') << std::setw(9) << std::dec << std::right <<  i << "[:" << std::setw(3) << i - VM_MEM_SEGMENT_SIZE << "]";
             insert_addr = false;
         }
-        if(i == m_ip)
+        if(i == reg_ip())
         {
             ss << ">";
         }
@@ -208,7 +918,7 @@ void vm_impl::memdump(word_t start, word_t end, word_t mark, bool insert_addr)
         {
             ss << " ";
         }
-        if(i == m_ip)
+        if(i == reg_ip())
         {
             ss << "<";
         }
@@ -234,7 +944,7 @@ void vm_impl::memdump(word_t start, word_t end, word_t mark, bool insert_addr)
 
 void vm_impl::bindump(const char *title, word_t start, word_t end, bool insert_addr)
 {
-    if(start == -1) start = VM_MEM_SEGMENT_SIZE; //std::max<word_t>(VM_MEM_SEGMENT_SIZE, m_ip - 64);
+    if(start == -1) start = VM_MEM_SEGMENT_SIZE; //std::max<word_t>(VM_MEM_SEGMENT_SIZE, reg_ip() - 64);
     if(end == -1) end = VM_MEM_SEGMENT_SIZE + app_size;
 
     std::stringstream ss;
@@ -244,7 +954,7 @@ void vm_impl::bindump(const char *title, word_t start, word_t end, bool insert_a
         std::cout << "----" << title << "----" << std::endl;
     }
 
-    memdump(start, end, m_ip, true);
+    memdump(start, end, reg_ip(), true);
 
     std::cout << CYAN << "-= VM Address  / Value =-" << RESET << std::endl;
 
@@ -255,15 +965,16 @@ void vm_impl::bindump(const char *title, word_t start, word_t end, bool insert_a
         ss << get_mem(i) << std::endl;
     }
     ss << "STC" << RED << "↓" << RESET; // indicates the stack start
-    for(word_t i = stack_offset * word_size; i<max_used_sp + 4*word_size; i += word_size)
+    word_t stack_dump_end = std::min<word_t>(max_used_sp + 4*word_size, static_cast<word_t>(ms.size()) - word_size + 1);
+    for(word_t i = m_stack_start; i < stack_dump_end; i += word_size)
     {
-        if(i == sp.value())
+        if(i == reg_sp())
         {
             ss << RED << " SP→" << RESET; // current stack position
         }
         else
         {
-            if (i > stack_offset * word_size) ss << "    ";
+            if (i > m_stack_start) ss << "    ";
         }
 
         ss << std::right << "[" << std::setfill('0') << std::setw(8) << std::dec << i << "] = ";
@@ -276,23 +987,16 @@ void vm_impl::bindump(const char *title, word_t start, word_t end, bool insert_a
 
 
     std::cout << CYAN << "\n-= Registers =-" << RESET << std::endl;
-    std::cout << "IP=" << std::dec << m_ip.value() << "[:" << m_ip - VM_MEM_SEGMENT_SIZE << "] (" << std::hex << m_ip.value() << ")" << std::endl;
-    std::cout << "SP=" << std::dec << sp.value() << " (" << std::hex << sp.value() << ")" << std::endl;
+    std::cout << "IP=" << std::dec << reg_ip() << "[:" << reg_ip() - VM_MEM_SEGMENT_SIZE << "] (" << std::hex << reg_ip() << ")" << std::endl;
+    std::cout << "SP=" << std::dec << reg_sp() << " (" << std::hex << reg_sp() << ")" << std::endl;
     std::cout << std::endl;
 
 
 }
 
-reg_subbyte* vm_impl::rsb(uint8_t ridx, uint8_t bidx)
-{
-    t1.m_r = &m_r[ridx];
-    t1.m_bidx = bidx;
-    return &t1;
-}
-
 void vm_impl::set_mem(word_t address, word_t new_value)
 {
-    if(address > VM_MEM_SEGMENT_SIZE + app_size || address < 0)
+    if(address < 0 || address + word_size > static_cast<word_t>(ms.size()))
     {
         panic(std::string("Memory overflow/underflow error. Invalid set at:" + std::to_string(address)).c_str() );
     }
@@ -302,7 +1006,7 @@ void vm_impl::set_mem(word_t address, word_t new_value)
 
 word_t vm_impl::get_mem(word_t address)
 {
-    if(address > VM_MEM_SEGMENT_SIZE + app_size || address < 0)
+    if(address < 0 || address + word_size > static_cast<word_t>(ms.size()))
     {
         panic(std::string("Memory overflow/underflow error. Invalid get at:" + std::to_string(address)).c_str() );
     }
@@ -314,7 +1018,7 @@ word_t vm_impl::get_mem(word_t address)
 
 void vm_impl::set_mem_byte(word_t address, uint8_t b)
 {
-    if(address > VM_MEM_SEGMENT_SIZE + app_size || address < 0)
+    if(address < 0 || address >= static_cast<word_t>(ms.size()))
     {
         panic(std::string("Memory overflow/underflow error. Invalid set byte at:" + std::to_string(address)).c_str() );
     }
@@ -323,100 +1027,58 @@ void vm_impl::set_mem_byte(word_t address, uint8_t b)
 
 uint8_t vm_impl::get_mem_byte(word_t address)
 {
-    if(address > VM_MEM_SEGMENT_SIZE + app_size || address < 0)
+    if(address < 0 || address >= static_cast<word_t>(ms.size()))
     {
         panic(std::string("Memory overflow/underflow error. Invalid get byte at:" + std::to_string(address)).c_str() );
     }
     return ms[static_cast<size_t>(address)];
 }
 
-memaddress* vm_impl::mem(word_t address)
+uint8_t* vm_impl::mem_at(word_t address, word_t width)
 {
-    auto setter = [&](word_t a, word_t v) -> void
+    if(address < 0 || address + width > static_cast<word_t>(ms.size()))
     {
-        set_mem(a,v);
-    };
-    auto getter = [&](word_t a) -> word_t
-    {
-        return get_mem(a);
-    };
-
-    ma_i = !ma_i;
-    ma[ma_i].m_address = address;
-    ma[ma_i].m_setter = setter;
-    ma[ma_i].m_getter = getter;
-    return &ma[ma_i];
+        panic(std::string("Memory overflow/underflow error. Invalid access at:" + std::to_string(address)).c_str() );
+    }
+    return &ms[static_cast<size_t>(address)];
 }
 
-memaddress_byte_ref* vm_impl::mem_byte(word_t address)
+operand vm_impl::fetch()
 {
-    auto setter = [&](word_t a, uint8_t v) -> void
+    if(m_current)
     {
-        set_mem_byte(a,v);
-    };
-    auto getter = [&](word_t a) -> uint8_t
-    {
-        return get_mem_byte(a);
-    };
-
-    mb_i = !mb_i;
-    mb[mb_i].m_address = address;
-    mb[mb_i].m_setter = setter;
-    mb[mb_i].m_getter = getter;
-    return &mb[mb_i];
-}
-
-
-immediate *vm_impl::imm(word_t v)
-{
-    mi_i++; if(mi_i == 3) mi_i = 0;
-
-    imv[mi_i].m_value = v;
-    return &imv[mi_i];
-}
-
-
-type_destination vm_impl::fetch_type_dest()
-{
-    return static_cast<type_destination>(ms[static_cast<size_t>(m_ip ++)]) ;
-}
-
-
-uint8_t vm_impl::fetch_register_index()
-{
-    return ms[static_cast<size_t>(m_ip ++)];
-}
+        return resolve(m_current->operands[m_operand++]);
+    }
 
-word_t vm_impl::fetch_immediate()
-{
-    word_t retv = htovm(*(reinterpret_cast<word_t*>(ms.get() + m_ip)));
-    m_ip += word_size;
-    return retv;
-}
+    decoded_operand o;
+    word_t at = reg_ip();
+    if(!decode_operand(ms.data(), static_cast<word_t>(ms.size()), at, o))
+    {
+        auto dst = static_cast<type_destination>(ms[static_cast<size_t>(reg_ip())]);
+        if(dst == type_destination::TYPE_MOD_UNKNOWN)
+        {
+            panic("Cannot fetch an unknow TD");
+        }
+        panic(std::string("Unimplemented operation:" + to_string(dst)).c_str() );
+    }
+    reg_ip() = at;
 
-uint8_t vm_impl::fetch_byte()
-{
-    return ms[static_cast<size_t>(m_ip ++)];
+    return resolve(o);
 }
 
-valued *vm_impl::fetch()
+operand vm_impl::resolve(const decoded_operand &o)
 {
-    auto dst = fetch_type_dest();
-    switch(dst)
-    {
-    case type_destination::TYPE_MOD_IMM_BYTE:
+    switch(o.type)
     {
-        return imm(fetch_byte());
-    }
+    case type_destination::TYPE_MOD_IMM_BYTE:   // [[fallthrough]]
     case type_destination::TYPE_MOD_IMM:
     {
-        return imm(fetch_immediate());
+        return operand::of_immediate(o.imm);
     }
 
     case type_destination::TYPE_MOD_REG_BYTE:
     {
-        uint8_t ridx = fetch_register_index();
-        return rsb(ridx, 0);
+        return operand::of_reg_byte(m_r[o.ridx], 0);
     }
 
     case type_destination::TYPE_MOD_REG_BYTE0:  // [[fallthrough]]
@@ -430,88 +1092,74 @@ valued *vm_impl::fetch()
     case type_destination::TYPE_MOD_REG_BYTE7:
 #endif
     {
-        uint8_t ridx = fetch_register_index();
-        return rsb(ridx, static_cast<uint8_t>(dst) - static_cast<uint8_t>(type_destination::TYPE_MOD_REG_BYTE0));
+        return operand::of_reg_byte(m_r[o.ridx], static_cast<uint8_t>(o.type) - static_cast<uint8_t>(type_destination::TYPE_MOD_REG_BYTE0));
     }
 
         // are we moving something into a register?
     case type_destination::TYPE_MOD_REG:
     {
-        uint8_t ridx = fetch_register_index();
-        return &(m_r[ridx]);
+        return operand::of_reg(m_r[o.ridx]);
     }
 
         // are we moving something into an immediate memory address?
     case type_destination::TYPE_MOD_MEM_IMM:
     {
-        word_t vaddr = fetch_immediate();
-        return mem(vaddr);
+        return operand::of_mem(mem_at(o, word_size));
     }
 
     case type_destination::TYPE_MOD_MEM_REG_IDX:
     {
-        uint8_t ridx = fetch_register_index();
-        return mem(m_r[ridx].value());
+        return operand::of_mem(mem_at(m_r[o.ridx], word_size));
     }
 
     case type_destination::TYPE_MOD_MEM_REG_BYTE:
     {
-        uint8_t ridx = fetch_register_index();
-        return mem_byte(m_r[ridx].value());
+        return operand::of_mem_byte(mem_at(m_r[o.ridx], 1));
     }
 
     case type_destination::TYPE_MOD_MEM_IMM_BYTE:
     {
-        word_t vaddr = fetch_immediate();
-        return mem_byte(vaddr);
+        return operand::of_mem_byte(mem_at(o, 1));
     }
 
     case type_destination::TYPE_MOD_MEM_REG_IDX_OFFS:
     {
-        uint8_t ridx = fetch_register_index();
-        uint8_t op = fetch_byte();
-
-        word_t vaddr = fetch_immediate();
-
-        if(op == '+')
+        if(o.op == '+')
         {
-            return mem_byte(m_r[ridx].value() + vaddr);
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] + o.imm, 1));
         }
-        else if(op == '-')
+        else if(o.op == '-')
         {
-            return mem_byte(m_r[ridx].value() - vaddr);
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] - o.imm, 1));
         }
-        else if(op == '*')
+        else if(o.op == '*')
         {
-            return mem_byte(m_r[ridx].value() * vaddr);
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] * o.imm, 1));
         }
-        else if(op == '/')
+        else if(o.op == '/')
         {
-            return mem_byte(m_r[ridx].value() / vaddr);
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] / o.imm, 1));
         }
         break;
     }
 
     case type_destination::TYPE_MOD_MEM_REG_IDX_REG_OFFS:
     {
-        uint8_t ridx = fetch_register_index();
-        uint8_t op = fetch_byte();
-        uint8_t ridx2 = fetch_register_index();
-        if(op == '+')
+        if(o.op == '+')
         {
-            return mem_byte( m_r[ridx].value() + m_r[ridx2].value() );
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] + m_r[o.ridx2], 1));
         }
-        else if(op == '-')
+        else if(o.op == '-')
         {
-            return mem_byte( m_r[ridx].value() - m_r[ridx2].value() );
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] - m_r[o.ridx2], 1));
         }
-        else if(op == '*')
+        else if(o.op == '*')
         {
-            return mem_byte( m_r[ridx].value() * m_r[ridx2].value() );
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] * m_r[o.ridx2], 1));
         }
-        else if(op == '/')
+        else if(o.op == '/')
         {
-            return mem_byte( m_r[ridx].value() / m_r[ridx2].value() );
+            return operand::of_mem_byte(mem_at(m_r[o.ridx] / m_r[o.ridx2], 1));
         }
         break;
     }
@@ -522,11 +1170,11 @@ valued *vm_impl::fetch()
     }
     }
 
-    panic(std::string("Unimplemented operation:" + to_string(dst)).c_str() );
+    panic(std::string("Unimplemented operation:" + to_string(o.type)).c_str() );
 
 }
 
-// Peek functions – do NOT modify m_ip, take a local ip instead
+// Peek functions – do NOT modify reg_ip(), take a local ip instead
 type_destination vm_impl::peek_type_dest(size_t& ip) const
 {
     return static_cast<type_destination>(ms[static_cast<size_t>(ip ++)]) ;
@@ -539,7 +1187,7 @@ uint8_t vm_impl::peek_register_index(size_t&ip) const
 
 word_t vm_impl::peek_immediate(size_t& ip) const
 {
-    word_t retv = htovm(*(reinterpret_cast<word_t*>(ms.get() + ip)));
+    word_t retv = htovm(*(reinterpret_cast<word_t*>(ms.data() + ip)));
     ip += word_size;
     return retv;
 }
@@ -567,7 +1215,7 @@ void vm_impl::peek(size_t&ip)
     {
         uint8_t ridx = peek_register_index(ip);
         const auto rdx = m_r[ridx];
-        std::cout << "REG_BYTE r" << unsigned(ridx) << " {" << rdx.debug() << "} " ;
+        std::cout << "REG_BYTE r" << unsigned(ridx) << " {" << rdx << "} " ;
         break;
     }
 
@@ -592,7 +1240,7 @@ void vm_impl::peek(size_t&ip)
     {
         uint8_t ridx = peek_register_index(ip);
         const auto rdx = m_r[ridx];
-        std::cout << "REG $r" << std::dec << unsigned(ridx) << " {" << rdx.debug() << "} " ;
+        std::cout << "REG $r" << std::dec << unsigned(ridx) << " {" << rdx << "} " ;
         break;
     }
 
@@ -610,8 +1258,8 @@ void vm_impl::peek(size_t&ip)
         std::cout << "MEM[ $r" << std::dec << unsigned(ridx) << " ] ";
         const auto rdx = m_r[ridx];
 
-        std::cout << "REG $r" << std::dec << unsigned(ridx) << " {" << rdx.debug() << "} " ;
-        word_t vaddr = rdx.m_value;
+        std::cout << "REG $r" << std::dec << unsigned(ridx) << " {" << rdx << "} " ;
+        word_t vaddr = rdx;
         memdump(vaddr - 4,vaddr + 4, vaddr);
 
         break;
@@ -664,71 +1312,61 @@ void vm_impl::peek(size_t&ip)
 }
 
 
-word_t &vm_impl::ip()      {return m_ip.m_value;}
+word_t &vm_impl::ip()      {return reg_ip();}
 
-word_t vm_impl::ip() const {return m_ip;}
+word_t vm_impl::ip() const {return reg_ip();}
 
-word_t vm_impl::flag() const {return m_lbo.value();}
+word_t vm_impl::flag() const {return reg_flag();}
 
 bool vm_impl::push(const valued *v)
 {
     if(!v) return false;
 
-    // value
-    set_mem(sp.value(), v->value());
-    sp += word_size;
-    if(sp > max_used_sp) max_used_sp = sp.value();
-    if(sp.value() > VM_MEM_SEGMENT_SIZE)
+    return push(v->value());
+}
+
+bool vm_impl::push(const word_t v)
+{
+    // the scripts can set the stack pointer to anything, so it is always checked to be in the stack: one
+    // unsigned comparison, the guard page above the stack is only there for what escapes the checks
+    using uword_t = std::make_unsigned_t<word_t>;
+    if(m_stack_end - m_stack_start < word_size
+       || static_cast<uword_t>(reg_sp()) - static_cast<uword_t>(m_stack_start) > static_cast<uword_t>(m_stack_end - m_stack_start - word_size))
     {
         panic("Stack Overflow Error");
     }
+    std::memcpy(&ms[static_cast<size_t>(reg_sp())], &v, sizeof(v));
+    reg_sp() += word_size;
+    if(reg_sp() > max_used_sp) max_used_sp = reg_sp();
 
     return true;
 }
 
-bool vm_impl::push(const word_t v)
-{
-    immediate i(v);
-    return push(&i);
-}
 
 word_t vm_impl::pop()
 {
-    if(sp.value() - word_size < 0)
+    // the same unsigned comparison as push, the popped word has to be in the stack
+    using uword_t = std::make_unsigned_t<word_t>;
+    if(m_stack_end - m_stack_start < word_size
+       || static_cast<uword_t>(reg_sp()) - static_cast<uword_t>(m_stack_start) - word_size > static_cast<uword_t>(m_stack_end - m_stack_start - word_size))
     {
         panic("Stack Underflow Error");
     }
-    word_t v = get_mem(sp.value() - word_size);
-    sp -= word_size;
+    word_t v = 0;
+    std::memcpy(&v, mem_at(reg_sp() - word_size, word_size), sizeof(v));
+    reg_sp() -= word_size;
     return v;
 }
 
 bool vm_impl::copy(word_t dest, word_t src, word_t cnt)
 {
-    if(dest + cnt > VM_MEM_SEGMENT_SIZE || src < 0 || dest < 0)
+    // both blocks have to be in the memory, the heap included
+    word_t size = static_cast<word_t>(ms.size());
+    if(cnt < 0 || cnt > size || dest < 0 || src < 0 || dest > size - cnt || src > size - cnt)
     {
         return false;
     }
-    if(m_debug)
-    {
-        std::cout << "************************************" << std::endl;
-        std::cout << "COPY: src=" << src << " dest=" << dest << " cnt=" << cnt << std::endl;
-        memdump(src-4, src + cnt, src);
-        std::cout << "************************************" << std::endl;
-    }
-
-    std::memmove(&ms[static_cast<size_t>(dest)], &ms[static_cast<size_t>(src)], static_cast<size_t>(cnt));
-
-    if(m_debug)
-    {
-        std::cout << "************************************" << std::endl;
-        memdump(dest - 4, dest + 10 + cnt, dest);
-        std::cout << "************************************" << std::endl;
-    }
+    std::memmove(ms.data() + dest, ms.data() + src, static_cast<size_t>(cnt));
     return true;
 }
 
-void vm_impl::set_debug(bool newDebug)
-{
-    m_debug = newDebug;
-}
@@ -1,11 +1,19 @@
 #ifndef VM_IMPL_H
 #define VM_IMPL_H
 
-#include <functional>
-#include <map>
 #include <hal.h>
 #include <numeric_decl.h>
 #include <registers.h>
+#include <operand.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "verifier.h"
+#include "jit.h"
+#include "vm_memory.h"
+#include "meter.h"
+#include "vm_snapshot.h"
+#include "profiler.h"
 
 #include <vector>
 #include <sstream>
@@ -13,6 +21,7 @@
 #include <functional>
 #include <memory>
 #include <array>
+#include <atomic>
 
 namespace primal {
 
@@ -23,45 +32,264 @@ struct vm_impl
 
     friend class vm;
 
-    vm_impl();
-    ~vm_impl();
+    vm_impl(const memory_config& config, execution_policy policy);
+    ~vm_impl() = default;
 
-    struct executor
+    // an entry of the interrupt vector: a plain function, or a callable held by target and called through thunk
+    struct interrupt_entry
     {
-        std::function<bool(vm*)> runner;
+        bool (*handler)(vm*) = nullptr;
+        bool (*thunk)(void*, vm*) = nullptr;
+        std::shared_ptr<void> target;
     };
 
-    bool run(const std::vector<uint8_t> &app, vm *v);
+    // the opcode implementations are plain functions, no need to wrap them
+    using opcode_runner = bool(*)(vm*);
+
+    /**
+     * @brief Lays out the memory for the application and decodes it, the run is started by resume()
+     */
+    void load(const std::vector<uint8_t> &app, vm *v);
+
+    /**
+     * @brief Continues a run which stopped because its instruction budget was exhausted, it yielded or it
+     * was suspended, or starts one loaded from a snapshot or by load()
+     */
+    bool resume(vm* v);
+
+    /**
+     * @brief Continues the run for at most the given number of instructions, 0 only reports the status
+     */
+    run_status run_for(vm* v, uint64_t instructions);
+
+    /**
+     * @brief Continues the run until the deadline, checked between two batches of instructions
+     */
+    run_status run_until(vm* v, std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Captures the current state of the machine, nullptr if it has not run anything
+     */
+    std::shared_ptr<const vm_snapshot> take_snapshot(const vm* v) const;
+
+    /**
+     * @brief Replaces the state of the machine with the one captured by the snapshot
+     */
+    void fork_from(const vm_snapshot& s, vm* v);
+
+    /**
+     * @brief Resolves the extern functions of the application to their slots in the function registry
+     */
+    void link_functions(const std::vector<loaded_function>& functions);
+
+    /**
+     * @brief Calls the extern function with the given index, with the arguments on the stack (see vm::call_native)
+     */
+    bool call_native(word_t index, vm* v);
+
+    // copies a string returned by a foreign function into the memory, returns its address
+    word_t store_foreign_string(std::string_view s);
+
+    // places the result of a foreign function into r0, the address of the copy for the strings
+    void store_foreign_result(const script_value& result);
+
+    // the instruction being executed suspends the machine after it, until the pending result is ready
+    void suspend(std::shared_ptr<pending_call> pending)
+    {
+        m_pending = std::move(pending);
+        m_stop_requested = true;
+        m_stop_reason = run_status::suspended;
+    }
 
-    template<class OPC, class EXECUTOR>
-    static void register_opcode(OPC&& o, EXECUTOR&& ex)
+    // the instruction being executed gives the thread back to the host, the run continues after it
+    void yield()
     {
-        auto f = [&](vm* machina) -> bool {return ex(machina);};
-        executor t;
-        t.runner = std::function<bool(vm*)>(f);
-        opcode_runners[o.bin()] = t;
+        m_stop_requested = true;
+        m_stop_reason = run_status::yielded;
+    }
+
+    bool stop_requested() const { return m_stop_requested; }
+
+    // takes the stop asked for by another thread, the dispatch loops only look at it when the execution
+    // went backward or called a function
+    bool take_stop_request()
+    {
+        if(!m_stop_request.load(std::memory_order_relaxed) || !m_stop_request.exchange(false))
+        {
+            return false;
+        }
+        m_stop_requested = true;
+        m_stop_reason = run_status::cancelled;
+        return true;
+    }
+
+    // whether the instruction at the given address, which left the IP on ip, is one to look at the stop request after
+    bool polls_stop(word_t address, word_t ip, uint8_t opcode) const
+    {
+        return ip <= address || opcode == m_call_opcode || opcode == m_calla_opcode;
+    }
+
+    // a handler returned false: it either asked the machine to stop after it, or it failed
+    void stop_or_panic()
+    {
+        if(!m_stop_requested)
+        {
+            panic("Exc failed");
+        }
+    }
+
+    /**
+     * @brief Decodes, verifies and specializes the code section of the loaded application
+     */
+    void load_program(vm* v);
+
+    /**
+     * @brief Runs the loaded application from the current IP, and records how it stopped
+     */
+    bool execute(vm* v);
+
+    /**
+     * @brief Picks the dispatch loop for the loaded application and runs it
+     */
+    bool dispatch(vm* v);
+
+    template<class OPC>
+    static void register_opcode(OPC&& o, opcode_runner r)
+    {
+        opcode_runners[o.bin()] = r;
     };
 
-    template<class EXECUTOR>
-    static void register_interrupt(uint8_t intrn, EXECUTOR&& ex)
+    // the interrupts enabled in vm/CMakeLists.txt, every machine starts with these
+    static void register_builtin_interrupt(uint8_t intrn, bool (*handler)(vm*))
+    {
+        builtin_interrupts[intrn].handler = handler;
+    }
+
+    // runs the interrupt from the vector of this machine, panics if nothing is registered for it
+    bool call_interrupt(word_t intrn, vm* v)
     {
-        auto f = [&](vm* machina) -> bool {return ex(machina);};
-        executor t;
-        t.runner = std::function<bool(vm*)>(f);
-        interrupts[intrn] = t;
+        if(intrn >= 0 && intrn < static_cast<word_t>(m_interrupts.size()))
+        {
+            const interrupt_entry& e = m_interrupts[static_cast<size_t>(intrn)];
+            if(e.handler)
+            {
+                return e.handler(v);
+            }
+            if(e.thunk)
+            {
+                return e.thunk(e.target.get(), v);
+            }
+        }
+        panic(std::string(("Unimplemented interrupt called: ") + std::to_string(intrn)).c_str());
     }
 
     [[noreturn]] void panic(const char *reason) ;
 
+    /**
+     * @brief The handler of a specialized opcode for the given kinds of operands, nullptr if there is none
+     */
+    static opcode_runner specialized_runner(uint8_t opc, type_destination dest, type_destination src, bool flag = true);
 
-    void bindump(const char* title = nullptr, word_t start = -1, word_t end = -1, bool insert_addr = true);
+    /**
+     * @brief Replaces the generic handlers of the decoded program with the specialized ones where possible
+     *
+     * With @p dead_flags the instructions marked with decoded_instruction::flag_dead get a handler not
+     * setting the flag. Only the release machines do that, the observers of the others see every flag.
+     */
+    static void specialize(decoded_program& p, bool dead_flags);
 
     /**
-     * @brief rsb is an access function for a given byte from a register
+     * @brief The handler of OP with a destination of kind D and a source of kind S, setting the flag
+     * if FLAG, see specialized.cpp
      */
+    template<class OP, operand::kind D, operand::kind S, bool FLAG>
+    static bool run_specialized(vm* v);
 
-    reg_subbyte* rsb(uint8_t ridx, uint8_t bidx);
+    /**
+     * @brief The dispatch loop used in production: direct threaded (computed goto) where the compiler
+     * supports it, a switch otherwise. Both are generated from the opcode list in opcodes/CMakeLists.txt
+     */
+    bool run_threaded(vm* v);
+
+    // the policies of the observed dispatch loop, see execution_policy
+    struct trace_policy
+    {
+        static constexpr bool decoded = true;       // runs the pre-decoded program where there is one
+    };
+    struct debug_policy
+    {
+        static constexpr bool decoded = false;      // reads every instruction from the memory
+    };
 
+    /**
+     * @brief The dispatch loop of the trace and debug machines: runs one instruction at a time, tells the
+     * observer about it and honours the instruction budget. The release machines never get here
+     */
+    template<class POLICY>
+    bool run_observed(vm* v);
+
+    /**
+     * @brief The dispatch loop running the pre-decoded program. Falls back to run_threaded when the
+     * execution lands on an address which is not the start of a decoded instruction
+     */
+    bool run_predecoded(vm* v);
+
+    /**
+     * @brief The dispatch loop used when there is an instruction budget or a clock speed: runs the pre-decoded
+     * program (or the bytecode where there is none) in batches, and leaves it to the meter to count and wait
+     * between two batches. Returns false when the budget is exhausted
+     */
+    bool run_metered(vm* v);
+
+    /**
+     * @brief The dispatch loop used when profiling: runs like run_metered, one instruction at a time, and
+     * tells the profiler about every instruction
+     */
+    bool run_profiled(vm* v);
+
+    // what execute_decoded gives back when the instruction asked the machine to stop
+    static constexpr int32_t stopped_pc = -2;
+
+    // runs a decoded instruction, gives back the index of the next one, -1 if it did not land on a decoded instruction
+    int32_t execute_decoded(vm* v, const decoded_instruction& ins, int32_t pc)
+    {
+        // the handlers see the IP after the operands, just like when running the bytecode
+        m_current = &ins;
+        m_operand = 0;
+        reg_ip() = ins.next;
+
+        if(!ins.handler(v))
+        {
+            m_current = nullptr;
+            stop_or_panic();
+            return stopped_pc;
+        }
+        m_current = nullptr;
+
+        word_t ip = reg_ip();
+        if(ip == ins.next)
+        {
+            return pc + 1;
+        }
+        if(polls_stop(ins.address, ip, ins.opcode) && take_stop_request())
+        {
+            return stopped_pc;
+        }
+        if(ip == ins.target)
+        {
+            return ins.target_index;
+        }
+        return m_program.index(ip);
+    }
+
+    /**
+     * @brief The dispatch loop of the JIT tier: runs the pre-decoded program like run_predecoded, counts the
+     * calls and backward jumps of the functions and enters the native code of the ones already translated
+     */
+    bool run_jit(vm* v);
+
+
+    void bindump(const char* title = nullptr, word_t start = -1, word_t end = -1, bool insert_addr = true);
 
     void set_mem(word_t address, word_t new_value);
 
@@ -73,17 +301,26 @@ struct vm_impl
 
     bool copy(word_t dest, word_t src, word_t cnt);
 
-    // access the memory at the given location
-    memaddress* mem(word_t address);
-    memaddress_byte_ref* mem_byte(word_t address);
-    immediate* imm(word_t v);
+    // the location of an operand of the given width in the memory, panics if it is outside
+    uint8_t* mem_at(word_t address, word_t width);
+
+    // the location of a memory operand with an immediate address, checked only if the verifier could not prove it safe
+    uint8_t* mem_at(const decoded_operand& o, word_t width)
+    {
+        return o.unchecked ? &ms[static_cast<size_t>(o.imm)] : mem_at(o.imm, width);
+    }
+
+    // gives back the next operand, either from the current decoded instruction or from the bytecode
+    operand fetch();
 
-    type_destination fetch_type_dest();
-    uint8_t fetch_register_index();
-    word_t fetch_immediate();
-    uint8_t fetch_byte();
+    // resolves a decoded operand against the current state of the registers and the memory
+    operand resolve(const decoded_operand& o);
 
-    valued *fetch();
+    // read and write an operand of a statically known kind, used by the specialized handlers
+    template<operand::kind K>
+    word_t read(const decoded_operand& o);
+    template<operand::kind K>
+    void write(const decoded_operand& o, word_t v);
 
 
     word_t &ip();
@@ -106,39 +343,68 @@ struct vm_impl
     uint8_t peek_byte(size_t &ip) const;
 
 
-    void set_debug(bool newDebug);
 #ifdef TICKS
-    void set_speed(uint64_t hertz) { m_clock_speed = hertz; }
+    void set_speed(uint64_t hertz) { m_meter.set_speed(hertz); }
 #endif
+    void set_instruction_budget(uint64_t instructions) { m_meter.set_budget(instructions); }
+    void set_predecode(bool predecode) { m_predecode = predecode; }
+    void set_jit(bool jit) { m_jit_enabled = jit; }
+    void set_verify(bool verify) { m_verify = verify; }
+    void set_profiling(bool profiling) { m_profiling = profiling; }
 
 public:
     void memdump(word_t start, word_t end, word_t mark, bool insert_addr = true);
 
 private:
 
-    static std::array<executor, 256> opcode_runners;
-    static std::map<word_t, executor> interrupts;
-
-    reg m_r[VM_REG_COUNT];              // the registers of the machine
-    reg& m_ip;               // the instructions pointer
-    std::unique_ptr<uint8_t[]> ms;      // the memory segment
-
-    reg_subbyte t1 {&this->m_r[0], 0};
-    std::array<immediate, 3> imv = { immediate{-1}, immediate{-1}, immediate{-1}} ;
-    memaddress_byte_ref mb[2];
-    memaddress ma[2];
-    int mb_i = 0;
-    int ma_i = 0;
-    std::size_t mi_i = 0;
-    reg& m_lbo; // the last operations' result. This is set to false if the result was 0
+    static std::array<opcode_runner, 256> opcode_runners;
+    static std::array<interrupt_entry, 256> builtin_interrupts;
+    std::array<interrupt_entry, 256> m_interrupts;      // the interrupt vector of this machine, indexed by the number
+    std::vector<size_t> m_natives;                      // the registry slots of the extern functions, by their index
+    std::vector<ffi_arg> m_ffi_args;                    // the arguments of the foreign call being made
+
+    // the special registers, kept in the register file like the others
+    word_t& reg_ip() { return m_r[VM_REG_IP]; }
+    word_t reg_ip() const { return m_r[VM_REG_IP]; }
+    word_t& reg_flag() { return m_r[VM_REG_FLAG]; }
+    word_t reg_flag() const { return m_r[VM_REG_FLAG]; }
+    word_t& reg_sp() { return m_r[VM_REG_SP]; }
+    word_t reg_sp() const { return m_r[VM_REG_SP]; }
+
+    alignas(64) word_t m_r[VM_REG_COUNT] = {};         // the registers of the machine, the special ones included
+    vm_memory ms;                       // the memory segment
+
     word_t app_size = -1;
     word_t max_used_sp = 0;
     word_t stack_offset = 0;
-    reg& sp;
-    bool m_debug = false;
-#ifdef TICKS
-    word_t m_clock_speed = 1000;
-#endif
+    memory_config m_memory_config;
+    word_t m_heap_start = 0;                            // where the heap starts, it ends where the foreign results start
+    word_t m_results_start = 0;                         // where the strings returned by the foreign functions go
+    word_t m_results_size = 0;                          // the size of their area, 0 if they all go to one place
+    word_t m_results_next = 0;                          // where the next one goes
+    word_t m_stack_start = 0;                           // where the stack starts
+    word_t m_stack_end = VM_MEM_SEGMENT_SIZE;           // the first byte above the stack
+    execution_policy m_policy;                          // fixed when the machine is created
+    std::shared_ptr<vm_observer> m_observer;            // told about the instructions when not in release
+    bool m_predecode = true;
+    decoded_program m_program;                          // the code section, decoded when loaded
+    bool m_verify = true;
+    verification m_verification;                        // what the verifier found out about m_program
+    const decoded_instruction* m_current = nullptr;     // the instruction executed by run_predecoded
+    uint8_t m_operand = 0;                              // the next operand of m_current to be fetched
+    bool m_jit_enabled = false;
+    jit m_jit;                                          // the native code of the hot functions
+    meter m_meter;                                      // the instruction budget and the clock speed
+    run_status m_status = run_status::finished;         // how the last run stopped
+    bool m_stop_requested = false;                      // the instruction executed asked the dispatch loop to stop
+    run_status m_stop_reason = run_status::suspended;   // and the status the run stops with
+    std::shared_ptr<pending_call> m_pending;            // the foreign call the machine is suspended on
+    std::atomic<bool> m_stop_request {false};           // set by vm::request_stop(), from any thread
+    uint8_t m_call_opcode = 0;                          // the calls look at the stop request even when going forward
+    uint8_t m_calla_opcode = 0;
+    bool m_decoded = false;                             // m_program holds the code section of the application
+    bool m_profiling = false;
+    profiler m_profiler;                                // what the last profiled run collected
 };
 
 }
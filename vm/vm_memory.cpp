@@ -0,0 +1,205 @@
+#include "vm_memory.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+#define PRIMAL_GUARD_PAGES
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define PRIMAL_MEMORY_FILES
+#endif
+
+using namespace primal;
+
+memory_image::memory_image(const vm_memory& m) : m_size(m.size())
+{
+#ifdef PRIMAL_MEMORY_FILES
+    m_file = memfd_create("primal-snapshot", MFD_CLOEXEC);
+    if(m_file != -1)
+    {
+        bool written = ftruncate(m_file, static_cast<off_t>(m_size)) == 0;
+        for(size_t done = 0; written && done < m_size; )
+        {
+            ssize_t w = pwrite(m_file, m.data() + done, m_size - done, static_cast<off_t>(done));
+            written = w > 0;
+            done += written ? static_cast<size_t>(w) : 0;
+        }
+        if(written)
+        {
+            return;
+        }
+        close(m_file);
+        m_file = -1;
+    }
+#endif
+
+    if(m.data() == nullptr && m_size > 0)
+    {
+        throw std::runtime_error("No memory to take an image of");
+    }
+    m_copy = std::make_unique<uint8_t[]>(m_size);
+    std::copy(m.data(), m.data() + m_size, m_copy.get());
+}
+
+memory_image::~memory_image()
+{
+#ifdef PRIMAL_MEMORY_FILES
+    if(m_file != -1)
+    {
+        close(m_file);
+    }
+#endif
+}
+
+vm_memory::~vm_memory()
+{
+    release();
+}
+
+bool vm_memory::guards_supported()
+{
+#ifdef PRIMAL_GUARD_PAGES
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t vm_memory::page_size()
+{
+#ifdef PRIMAL_GUARD_PAGES
+    static const size_t ps = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return ps;
+#else
+    return 4096;
+#endif
+}
+
+bool vm_memory::allocate(size_t size, bool guarded)
+{
+#ifdef PRIMAL_GUARD_PAGES
+    if(guarded)
+    {
+        // one inaccessible page on each side, the memory itself is readable and writable
+        size_t ps = page_size();
+        size_t rounded = (size + ps - 1) / ps * ps;
+        if(m_mapping && m_guarded && !m_mapped_image && rounded == m_size)
+        {
+            // the same mapping will do, the guard pages stay where they are
+            clear();
+            return true;
+        }
+        release();
+        size_t total = rounded + 2 * ps;
+        void* m = mmap(nullptr, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(m == MAP_FAILED)
+        {
+            return false;
+        }
+        if(mprotect(static_cast<uint8_t*>(m) + ps, rounded, PROT_READ | PROT_WRITE) != 0)
+        {
+            munmap(m, total);
+            return false;
+        }
+        m_mapping = m;
+        m_mapping_size = total;
+        m_guarded = true;
+        m_data = static_cast<uint8_t*>(m) + ps;
+        m_size = rounded;
+        return true;
+    }
+#else
+    (void)guarded;
+#endif
+
+    if(m_plain && m_capacity >= size)
+    {
+        m_size = size;
+        clear();
+        return true;
+    }
+    release();
+
+    m_plain = std::make_unique<uint8_t[]>(size);
+    m_capacity = size;
+    m_data = m_plain.get();
+    m_size = size;
+    return true;
+}
+
+bool vm_memory::map(const memory_image& image, bool guarded)
+{
+    release();
+
+#ifdef PRIMAL_MEMORY_FILES
+    if(image.m_file != -1)
+    {
+        // the file is mapped over the middle of an inaccessible reservation, which gives the guard pages
+        size_t guard = guarded ? page_size() : 0;
+        size_t total = image.m_size + 2 * guard;
+        void* m = mmap(nullptr, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(m == MAP_FAILED)
+        {
+            return false;
+        }
+        uint8_t* data = static_cast<uint8_t*>(m) + guard;
+        if(image.m_size > 0 && mmap(data, image.m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image.m_file, 0) == MAP_FAILED)
+        {
+            munmap(m, total);
+            return false;
+        }
+        if(guarded)
+        {
+            }
+        m_mapping = m;
+        m_mapping_size = total;
+        m_guarded = guarded;
+        m_mapped_image = true;
+        m_data = data;
+        m_size = image.m_size;
+        return true;
+    }
+#endif
+
+    if(!allocate(image.m_size, guarded) || m_size != image.m_size)
+    {
+        release();
+        return false;
+    }
+    std::copy(image.m_copy.get(), image.m_copy.get() + image.m_size, m_data);
+    return true;
+}
+
+void vm_memory::clear()
+{
+#if defined(__linux__)
+    // the private anonymous pages read as zero again, without touching the ones never used
+    if(m_mapping && !m_mapped_image && madvise(m_data, m_size, MADV_DONTNEED) == 0)
+    {
+        return;
+    }
+#endif
+    std::fill(m_data, m_data + m_size, 0x00);
+}
+
+void vm_memory::release()
+{
+#ifdef PRIMAL_GUARD_PAGES
+    if(m_mapping)
+    {
+        munmap(m_mapping, m_mapping_size);
+    }
+#endif
+    m_mapping = nullptr;
+    m_mapping_size = 0;
+    m_guarded = false;
+    m_mapped_image = false;
+    m_plain.reset();
+    m_capacity = 0;
+    m_data = nullptr;
+    m_size = 0;
+}
@@ -0,0 +1,114 @@
+#ifndef PRIMAL_VM_MEMORY_H
+#define PRIMAL_VM_MEMORY_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace primal
+{
+
+class vm_memory;
+
+/**
+ * @brief A read-only copy of the contents of a VM memory, taken once and mapped by any number of memories.
+ *
+ * Where the platform has anonymous files the copy is one, and the memories mapping it share its pages
+ * until they write to them (copy-on-write). Elsewhere the memories get a copy of it.
+ */
+class memory_image final
+{
+public:
+
+    /**
+     * @brief Copies the contents of the memory.
+     *
+     * @throws std::runtime_error If the copy cannot be made.
+     */
+    explicit memory_image(const vm_memory& m);
+    ~memory_image();
+
+    memory_image(const memory_image&) = delete;
+    memory_image& operator=(const memory_image&) = delete;
+
+    size_t size() const { return m_size; }
+
+private:
+
+    friend class vm_memory;
+
+    int m_file = -1;                        // the anonymous file holding the copy
+    std::unique_ptr<uint8_t[]> m_copy;      // the copy where there are no anonymous files
+    size_t m_size = 0;
+};
+
+/**
+ * @brief The memory of a VM: either a plain allocation, or an anonymous mapping surrounded by guard pages.
+ *
+ * An access falling on a guard page faults and takes the process down. The guard pages only catch the
+ * accesses landing right next to the memory, so they are a second line of defence behind the bounds
+ * checks and not a replacement for them. Guard pages are available where anonymous mappings are,
+ * elsewhere the memory is always a plain allocation.
+ */
+class vm_memory final
+{
+public:
+
+    vm_memory() = default;
+    ~vm_memory();
+
+    vm_memory(const vm_memory&) = delete;
+    vm_memory& operator=(const vm_memory&) = delete;
+
+    /** @return True if guard pages can be placed around the memory on this platform. */
+    static bool guards_supported();
+
+    /** @return The size of the guard pages, the guarded memory is a multiple of it. */
+    static size_t page_size();
+
+    /**
+     * @brief Provides a zero-filled memory of the given size, the current one is reused if it is big enough.
+     *
+     * @param size The number of usable bytes.
+     * @param guarded Place guard pages around the memory, the size is rounded up to the page size.
+     * @return False if the memory could not be allocated.
+     */
+    bool allocate(size_t size, bool guarded);
+
+    /**
+     * @brief Replaces the memory with a copy-on-write mapping of the image, of the same size.
+     *
+     * @param image The contents of the memory.
+     * @param guarded Place guard pages around the memory, the image must have a multiple of the page size.
+     * @return False if the mapping could not be made.
+     */
+    bool map(const memory_image& image, bool guarded);
+
+    /** @brief Drops the memory. */
+    void release();
+
+    /** @brief Fills the memory with zeroes. */
+    void clear();
+
+    uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool guarded() const { return m_guarded; }
+
+    uint8_t& operator[](size_t i) { return m_data[i]; }
+    uint8_t operator[](size_t i) const { return m_data[i]; }
+
+private:
+
+    std::unique_ptr<uint8_t[]> m_plain;     // the memory when there are no guard pages
+    size_t m_capacity = 0;                  // the size of m_plain, the memory might use less of it
+    void* m_mapping = nullptr;              // the whole mapping, guard pages included
+    size_t m_mapping_size = 0;
+    bool m_guarded = false;                 // the mapping has a guard page on both sides
+    bool m_mapped_image = false;            // the mapping is backed by a memory_image, not zeroes
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+}
+
+#endif // PRIMAL_VM_MEMORY_H
@@ -0,0 +1,58 @@
+#ifndef PRIMAL_VM_OBSERVER_H
+#define PRIMAL_VM_OBSERVER_H
+
+#include <numeric_decl.h>
+
+#include <cstdint>
+
+namespace primal
+{
+
+class vm;
+
+/**
+ * @brief Watches a virtual machine executing an application, instruction by instruction.
+ *
+ * Only the machines created with execution_policy::trace or execution_policy::debug tell their observer
+ * about the instructions, the release machines run without ever calling it. The calls are made on the
+ * thread running the machine, between two instructions, so the observer can read (and in the debug
+ * policy change) the registers and the memory.
+ */
+class vm_observer
+{
+public:
+
+    virtual ~vm_observer() = default;
+
+    /**
+     * @brief Called when a run starts or a stopped run is resumed.
+     */
+    virtual void started(vm& v) {}
+
+    /**
+     * @brief Called before an instruction runs, with the IP still on the instruction.
+     *
+     * @param v The machine.
+     * @param address The address of the instruction.
+     * @param opcode The opcode of the instruction.
+     */
+    virtual void before(vm& v, word_t address, uint8_t opcode) {}
+
+    /**
+     * @brief Called after an instruction ran, with the IP on the instruction executed next.
+     *
+     * @param v The machine.
+     * @param address The address of the instruction which ran.
+     * @param opcode The opcode of the instruction which ran.
+     */
+    virtual void after(vm& v, word_t address, uint8_t opcode) {}
+
+    /**
+     * @brief Called when the application reached its end.
+     */
+    virtual void finished(vm& v) {}
+};
+
+}
+
+#endif // PRIMAL_VM_OBSERVER_H
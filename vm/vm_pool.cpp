@@ -0,0 +1,133 @@
+#include "vm_pool.h"
+
+#include <algorithm>
+
+using namespace primal;
+
+vm_pool::vm_pool(size_t workers, const memory_config& config, std::function<void(vm&)> setup)
+{
+    workers = std::max<size_t>(workers, 1);
+    for(size_t i = 0; i < workers; i++)
+    {
+        auto w = std::make_unique<worker>();
+        w->machine = vm::create(config);
+#ifdef TICKS
+        w->machine->set_speed(0);
+#endif
+        if(setup)
+        {
+            setup(*w->machine);
+        }
+        m_workers.push_back(std::move(w));
+    }
+
+    // the threads only start when all the workers are there to steal from
+    for(size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->thread = std::thread(&vm_pool::work, this, i);
+    }
+}
+
+vm_pool::~vm_pool()
+{
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+        m_stopping = true;
+    }
+    m_work.notify_all();
+
+    for(auto& w : m_workers)
+    {
+        w->thread.join();
+    }
+}
+
+std::future<bool> vm_pool::submit(std::shared_ptr<const std::vector<uint8_t>> app, inspector inspect)
+{
+    job j;
+    j.app = std::move(app);
+    j.inspect = std::move(inspect);
+    std::future<bool> result = j.result.get_future();
+
+    worker& w = *m_workers[m_next++ % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> l(w.lock);
+        w.queue.push_back(std::move(j));
+    }
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+        m_pending ++;
+    }
+    m_work.notify_one();
+
+    return result;
+}
+
+bool vm_pool::take(size_t index, job& j)
+{
+    {
+        worker& own = *m_workers[index];
+        std::lock_guard<std::mutex> l(own.lock);
+        if(!own.queue.empty())
+        {
+            j = std::move(own.queue.front());
+            own.queue.pop_front();
+            return true;
+        }
+    }
+
+    for(size_t k = 1; k < m_workers.size(); k++)
+    {
+        worker& other = *m_workers[(index + k) % m_workers.size()];
+        std::lock_guard<std::mutex> l(other.lock);
+        if(!other.queue.empty())
+        {
+            j = std::move(other.queue.back());
+            other.queue.pop_back();
+            m_stolen ++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void vm_pool::work(size_t index)
+{
+    vm& machine = *m_workers[index]->machine;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> l(m_lock);
+            m_work.wait(l, [this]() { return m_pending > 0 || m_stopping; });
+            if(m_pending == 0)
+            {
+                return; // stopping, and nothing is left to run
+            }
+
+            // every job counted is in one of the queues until a worker having counted it down takes it
+            m_pending --;
+        }
+
+        job j;
+        while(!take(index, j))
+        {
+            std::this_thread::yield();
+        }
+
+        try
+        {
+            bool finished = machine.run(*j.app);
+            if(j.inspect)
+            {
+                j.inspect(machine);
+            }
+            j.result.set_value(finished);
+        }
+        catch(...)
+        {
+            j.result.set_exception(std::current_exception());
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef PRIMAL_VM_POOL_H
+#define PRIMAL_VM_POOL_H
+
+#include "vm.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace primal
+{
+
+/**
+ * @brief Runs compiled applications on a fixed number of worker threads.
+ *
+ * Every worker owns a virtual machine which it reuses for all the applications it runs, so its memory
+ * is only allocated again when an application needs more of it. The submitted applications are queued
+ * at the workers in turns, a worker takes the oldest application of its own queue, and when its queue
+ * is empty it steals the newest one queued at another worker.
+ */
+class vm_pool final
+{
+public:
+
+    /**
+     * @brief Called on the worker thread after the application finished, with the machine still
+     * holding the registers and the memory of the run.
+     */
+    using inspector = std::function<void(vm&)>;
+
+    /**
+     * @brief Starts the workers.
+     *
+     * @param workers The number of worker threads, at least one is started.
+     * @param config The memory layout of the machines of the workers.
+     * @param setup Called once for the machine of every worker, before it runs anything. The machines
+     * run at full speed unless the setup changes it.
+     */
+    explicit vm_pool(size_t workers = std::thread::hardware_concurrency(),
+                     const memory_config& config = memory_config(),
+                     std::function<void(vm&)> setup = nullptr);
+
+    /**
+     * @brief Runs what is still queued, then stops the workers.
+     */
+    ~vm_pool();
+
+    vm_pool(const vm_pool&) = delete;
+    vm_pool& operator=(const vm_pool&) = delete;
+
+    /**
+     * @brief Queues an application to be run by one of the workers.
+     *
+     * @param app The compiled bytecode, shared by the applications submitted more than once.
+     * @param inspect Called with the machine after the run, to read out the results.
+     * @return Becomes what vm::run returned, or holds the exception (a primal::vm_panic for example)
+     * the run or the inspector threw.
+     */
+    std::future<bool> submit(std::shared_ptr<const std::vector<uint8_t>> app, inspector inspect = nullptr);
+
+    /** @return The number of worker threads. */
+    size_t workers() const { return m_workers.size(); }
+
+    /** @return The number of applications a worker took from the queue of another one. */
+    size_t stolen() const { return m_stolen.load(); }
+
+private:
+
+    struct job
+    {
+        std::shared_ptr<const std::vector<uint8_t>> app;
+        inspector inspect;
+        std::promise<bool> result;
+    };
+
+    struct worker
+    {
+        std::mutex lock;
+        std::deque<job> queue;
+        std::shared_ptr<vm> machine;
+        std::thread thread;
+    };
+
+    void work(size_t index);
+    bool take(size_t index, job& j);
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::mutex m_lock;                      // guards the waiting for work
+    std::condition_variable m_work;         // signalled when something is queued or the pool stops
+    size_t m_pending = 0;                   // the number of queued jobs, guarded by m_lock
+    bool m_stopping = false;
+    std::atomic<size_t> m_next {0};         // the worker the next job is queued at
+    std::atomic<size_t> m_stolen {0};
+};
+
+}
+
+#endif // PRIMAL_VM_POOL_H
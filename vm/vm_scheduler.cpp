@@ -0,0 +1,92 @@
+#include "vm_scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace primal;
+
+vm_scheduler::vm_scheduler(std::chrono::microseconds idle) : m_idle(idle)
+{
+}
+
+std::future<bool> vm_scheduler::add(std::shared_ptr<vm> machine, std::shared_ptr<const std::vector<uint8_t>> app, inspector inspect)
+{
+    task t;
+    t.machine = std::move(machine);
+    t.app = std::move(app);
+    t.inspect = std::move(inspect);
+    std::future<bool> result = t.result.get_future();
+    m_tasks.push_back(std::move(t));
+    return result;
+}
+
+size_t vm_scheduler::round()
+{
+    size_t ran = 0;
+    for(auto it = m_tasks.begin(); it != m_tasks.end(); )
+    {
+        task& t = *it;
+        if(t.started && !t.machine->ready())
+        {
+            ++it;
+            continue; // still waiting for its foreign function
+        }
+
+        ran ++;
+        try
+        {
+            bool finished = false;
+            if(!t.started)
+            {
+                t.started = true;
+                finished = t.machine->run(*t.app);
+            }
+            else
+            {
+                finished = t.machine->resume();
+            }
+
+            if(!finished)
+            {
+                ++it;
+                continue; // suspended, yielded, or its budget ran out
+            }
+
+            if(t.inspect)
+            {
+                t.inspect(*t.machine);
+            }
+            t.result.set_value(true);
+        }
+        catch(...)
+        {
+            t.result.set_exception(std::current_exception());
+        }
+        it = m_tasks.erase(it);
+    }
+    return ran;
+}
+
+size_t vm_scheduler::step()
+{
+    round();
+    return m_tasks.size();
+}
+
+void vm_scheduler::run()
+{
+    while(!m_tasks.empty())
+    {
+        if(round() == 0)
+        {
+            // everything waits for a foreign function
+            std::this_thread::sleep_for(m_idle);
+        }
+    }
+}
+
+size_t vm_scheduler::waiting() const
+{
+    return static_cast<size_t>(std::count_if(m_tasks.begin(), m_tasks.end(),
+                                             [](const task& t) { return t.started && !t.machine->ready(); }));
+}
@@ -0,0 +1,92 @@
+#ifndef PRIMAL_VM_SCHEDULER_H
+#define PRIMAL_VM_SCHEDULER_H
+
+#include "vm.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace primal
+{
+
+/**
+ * @brief Runs many applications on the calling thread, switching between them when they wait.
+ *
+ * Every application has its own machine. A machine suspended on an asynchronous foreign function (see
+ * run_status::suspended) is put aside until the result of the function is ready, and the others run in the
+ * meantime. A machine which ran out of its instruction budget or yielded is continued in the next round, so
+ * the budget works as a time slice.
+ */
+class vm_scheduler final
+{
+public:
+
+    /**
+     * @brief Called after the application finished, with the machine still holding the registers and the
+     * memory of the run.
+     */
+    using inspector = std::function<void(vm&)>;
+
+    /**
+     * @param idle How long run() sleeps when every application waits for a foreign function.
+     */
+    explicit vm_scheduler(std::chrono::microseconds idle = std::chrono::microseconds(100));
+
+    vm_scheduler(const vm_scheduler&) = delete;
+    vm_scheduler& operator=(const vm_scheduler&) = delete;
+
+    /**
+     * @brief Adds an application, it starts with the next round.
+     *
+     * @param machine The machine running the application, not shared with the other applications.
+     * @param app The compiled bytecode, shared by the applications added more than once.
+     * @param inspect Called with the machine after the application finished, to read out the results.
+     * @return Becomes true once the application finished, or holds the exception (a primal::vm_panic for
+     * example) the run or the inspector threw.
+     */
+    std::future<bool> add(std::shared_ptr<vm> machine, std::shared_ptr<const std::vector<uint8_t>> app, inspector inspect = nullptr);
+
+    /**
+     * @brief Runs one round: starts or continues every application which can go on without waiting.
+     *
+     * @return The number of applications not finished yet.
+     */
+    size_t step();
+
+    /**
+     * @brief Runs rounds until every application finished.
+     */
+    void run();
+
+    /** @return The number of applications not finished yet. */
+    size_t size() const { return m_tasks.size(); }
+
+    /** @return The number of applications waiting for the result of a foreign function. */
+    size_t waiting() const;
+
+private:
+
+    struct task
+    {
+        std::shared_ptr<vm> machine;
+        std::shared_ptr<const std::vector<uint8_t>> app;
+        inspector inspect;
+        std::promise<bool> result;
+        bool started = false;
+    };
+
+    // runs a round, tells how many applications could go on
+    size_t round();
+
+    std::list<task> m_tasks;
+    std::chrono::microseconds m_idle;
+};
+
+}
+
+#endif // PRIMAL_VM_SCHEDULER_H
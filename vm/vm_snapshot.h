@@ -0,0 +1,47 @@
+#ifndef PRIMAL_VM_SNAPSHOT_H
+#define PRIMAL_VM_SNAPSHOT_H
+
+#include <hal.h>
+#include <numeric_decl.h>
+
+#include "decoder.h"
+#include "verifier.h"
+#include "vm_memory.h"
+#include "loaded_function.h"
+
+#include <vector>
+
+namespace primal
+{
+
+/**
+ * @brief The state of a stopped VM: its registers, its memory and what was derived from the application
+ * when it was loaded, so the machines forked from it neither load nor decode anything.
+ */
+struct vm_snapshot
+{
+    explicit vm_snapshot(const vm_memory& m) : image(m) {}
+
+    memory_image image;                     // the memory, mapped copy-on-write by the forks
+    bool guarded = false;                   // the memory had guard pages
+    word_t registers[VM_REG_COUNT] = {};
+
+    word_t app_size = 0;
+    word_t stack_offset = 0;
+    word_t heap_start = 0;
+    word_t results_start = 0;
+    word_t results_size = 0;
+    word_t results_next = 0;
+    word_t stack_start = 0;
+    word_t stack_end = 0;
+    word_t max_used_sp = 0;
+
+    std::vector<loaded_function> functions;
+    decoded_program program;                // only valid if decoded is set
+    bool decoded = false;
+    verification verified;
+};
+
+}
+
+#endif // PRIMAL_VM_SNAPSHOT_H
@@ -0,0 +1,148 @@
+#include "vm_watchdog.h"
+
+#include <exceptions.h>
+
+using namespace primal;
+
+vm_watchdog::vm_watchdog() : m_thread(&vm_watchdog::work, this)
+{
+}
+
+vm_watchdog::~vm_watchdog()
+{
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+}
+
+watched_run vm_watchdog::run(vm& machine, const std::vector<uint8_t>& app, std::chrono::steady_clock::duration limit)
+{
+    // loading drops the stop requests, so it comes before the watching starts
+    try
+    {
+        machine.load(app);
+    }
+    catch(const vm_panic& e)
+    {
+        watched_run r;
+        r.panic = e.what();
+        return r;
+    }
+    return run_watched(machine, limit);
+}
+
+watched_run vm_watchdog::resume(vm& machine, std::chrono::steady_clock::duration limit)
+{
+    return run_watched(machine, limit);
+}
+
+watched_run vm_watchdog::run_watched(vm& machine, std::chrono::steady_clock::duration limit)
+{
+    watched_run r;
+    auto started = std::chrono::steady_clock::now();
+    uint64_t ticket = watch(machine, started + limit);
+    try
+    {
+        machine.resume();
+        r.status = machine.status();
+    }
+    catch(const vm_panic& e)
+    {
+        r.status = machine.status();
+        r.panic = e.what();
+    }
+
+    if(unwatch(ticket) && r.status != run_status::cancelled)
+    {
+        // the run ended by itself right when its deadline passed, the request would stop the next one
+        machine.clear_stop_request();
+    }
+    r.elapsed = std::chrono::steady_clock::now() - started;
+    return r;
+}
+
+uint64_t vm_watchdog::watch(vm& machine, std::chrono::steady_clock::time_point deadline)
+{
+    bool nearest = false;
+    uint64_t ticket = 0;
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+        ticket = m_next++;
+        m_entries[ticket] = { &machine, deadline, false };
+        nearest = m_deadlines.empty() || deadline < m_deadlines.begin()->first;
+        m_deadlines.emplace(deadline, ticket);
+    }
+    if(nearest)
+    {
+        m_changed.notify_one();
+    }
+    return ticket;
+}
+
+bool vm_watchdog::unwatch(uint64_t ticket)
+{
+    std::lock_guard<std::mutex> l(m_lock);
+    auto e = m_entries.find(ticket);
+    if(e == m_entries.end())
+    {
+        return false;
+    }
+
+    bool fired = e->second.fired;
+    if(!fired)
+    {
+        auto range = m_deadlines.equal_range(e->second.deadline);
+        for(auto d = range.first; d != range.second; ++d)
+        {
+            if(d->second == ticket)
+            {
+                m_deadlines.erase(d);
+                break;
+            }
+        }
+    }
+    m_entries.erase(e);
+    return fired;
+}
+
+size_t vm_watchdog::watched() const
+{
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_entries.size();
+}
+
+uint64_t vm_watchdog::stopped() const
+{
+    std::lock_guard<std::mutex> l(m_lock);
+    return m_stopped;
+}
+
+void vm_watchdog::work()
+{
+    std::unique_lock<std::mutex> l(m_lock);
+    while(!m_stopping)
+    {
+        if(m_deadlines.empty())
+        {
+            m_changed.wait(l);
+            continue;
+        }
+
+        auto nearest = m_deadlines.begin();
+        if(std::chrono::steady_clock::now() < nearest->first)
+        {
+            m_changed.wait_until(l, nearest->first);
+            continue;
+        }
+
+        // the machine stays valid while it is watched, and unwatch() waits for the lock
+        entry& e = m_entries[nearest->second];
+        e.fired = true;
+        e.machine->request_stop();
+        m_stopped ++;
+        m_deadlines.erase(nearest);
+    }
+}
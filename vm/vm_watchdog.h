@@ -0,0 +1,116 @@
+#ifndef PRIMAL_VM_WATCHDOG_H
+#define PRIMAL_VM_WATCHDOG_H
+
+#include "vm.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace primal
+{
+
+/**
+ * @brief How a run watched by a vm_watchdog ended.
+ */
+struct watched_run
+{
+    run_status status = run_status::finished;       /**< run_status::cancelled when the run went past its deadline */
+    std::string panic;                              /**< Why the machine panicked, empty if it did not */
+    std::chrono::steady_clock::duration elapsed {0};
+
+    /** @return True if the application reached its end. */
+    bool finished() const { return panic.empty() && status == run_status::finished; }
+};
+
+/**
+ * @brief Stops the runs which go past their deadline, so a stuck script cannot keep its thread.
+ *
+ * The watchdog has one thread of its own, sleeping until the nearest deadline of the watched machines and
+ * calling vm::request_stop() on the machines whose deadline passed. The machines see the request at their
+ * next backward jump or call and stop with run_status::cancelled, a foreign function which takes long is not
+ * interrupted. Any number of threads can run machines under the same watchdog.
+ */
+class vm_watchdog final
+{
+public:
+
+    vm_watchdog();
+
+    /**
+     * @brief Stops the thread of the watchdog, the machines still watched are left running.
+     */
+    ~vm_watchdog();
+
+    vm_watchdog(const vm_watchdog&) = delete;
+    vm_watchdog& operator=(const vm_watchdog&) = delete;
+
+    /**
+     * @brief Runs the application on the calling thread, for at most the given time.
+     *
+     * @param machine The machine running the application.
+     * @param app The compiled bytecode.
+     * @param limit How long the run may go on.
+     * @return How the run ended, the panics are reported in it instead of being thrown.
+     */
+    watched_run run(vm& machine, const std::vector<uint8_t>& app, std::chrono::steady_clock::duration limit);
+
+    /**
+     * @brief Continues a stopped run on the calling thread, for at most the given time (see run()).
+     */
+    watched_run resume(vm& machine, std::chrono::steady_clock::duration limit);
+
+    /**
+     * @brief Starts watching a machine run by the caller.
+     *
+     * @param machine The machine, it must not be destroyed before unwatch() is called.
+     * @param deadline When the machine is asked to stop.
+     * @return What identifies the watch for unwatch().
+     */
+    uint64_t watch(vm& machine, std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Stops watching a machine, the watchdog does not touch it after this returns.
+     *
+     * @param ticket What watch() gave back.
+     * @return True if the deadline passed and the machine was asked to stop.
+     */
+    bool unwatch(uint64_t ticket);
+
+    /** @return The number of machines watched. */
+    size_t watched() const;
+
+    /** @return The number of machines asked to stop since the watchdog was created. */
+    uint64_t stopped() const;
+
+private:
+
+    struct entry
+    {
+        vm* machine = nullptr;
+        std::chrono::steady_clock::time_point deadline;
+        bool fired = false;
+    };
+
+    void work();
+    watched_run run_watched(vm& machine, std::chrono::steady_clock::duration limit);
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_changed;      // signalled when a nearer deadline comes or the watchdog stops
+    std::unordered_map<uint64_t, entry> m_entries;
+    std::multimap<std::chrono::steady_clock::time_point, uint64_t> m_deadlines;    // of the entries not fired yet
+    uint64_t m_next = 0;
+    uint64_t m_stopped = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+}
+
+#endif // PRIMAL_VM_WATCHDOG_H